@@ -9,12 +9,31 @@ LOCAL_EXPORT_C_INCLUDES := $(LOCAL_PATH)/include
 # Public API headers - top level headers first
 # This header list is currently used to generate a python binding
 LOCAL_EXPORT_CUSTOM_VARIABLES := LIBMETADATATHERMAL_HEADERS=$\
-	$(LOCAL_PATH)/include/metadata-thermal/tmeta.h;
+	$(LOCAL_PATH)/include/metadata-thermal/tmeta.h:$\
+	$(LOCAL_PATH)/include/metadata-thermal/tmeta_accum.h:$\
+	$(LOCAL_PATH)/include/metadata-thermal/tmeta_archive.h:$\
+	$(LOCAL_PATH)/include/metadata-thermal/tmeta_colorize.h:$\
+	$(LOCAL_PATH)/include/metadata-thermal/tmeta_gen.h:$\
+	$(LOCAL_PATH)/include/metadata-thermal/tmeta_hotspot.h:$\
+	$(LOCAL_PATH)/include/metadata-thermal/tmeta_remap.h:$\
+	$(LOCAL_PATH)/include/metadata-thermal/tmeta_rescale.h:$\
+	$(LOCAL_PATH)/include/metadata-thermal/tmeta_stats.h;
 
 LOCAL_CFLAGS := -DTMETA_API_EXPORTS -fvisibility=hidden -std=gnu99
 
 LOCAL_SRC_FILES := \
-	src/tmeta.c
+	src/tmeta.c \
+	src/tmeta_accum.c \
+	src/tmeta_archive.c \
+	src/tmeta_colorize.c \
+	src/tmeta_crc32c.c \
+	src/tmeta_gen.c \
+	src/tmeta_hotspot.c \
+	src/tmeta_json.c \
+	src/tmeta_radiometry.c \
+	src/tmeta_remap.c \
+	src/tmeta_rescale.c \
+	src/tmeta_stats.c
 
 LOCAL_PRIVATE_LIBRARIES := \
 	json \
@@ -22,6 +41,31 @@ LOCAL_PRIVATE_LIBRARIES := \
 
 ifeq ("$(TARGET_OS)","windows")
   LOCAL_LDLIBS += -lws2_32
+else ifneq ("$(TARGET_OS_FLAVOUR)","android")
+  LOCAL_LDLIBS += -lpthread
 endif
 
 include $(BUILD_LIBRARY)
+
+
+ifneq ("$(TARGET_OS)","windows")
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := tmeta-loadtest
+LOCAL_CATEGORY_PATH := libs/metadata-thermal
+LOCAL_DESCRIPTION := Parrot Drones thermal metadata load test tool
+LOCAL_CFLAGS := -std=gnu99
+
+LOCAL_SRC_FILES := \
+	tools/tmeta_loadtest.c
+
+LOCAL_LIBRARIES := \
+	json \
+	libmetadata-thermal
+
+LOCAL_LDLIBS += -lpthread
+
+include $(BUILD_EXECUTABLE)
+
+endif
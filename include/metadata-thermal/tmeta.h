@@ -31,6 +31,7 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <errno.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -56,33 +57,33 @@ struct json_object;
 /**
  * Global data structure
  *
- * +---+---+------------------------------------------------------+----------+-----------+------+
- * | U | V |                                                      |          |           |      |
- * | U | E |                    V0.1                              |   V0.2   |   V0.3    | V0.4 |
- * | I | R |                                                      |          |           |      |
- * | D | S +-----------------------+------------------------------+----------+-----------+------+
- * |   | I |                       |                              |          |           |   T  |
- * | S | O |     HEADER            |      DATA (VARIABLE SIZE)    | SHUTTER  |   TEMP    |   H  |
- * | E | N |                       |                              |  STATE   |           |   E  |
- * | I |   +---+---+---+---+---+---+-----------+------------------+----------+---+---+---+   R  |
- * |   |   | G | C | J | M | A | D |           |                  |          | F | H | W |   M  |
- * |   |   | A | A | P | I | T | A |           |                  |          | P | O | I |   A  |
- * |   |   | I | L | G | N | T | T | TELEMETRY |   JPG THERMAL    |          | A | U | N |   L  |
- * |   |   | N | I |   | / | I | A |           |                  |          |   | S | D |      |
- * |   |   |   | B | D | M | T |   |           |                  |          | T | I | O |   C  |
- * |   |   | M | R | A | A | U | C +-------+---+------------------+          | E | N | W |   A  |
- * |   |   | O | A | T | X | D | O |   C   | T |                             | M | G |   |   M  |
- * |   |   | D | T | A |   | E | U |   A   | I |                             | P |   | R |   E  |
- * |   |   | E | I |   | T |   | N |   M   | M |                             |   | T | E |   R  |
- * |   |   |   | O | S | E |   | T |       | E |                             |   | E | F |   A  |
- * |   |   |   | N | I | M |   |   |   A   | S |                             |   | M | L |      |
- * |   |   |   |   | Z | P |   |   |   N   | T |                             |   | P | E |   A  |
- * |   |   |   |   | E |   |   |   |   G   | A |                             |   |   | C |   L  |
- * |   |   |   |   |   |   |   |   |   L   | M |                             |   |   | T |   I  |
- * |   |   |   |   |   |   |   |   |   E   | P |                             |   |   | I |   G  |
- * |   |   |   |   |   |   |   |   |   S   | S |                             |   |   | O |   N  |
- * +---+---+---+---+---+---+---+---+-------+---+                             |   |   | N |      |
- *                                                                           +---+---+---+------+
+ * +---+---+------------------------------------------------------+----------+-----------+------+------+
+ * | U | V |                                                      |          |           |      |      |
+ * | U | E |                    V0.1                              |   V0.2   |   V0.3    | V0.4 | V0.5 |
+ * | I | R |                                                      |          |           |      |      |
+ * | D | S +-----------------------+------------------------------+----------+-----------+------+------+
+ * |   | I |                       |                              |          |           |   T  |   C  |
+ * | S | O |     HEADER            |      DATA (VARIABLE SIZE)    | SHUTTER  |   TEMP    |   H  |   R  |
+ * | E | N |                       |                              |  STATE   |           |   E  |   C  |
+ * | I |   +---+---+---+---+---+---+-----------+------------------+----------+---+---+---+   R  |   3  |
+ * |   |   | G | C | J | M | A | D |           |                  |          | F | H | W |   M  |   2  |
+ * |   |   | A | A | P | I | T | A |           |                  |          | P | O | I |   A  |   C  |
+ * |   |   | I | L | G | N | T | T | TELEMETRY |   JPG THERMAL    |          | A | U | N |   L  |      |
+ * |   |   | N | I |   | / | I | A |           |                  |          |   | S | D |      |      |
+ * |   |   |   | B | D | M | T |   |           |                  |          | T | I | O |   C  |      |
+ * |   |   | M | R | A | A | U | C +-------+---+------------------+          | E | N | W |   A  |      |
+ * |   |   | O | A | T | X | D | O |   C   | T |                             | M | G |   |   M  |      |
+ * |   |   | D | T | A |   | E | U |   A   | I |                             | P |   | R |   E  |      |
+ * |   |   | E | I |   | T |   | N |   M   | M |                             |   | T | E |   R  |      |
+ * |   |   |   | O | S | E |   | T |       | E |                             |   | E | F |   A  |      |
+ * |   |   |   | N | I | M |   |   |   A   | S |                             |   | M | L |      |      |
+ * |   |   |   |   | Z | P |   |   |   N   | T |                             |   | P | E |   A  |      |
+ * |   |   |   |   | E |   |   |   |   G   | A |                             |   |   | C |   L  |      |
+ * |   |   |   |   |   |   |   |   |   L   | M |                             |   |   | T |   I  |      |
+ * |   |   |   |   |   |   |   |   |   E   | P |                             |   |   | I |   G  |      |
+ * |   |   |   |   |   |   |   |   |   S   | S |                             |   |   | O |   N  |      |
+ * +---+---+---+---+---+---+---+---+-------+---+                             |   |   | N |      |      |
+ *                                                                           +---+---+---+------+------+
  */
 /* clang-format on */
 
@@ -111,20 +112,31 @@ struct json_object;
 /* Version 0.4 added size */
 #define TMETA_V0_4_DATA_SIZE (4 * sizeof(float)) /* thermal cam alignment */
 
+/* Version 0.5 added size; the CRC32C checksum covers the data from the
+ * version to the end of the v0.4 data */
+#define TMETA_V0_5_DATA_SIZE sizeof(uint32_t) /* checksum */
+
 /* Total buffer size */
 #define TMETA_BUF_SIZE(meta)                                                   \
 	(TMETA_SEI_UUID_SIZE + TMETA_VERSION_SIZE + TMETA_V0_1_HEADER_SIZE +   \
 	 sizeof(float) * (meta)->cam_angles_count * 4 +                        \
 	 sizeof(uint64_t) * (meta)->cam_angles_count +                         \
 	 (meta)->jpeg_data_size + TMETA_V0_2_DATA_SIZE +                       \
-	 TMETA_V0_3_DATA_SIZE + TMETA_V0_4_DATA_SIZE)
+	 TMETA_V0_3_DATA_SIZE + TMETA_V0_4_DATA_SIZE + TMETA_V0_5_DATA_SIZE)
 
 
 /* Current version major number */
 #define TMETA_MAJOR_VERSION 0x0
 
-/* Current version minor number */
-#define TMETA_MINOR_VERSION 0x4
+/* Current version minor number; this is the version written by default
+ * by tmeta_serialize_thermal_metadata_user_data_sei(), which includes the
+ * v0.5 checksum trailer */
+#define TMETA_MINOR_VERSION 0x5
+
+/* Latest version minor number without the checksum trailer, for receivers
+ * that do not support version 0.5, see
+ * tmeta_serialize_thermal_metadata_user_data_sei_minor() */
+#define TMETA_MINOR_VERSION_NO_CHECKSUM 0x4
 
 /* Full version as 32bit value */
 #define TMETA_VERSION (TMETA_MAJOR_VERSION << 16 | TMETA_MINOR_VERSION)
@@ -138,6 +150,44 @@ struct json_object;
 #define TMETA_CAMANGLES_MAXCOUNT 50
 
 
+/* Deserialization error codes (negative errno values); the values are
+ * distinct from the other errors of the deserialization functions and
+ * from the -EDOM returned by the radiometry functions */
+
+/* Buffer too short for the SEI UUID and version */
+#define TMETA_ERR_SHORT_HEADER (-ENODATA)
+
+/* Unsupported major version */
+#define TMETA_ERR_BAD_MAJOR_VERSION (-EPROTONOSUPPORT)
+
+/* Buffer too short for the v0.1 fixed header */
+#define TMETA_ERR_TRUNCATED_HEADER (-EBADMSG)
+
+/* Camera angles count above TMETA_CAMANGLES_MAXCOUNT */
+#define TMETA_ERR_TOO_MANY_CAM_ANGLES (-E2BIG)
+
+/* Buffer too short for the v0.1 camera angles */
+#define TMETA_ERR_TRUNCATED_CAM_ANGLES (-ERANGE)
+
+/* Buffer too short for the v0.1 JPEG data */
+#define TMETA_ERR_TRUNCATED_JPEG (-EMSGSIZE)
+
+/* Buffer too short for the v0.2 data */
+#define TMETA_ERR_TRUNCATED_V0_2 (-ENOMSG)
+
+/* Buffer too short for the v0.3 data */
+#define TMETA_ERR_TRUNCATED_V0_3 (-EILSEQ)
+
+/* Buffer too short for the v0.4 data */
+#define TMETA_ERR_TRUNCATED_V0_4 (-EOVERFLOW)
+
+/* Buffer too short for the v0.5 data */
+#define TMETA_ERR_TRUNCATED_V0_5 (-ENOSR)
+
+/* Checksum mismatch (v0.5 and later): the SEI is corrupted */
+#define TMETA_ERR_BAD_CHECKSUM (-EIO)
+
+
 /* Thermal gain mode */
 enum tmeta_thermal_gain_mode {
 	/* FLIR low gain mode */
@@ -247,6 +297,103 @@ struct tmeta_data {
 };
 
 
+/* Thermal metadata with caller-owned camera angles storage.
+ * The fields have the same meaning as in struct tmeta_data, except for the
+ * camera angles: their count is not limited to TMETA_CAMANGLES_MAXCOUNT
+ * and they are stored either in arrays provided by the caller or in the
+ * SEI buffer, so that the structure size does not depend on the maximum
+ * camera angles count */
+struct tmeta_data_ext {
+	/* Version 0.1 base */
+
+	/* Structure format version (major number as high 16 bits, minor number
+	 * as low 16 bits) */
+	uint32_t version;
+
+	/* Active gain mode for this frame, serialized as a uint32_t value */
+	enum tmeta_thermal_gain_mode gain_mode;
+
+	/* R calibration value for this frame */
+	double calib_r;
+
+	/* B calibration value for this frame */
+	double calib_b;
+
+	/* F calibration value for this frame */
+	double calib_f;
+
+	/* O calibration value for this frame */
+	double calib_o;
+
+	/* tauWin calibration value for this frame */
+	double calib_tau_win;
+
+	/* tWin calibration value for this frame */
+	double calib_t_win;
+
+	/* tBg calibration value for this frame */
+	double calib_t_bg;
+
+	/* Emissivity calibration value for this frame */
+	double calib_emissivity;
+
+	/* Size in bytes of the JPEG data */
+	uint32_t jpeg_data_size;
+
+	/* Mininmum raw thermal value for this frame */
+	uint32_t value_min;
+
+	/* Maximum raw thermal value for this frame */
+	uint32_t value_max;
+
+	/* Drone attitude reference quaternion (x, y, z, w) */
+	float attitude_reference_quat[4];
+
+	/* Camera angles count */
+	uint32_t cam_angles_count;
+
+	/* Capacity in number of camera angles of the cam_angles and
+	 * cam_angles_timestamps arrays */
+	uint32_t cam_angles_capacity;
+
+	/* Caller-owned camera angles quaternions (x, y, z, w), 4 floats per
+	 * camera angle, or NULL */
+	float *cam_angles;
+
+	/* Caller-owned camera angles timestamps in microseconds, or NULL */
+	uint64_t *cam_angles_timestamps;
+
+	/* Pointer to the camera angles in their serialized form in the SEI
+	 * buffer (use tmeta_data_ext_get_cam_angle() to read them) */
+	const void *cam_angles_data;
+
+	/* Pointer to the scaled raw thermal values encoded as an
+	 * 8bit JPEG image */
+	void *jpeg_data;
+
+	/* Added in version 0.2 */
+
+	/* Thermal shutter state */
+	enum tmeta_thermal_frame_state frame_state;
+
+	/* Added in version 0.3 */
+
+	/* Temperature of the focal plane array */
+	double fpa_temp;
+
+	/* Temperature measured by the housing thermistor */
+	double housing_temp;
+
+	/* Window reflected temperature */
+	double window_reflection;
+
+	/* Added in version 0.4 */
+
+	/* Thermal camera alignment quaternion (x, y, z, w) */
+	float thermal_to_visible_quat[4];
+};
+
+
 /* Thermal metadata user data SEI UUID;
  * UUID: a4897b82-4415-4171-b46a-bc8cd524c77e */
 #define TMETA_USER_DATA_SEI_UUID_0 0xa4897b82
@@ -278,7 +425,8 @@ bool tmeta_is_thermal_metadata_user_data_sei(const void *buf, size_t buf_size);
 /**
  * Serialize a thermal metadata user data SEI.
  * The function parses a thermal metadata structure and fills the user data
- * SEI buffer. buf_size must be at least TMETA_BUF_SIZE(meta).
+ * SEI buffer with the current version (TMETA_MINOR_VERSION, including the
+ * checksum trailer). buf_size must be at least TMETA_BUF_SIZE(meta).
  * @param meta: pointer to the thermal metadata structure
  * @param buf: pointer to the user data SEI buffer to fill (output)
  * @param buf_size: size in bytes of the user data SEI buffer
@@ -293,6 +441,29 @@ int tmeta_serialize_thermal_metadata_user_data_sei(
 	size_t *size);
 
 
+/**
+ * Serialize a thermal metadata user data SEI with a given minor version.
+ * This is the same as tmeta_serialize_thermal_metadata_user_data_sei()
+ * but the fields added after the given minor version are not written,
+ * e.g. TMETA_MINOR_VERSION_NO_CHECKSUM omits the checksum trailer for
+ * receivers that predate version 0.5. buf_size must be at least
+ * TMETA_BUF_SIZE(meta).
+ * @param meta: pointer to the thermal metadata structure
+ * @param minor: minor version, 1 to TMETA_MINOR_VERSION
+ * @param buf: pointer to the user data SEI buffer to fill (output)
+ * @param buf_size: size in bytes of the user data SEI buffer
+ * @param size: pointer to the final user data SEI size in bytes (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_serialize_thermal_metadata_user_data_sei_minor(
+	const struct tmeta_data *meta,
+	unsigned int minor,
+	void *buf,
+	size_t buf_size,
+	size_t *size);
+
+
 /**
  * Deserialize a thermal metadata user data SEI.
  * The function parses a thermal metadata user data SEI and fills the
@@ -300,7 +471,9 @@ int tmeta_serialize_thermal_metadata_user_data_sei(
  * @param buf: pointer to the user data SEI buffer
  * @param buf_size: size in bytes of the user data SEI
  * @param meta: pointer to the thermal metadata structure to fill (output)
- * @return 0 on success, negative errno value in case of error
+ * @return 0 on success, negative errno value in case of error:
+ *         -ENOENT if the SEI UUID does not match, or one of the
+ *         TMETA_ERR_* deserialization error codes
  */
 TMETA_API
 int tmeta_deserialize_thermal_metadata_user_data_sei(const void *buf,
@@ -308,6 +481,112 @@ int tmeta_deserialize_thermal_metadata_user_data_sei(const void *buf,
 						     struct tmeta_data *meta);
 
 
+/**
+ * Serialize a thermal metadata user data SEI from a structure with
+ * caller-owned camera angles storage.
+ * The camera angles are read from the cam_angles and cam_angles_timestamps
+ * arrays if both are set (cam_angles_count must not exceed
+ * cam_angles_capacity), otherwise from cam_angles_data (e.g. to serialize
+ * again a structure filled by
+ * tmeta_deserialize_thermal_metadata_user_data_sei_ext() without camera
+ * angles storage). buf_size must be at least TMETA_BUF_SIZE(meta).
+ * @param meta: pointer to the thermal metadata structure
+ * @param buf: pointer to the user data SEI buffer to fill (output)
+ * @param buf_size: size in bytes of the user data SEI buffer
+ * @param size: pointer to the final user data SEI size in bytes (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_serialize_thermal_metadata_user_data_sei_ext(
+	const struct tmeta_data_ext *meta,
+	void *buf,
+	size_t buf_size,
+	size_t *size);
+
+
+/**
+ * Serialize a thermal metadata user data SEI from a structure with
+ * caller-owned camera angles storage with a given minor version.
+ * This is the same as tmeta_serialize_thermal_metadata_user_data_sei_ext()
+ * but the fields added after the given minor version are not written, as
+ * with tmeta_serialize_thermal_metadata_user_data_sei_minor().
+ * @param meta: pointer to the thermal metadata structure
+ * @param minor: minor version, 1 to TMETA_MINOR_VERSION
+ * @param buf: pointer to the user data SEI buffer to fill (output)
+ * @param buf_size: size in bytes of the user data SEI buffer
+ * @param size: pointer to the final user data SEI size in bytes (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_serialize_thermal_metadata_user_data_sei_ext_minor(
+	const struct tmeta_data_ext *meta,
+	unsigned int minor,
+	void *buf,
+	size_t buf_size,
+	size_t *size);
+
+
+/**
+ * Deserialize a thermal metadata user data SEI into a structure with
+ * caller-owned camera angles storage.
+ * The cam_angles, cam_angles_timestamps and cam_angles_capacity fields
+ * must be set by the caller before the call; all other fields are filled.
+ * cam_angles_data (like jpeg_data) always points to the SEI buffer, which
+ * must therefore outlive the structure. If cam_angles or
+ * cam_angles_timestamps are set, the camera angles are also copied to
+ * these arrays; when the camera angles count exceeds cam_angles_capacity,
+ * nothing is copied, -ENOBUFS is returned and cam_angles_count holds the
+ * required capacity. When both arrays are NULL, no copy is done and the
+ * camera angles count is not limited.
+ * @param buf: pointer to the user data SEI buffer
+ * @param buf_size: size in bytes of the user data SEI
+ * @param meta: pointer to the thermal metadata structure to fill
+ *              (input/output)
+ * @return 0 on success, -ENOBUFS if the camera angles storage is too
+ *         small, negative errno value in case of error: -ENOENT if the
+ *         SEI UUID does not match, or one of the TMETA_ERR_*
+ *         deserialization error codes
+ */
+TMETA_API
+int tmeta_deserialize_thermal_metadata_user_data_sei_ext(
+	const void *buf,
+	size_t buf_size,
+	struct tmeta_data_ext *meta);
+
+
+/**
+ * Get a camera angle from a structure with caller-owned camera angles
+ * storage.
+ * The camera angle is read from the cam_angles and cam_angles_timestamps
+ * arrays when they are set, otherwise from cam_angles_data.
+ * @param meta: pointer to the thermal metadata structure
+ * @param index: index of the camera angle, below cam_angles_count
+ * @param quat: camera angle quaternion (x, y, z, w) (output, optional)
+ * @param timestamp: pointer to the camera angle timestamp in microseconds
+ *                   (output, optional)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_data_ext_get_cam_angle(const struct tmeta_data_ext *meta,
+				 uint32_t index,
+				 float quat[4],
+				 uint64_t *timestamp);
+
+
+/**
+ * Convert a structure with caller-owned camera angles storage to a
+ * struct tmeta_data, e.g. to use the JSON or radiometry functions.
+ * @param meta_ext: pointer to the thermal metadata structure to convert
+ * @param meta: pointer to the thermal metadata structure to fill (output)
+ * @return 0 on success, TMETA_ERR_TOO_MANY_CAM_ANGLES if the camera
+ *         angles count exceeds TMETA_CAMANGLES_MAXCOUNT, negative errno
+ *         value in case of error
+ */
+TMETA_API
+int tmeta_data_ext_to_data(const struct tmeta_data_ext *meta_ext,
+			   struct tmeta_data *meta);
+
+
 /**
  * Get an enum tmeta_thermal_gain_mode value from a string.
  * Valid strings are only the suffix of the gain mode name
@@ -363,6 +642,86 @@ int tmeta_thermal_metadata_to_json(const struct tmeta_data *meta,
 				   struct json_object *jobj);
 
 
+/**
+ * Read thermal metadata from a JSON object.
+ * The JSON object must follow the format written by
+ * tmeta_thermal_metadata_to_json(); missing fields are set to 0. The JPEG
+ * data is not part of the JSON format: jpeg_data is set to NULL.
+ * The ownership of the JSON object stays with the caller.
+ * @param jobj: pointer to the JSON object to read from
+ * @param meta: pointer to the thermal metadata structure to fill (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_thermal_metadata_from_json(struct json_object *jobj,
+				     struct tmeta_data *meta);
+
+
+/**
+ * Read thermal metadata from a JSON string.
+ * This is an allocation-free alternative to
+ * tmeta_thermal_metadata_from_json() that parses the JSON text directly;
+ * values written by tmeta_thermal_metadata_to_json() are read back
+ * exactly. The string must start with a JSON object (leading whitespace is
+ * ignored); the number of bytes consumed, including the whitespace
+ * following the object, is returned so that newline-delimited JSON can be
+ * parsed by calling the function in a loop. On a parsing error, the bytes
+ * up to the end of the line where the object starts are reported as
+ * consumed so that the loop can resume with the next line; on a camera
+ * angles count mismatch (-EPROTO on a well-formed object), the whole
+ * object is reported as consumed.
+ * @param str: pointer to the JSON string (does not need to be
+ *             null-terminated)
+ * @param len: length in bytes of the JSON string
+ * @param meta: pointer to the thermal metadata structure to fill (output)
+ * @param consumed: pointer to the number of bytes consumed (output,
+ *                  optional)
+ * @return 0 on success, -ENODATA if the string only contains whitespace,
+ *         negative errno value in case of error
+ */
+TMETA_API
+int tmeta_thermal_metadata_from_json_str(const char *str,
+					 size_t len,
+					 struct tmeta_data *meta,
+					 size_t *consumed);
+
+
+/**
+ * Convert a raw thermal value to a temperature.
+ * The object temperature is computed from the calibration values of the
+ * frame (calib_r, calib_b, calib_f, calib_o, calib_emissivity,
+ * calib_tau_win, calib_t_win, calib_t_bg) using the Planck curve
+ * raw = R / (exp(B / T) - F) + O and compensating for the reflected
+ * background (emissivity) and for the window transmission and emission;
+ * temperatures are in Kelvin. For the 8-bit JPEG values, the raw value is
+ * value_min + v * (value_max - value_min) / 255.
+ * @param meta: pointer to the thermal metadata of the frame
+ * @param raw: raw thermal value
+ * @param temp: pointer to the temperature in Kelvin (output)
+ * @return 0 on success, -EDOM if the raw value is outside of the range of
+ *         the calibration curve, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_raw_to_temperature(const struct tmeta_data *meta,
+			     double raw,
+			     double *temp);
+
+
+/**
+ * Convert a temperature to a raw thermal value.
+ * This is the inverse of tmeta_raw_to_temperature().
+ * @param meta: pointer to the thermal metadata of the frame
+ * @param temp: temperature in Kelvin
+ * @param raw: pointer to the raw thermal value (output)
+ * @return 0 on success, -EDOM if the temperature is outside of the range
+ *         of the calibration curve, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_temperature_to_raw(const struct tmeta_data *meta,
+			     double temp,
+			     double *raw);
+
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
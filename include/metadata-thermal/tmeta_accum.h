@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_ACCUM_H_
+#define _TMETA_ACCUM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <metadata-thermal/tmeta.h>
+
+
+/* Temporal accumulator configuration */
+struct tmeta_accum_config {
+	/* Frame width in pixels */
+	unsigned int width;
+
+	/* Frame height in pixels */
+	unsigned int height;
+
+	/* Sliding window length in frames; 0 selects the default value */
+	unsigned int window;
+
+	/* Persistence threshold temperature in Kelvin */
+	double threshold;
+};
+
+
+/* Temporal accumulator information */
+struct tmeta_accum_info {
+	/* Number of frames currently in the sliding window */
+	unsigned int window_frames;
+
+	/* Total number of accumulated frames */
+	uint64_t frames;
+
+	/* Total number of skipped (not valid) frames */
+	uint64_t skipped_frames;
+};
+
+
+/* Forward declaration */
+struct tmeta_accum;
+
+
+/**
+ * Create a temporal accumulator.
+ * The accumulator computes per-pixel maximum, mean and persistence maps
+ * over a sliding window of frames. The frames are converted to
+ * temperatures using the calibration values of each frame so that frames
+ * with different value_min/value_max scaling or calibration can be
+ * combined; temperatures are stored with a resolution of 1/64 K. The maps
+ * are updated incrementally: the cost of adding any frame (not only on
+ * average) does not depend on the window length. The memory used is about
+ * twice the window length in 16-bit planes of the frame size.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * tmeta_accum_destroy() function.
+ * @param config: accumulator configuration
+ * @param ret_obj: accumulator instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_accum_new(const struct tmeta_accum_config *config,
+		    struct tmeta_accum **ret_obj);
+
+
+/**
+ * Free a temporal accumulator.
+ * @param self: accumulator instance handle
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_accum_destroy(struct tmeta_accum *self);
+
+
+/**
+ * Reset a temporal accumulator.
+ * All frames are removed from the sliding window and the counters are
+ * reset.
+ * @param self: accumulator instance handle
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_accum_reset(struct tmeta_accum *self);
+
+
+/**
+ * Add a frame to a temporal accumulator.
+ * The frame is the decoded 8-bit JPEG image of the thermal metadata and
+ * must have the configured size. Frames that are not valid (see
+ * frame_state) are skipped and do not enter the sliding window; the oldest
+ * frame is evicted when the window is full.
+ * @param self: accumulator instance handle
+ * @param frame: pointer to the 8-bit frame
+ * @param stride: frame stride in bytes
+ * @param meta: pointer to the thermal metadata of the frame
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_accum_push(struct tmeta_accum *self,
+		     const uint8_t *frame,
+		     size_t stride,
+		     const struct tmeta_data *meta);
+
+
+/**
+ * Get the temporal accumulator information.
+ * @param self: accumulator instance handle
+ * @param info: pointer to the information structure (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_accum_get_info(struct tmeta_accum *self,
+			 struct tmeta_accum_info *info);
+
+
+/**
+ * Get the per-pixel maximum temperature map over the sliding window.
+ * @param self: accumulator instance handle
+ * @param dst: pointer to the temperature map in Kelvin (output)
+ * @param dst_stride: temperature map stride in bytes (must be a multiple
+ *                    of sizeof(float))
+ * @return 0 on success, -EAGAIN if the window is empty, negative errno
+ *         value in case of error
+ */
+TMETA_API
+int tmeta_accum_get_max(struct tmeta_accum *self,
+			float *dst,
+			size_t dst_stride);
+
+
+/**
+ * Get the per-pixel mean temperature map over the sliding window.
+ * @param self: accumulator instance handle
+ * @param dst: pointer to the temperature map in Kelvin (output)
+ * @param dst_stride: temperature map stride in bytes (must be a multiple
+ *                    of sizeof(float))
+ * @return 0 on success, -EAGAIN if the window is empty, negative errno
+ *         value in case of error
+ */
+TMETA_API
+int tmeta_accum_get_mean(struct tmeta_accum *self,
+			 float *dst,
+			 size_t dst_stride);
+
+
+/**
+ * Get the per-pixel persistence maps over the sliding window.
+ * The count map is the number of frames of the window above the threshold
+ * temperature; the streak map is the number of consecutive frames above
+ * the threshold temperature up to the most recent frame (saturated to
+ * UINT16_MAX). Both maps are optional.
+ * @param self: accumulator instance handle
+ * @param count: pointer to the count map (output, optional)
+ * @param count_stride: count map stride in bytes (must be a multiple of
+ *                      sizeof(uint16_t))
+ * @param streak: pointer to the streak map (output, optional)
+ * @param streak_stride: streak map stride in bytes (must be a multiple of
+ *                       sizeof(uint16_t))
+ * @return 0 on success, -EAGAIN if the window is empty, negative errno
+ *         value in case of error
+ */
+TMETA_API
+int tmeta_accum_get_persistence(struct tmeta_accum *self,
+				uint16_t *count,
+				size_t count_stride,
+				uint16_t *streak,
+				size_t streak_stride);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !_TMETA_ACCUM_H_ */
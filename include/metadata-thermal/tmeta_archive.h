@@ -0,0 +1,285 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_ARCHIVE_H_
+#define _TMETA_ARCHIVE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <metadata-thermal/tmeta.h>
+
+
+/* Archive query filters */
+enum tmeta_archive_filter {
+	/* Frame timestamp range filter */
+	TMETA_ARCHIVE_FILTER_TIME = (1 << 0),
+
+	/* Frame state filter */
+	TMETA_ARCHIVE_FILTER_FRAME_STATE = (1 << 1),
+
+	/* Raw value range filter */
+	TMETA_ARCHIVE_FILTER_RAW_VALUE = (1 << 2),
+
+	/* Camera angles timestamp range filter */
+	TMETA_ARCHIVE_FILTER_CAM_ANGLES_TIME = (1 << 3),
+
+	/* Focal plane array temperature range filter */
+	TMETA_ARCHIVE_FILTER_FPA_TEMP = (1 << 4),
+
+	/* Housing temperature range filter */
+	TMETA_ARCHIVE_FILTER_HOUSING_TEMP = (1 << 5),
+};
+
+
+/* Archive query; all ranges are inclusive */
+struct tmeta_archive_query {
+	/* Active filters (combination of enum tmeta_archive_filter) */
+	uint32_t filters;
+
+	/* TMETA_ARCHIVE_FILTER_TIME: frame timestamp range */
+	uint64_t ts_start;
+	uint64_t ts_end;
+
+	/* TMETA_ARCHIVE_FILTER_FRAME_STATE: accepted frame states, as a
+	 * combination of (1 << enum tmeta_thermal_frame_state) values */
+	uint32_t frame_state_mask;
+
+	/* TMETA_ARCHIVE_FILTER_RAW_VALUE: frames whose value_min..value_max
+	 * range intersects the raw_min..raw_max range */
+	uint32_t raw_min;
+	uint32_t raw_max;
+
+	/* TMETA_ARCHIVE_FILTER_CAM_ANGLES_TIME: frames with at least one
+	 * camera angle timestamp in the range */
+	uint64_t cam_ts_start;
+	uint64_t cam_ts_end;
+
+	/* TMETA_ARCHIVE_FILTER_FPA_TEMP: focal plane array temperature
+	 * range */
+	double fpa_temp_min;
+	double fpa_temp_max;
+
+	/* TMETA_ARCHIVE_FILTER_HOUSING_TEMP: housing temperature range */
+	double housing_temp_min;
+	double housing_temp_max;
+};
+
+
+/* Archive frame information (from the index, without parsing the
+ * metadata) */
+struct tmeta_archive_frame_info {
+	/* Frame timestamp */
+	uint64_t timestamp;
+
+	/* Thermal shutter state */
+	enum tmeta_thermal_frame_state frame_state;
+
+	/* Mininmum raw thermal value */
+	uint32_t value_min;
+
+	/* Maximum raw thermal value */
+	uint32_t value_max;
+
+	/* Size in bytes of the serialized metadata */
+	size_t size;
+};
+
+
+/* Forward declarations */
+struct tmeta_archive_writer;
+struct tmeta_archive_reader;
+
+
+/**
+ * Query callback function.
+ * @param reader: archive reader instance handle
+ * @param index: matching frame index
+ * @param info: matching frame information
+ * @param userdata: user data pointer
+ * @return 0 to continue the query, any other value to stop it
+ */
+typedef int (*tmeta_archive_query_cb_t)(
+	struct tmeta_archive_reader *reader,
+	unsigned int index,
+	const struct tmeta_archive_frame_info *info,
+	void *userdata);
+
+
+/**
+ * Create an archive writer.
+ * The archive stores the serialized thermal metadata user data SEIs
+ * followed by a sorted frame index and a block index with per-block
+ * summaries, written when the writer is destroyed. The file is flushed
+ * each time an index block is complete, so that an archive whose writer
+ * was not destroyed (e.g. after a crash) can still be opened by the
+ * reader, up to the last flushed frame.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * tmeta_archive_writer_destroy() function.
+ * @param path: archive file path
+ * @param block_frames: number of frames per index block, 0 selects the
+ *                      default value
+ * @param ret_obj: archive writer instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_archive_writer_new(const char *path,
+			     unsigned int block_frames,
+			     struct tmeta_archive_writer **ret_obj);
+
+
+/**
+ * Finalize the archive and free an archive writer.
+ * @param self: archive writer instance handle
+ * @return 0 on success, negative errno value in case of error (the
+ *         instance is freed anyway)
+ */
+TMETA_API
+int tmeta_archive_writer_destroy(struct tmeta_archive_writer *self);
+
+
+/**
+ * Append a frame to an archive.
+ * Frame timestamps must be non-decreasing.
+ * @param self: archive writer instance handle
+ * @param timestamp: frame timestamp (e.g. in microseconds)
+ * @param meta: pointer to the thermal metadata of the frame
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_archive_writer_append(struct tmeta_archive_writer *self,
+				uint64_t timestamp,
+				const struct tmeta_data *meta);
+
+
+/**
+ * Open an archive for reading.
+ * The archive file is memory-mapped; lookups and queries only use the
+ * indexes and do not parse the metadata unless needed. If the archive was
+ * not finalized (its writer was not destroyed), the indexes are rebuilt
+ * by scanning all frames, up to the first incomplete one.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * tmeta_archive_reader_destroy() function.
+ * @param path: archive file path
+ * @param ret_obj: archive reader instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_archive_reader_new(const char *path,
+			     struct tmeta_archive_reader **ret_obj);
+
+
+/**
+ * Free an archive reader.
+ * @param self: archive reader instance handle
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_archive_reader_destroy(struct tmeta_archive_reader *self);
+
+
+/**
+ * Get the number of frames in an archive.
+ * @param self: archive reader instance handle
+ * @return the frame count on success, negative errno value in case of
+ *         error
+ */
+TMETA_API
+int tmeta_archive_reader_get_frame_count(struct tmeta_archive_reader *self);
+
+
+/**
+ * Find the frame at a given time.
+ * The function returns the last frame with a timestamp lower than or equal
+ * to the given timestamp.
+ * @param self: archive reader instance handle
+ * @param timestamp: timestamp to look for
+ * @param index: pointer to the frame index (output)
+ * @return 0 on success, -ENOENT if all frames are after the timestamp,
+ *         negative errno value in case of error
+ */
+TMETA_API
+int tmeta_archive_reader_find(struct tmeta_archive_reader *self,
+			      uint64_t timestamp,
+			      unsigned int *index);
+
+
+/**
+ * Get a frame information from the index.
+ * @param self: archive reader instance handle
+ * @param index: frame index
+ * @param info: pointer to the frame information (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_archive_reader_get_info(struct tmeta_archive_reader *self,
+				  unsigned int index,
+				  struct tmeta_archive_frame_info *info);
+
+
+/**
+ * Get a frame metadata.
+ * The jpeg_data pointer of the metadata points to the memory-mapped
+ * archive and is valid until the reader is destroyed.
+ * @param self: archive reader instance handle
+ * @param index: frame index
+ * @param meta: pointer to the thermal metadata structure to fill (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_archive_reader_get(struct tmeta_archive_reader *self,
+			     unsigned int index,
+			     struct tmeta_data *meta);
+
+
+/**
+ * Query the frames of an archive.
+ * The callback function is called for each matching frame in timestamp
+ * order. Blocks are skipped using their summaries, then frames are
+ * filtered using the frame index; the metadata are only parsed for the
+ * camera angles timestamp and temperature filters.
+ * @param self: archive reader instance handle
+ * @param query: query filters
+ * @param cb: callback function
+ * @param userdata: user data pointer passed to the callback function
+ * @return the number of matching frames on success, negative errno value
+ *         in case of error
+ */
+TMETA_API
+int tmeta_archive_reader_query(struct tmeta_archive_reader *self,
+			       const struct tmeta_archive_query *query,
+			       tmeta_archive_query_cb_t cb,
+			       void *userdata);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !_TMETA_ARCHIVE_H_ */
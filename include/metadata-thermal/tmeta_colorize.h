@@ -0,0 +1,251 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_COLORIZE_H_
+#define _TMETA_COLORIZE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <metadata-thermal/tmeta.h>
+
+
+/* Palette LUT size (one entry per 8-bit JPEG value) */
+#define TMETA_PALETTE_SIZE 256
+
+
+/* Palette */
+enum tmeta_palette {
+	/* Iron palette (black, purple, red, orange, yellow, white) */
+	TMETA_PALETTE_IRON = 0,
+
+	/* Rainbow palette (blue, cyan, green, yellow, red) */
+	TMETA_PALETTE_RAINBOW,
+
+	/* White hot grayscale palette */
+	TMETA_PALETTE_WHITE_HOT,
+
+	/* Black hot grayscale palette */
+	TMETA_PALETTE_BLACK_HOT,
+
+	/* User-provided palette */
+	TMETA_PALETTE_USER,
+};
+
+
+/* Display range mode */
+enum tmeta_range_mode {
+	/* Use the value_min..value_max range of each frame; the display
+	 * follows the per-frame scaling and may flicker */
+	TMETA_RANGE_MODE_FRAME = 0,
+
+	/* Use an exponential moving average of the value_min..value_max
+	 * ranges; the range is locked while the frame state is not valid
+	 * (shutter events) */
+	TMETA_RANGE_MODE_SMOOTHED,
+
+	/* Use a fixed raw range */
+	TMETA_RANGE_MODE_FIXED,
+};
+
+
+/* RGBA color, 8 bits per component, in memory order */
+struct tmeta_color {
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+	uint8_t a;
+};
+
+
+/* Colorizer configuration */
+struct tmeta_colorizer_config {
+	/* Palette */
+	enum tmeta_palette palette;
+
+	/* User palette (TMETA_PALETTE_SIZE entries, from coldest to
+	 * hottest); mandatory if palette is TMETA_PALETTE_USER, ignored
+	 * otherwise; the palette is copied */
+	const struct tmeta_color *user_palette;
+
+	/* Display range mode */
+	enum tmeta_range_mode range_mode;
+
+	/* Smoothing factor of the moving average in ]0..1] for
+	 * TMETA_RANGE_MODE_SMOOTHED; the higher the factor, the faster the
+	 * range follows the frames; 0 selects the default value */
+	float smoothing;
+
+	/* Raw range for TMETA_RANGE_MODE_FIXED */
+	uint32_t fixed_min;
+	uint32_t fixed_max;
+};
+
+
+/* Forward declaration */
+struct tmeta_colorizer;
+
+
+/**
+ * Create a colorizer.
+ * The colorizer composes the per-frame 8-bit to raw rescale, the display
+ * range and the palette into a single 256-entry RGBA lookup table that is
+ * updated for each frame by tmeta_colorizer_update() and applied to the
+ * 8-bit decoded JPEG image by tmeta_colorizer_apply().
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * tmeta_colorizer_destroy() function.
+ * @param config: colorizer configuration
+ * @param ret_obj: colorizer instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_colorizer_new(const struct tmeta_colorizer_config *config,
+			struct tmeta_colorizer **ret_obj);
+
+
+/**
+ * Free a colorizer.
+ * @param self: colorizer instance handle
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_colorizer_destroy(struct tmeta_colorizer *self);
+
+
+/**
+ * Change the colorizer palette.
+ * The lookup table is rebuilt on the next call to tmeta_colorizer_update().
+ * @param self: colorizer instance handle
+ * @param palette: palette
+ * @param user_palette: user palette (TMETA_PALETTE_SIZE entries);
+ *                      mandatory if palette is TMETA_PALETTE_USER
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_colorizer_set_palette(struct tmeta_colorizer *self,
+				enum tmeta_palette palette,
+				const struct tmeta_color *user_palette);
+
+
+/**
+ * Reset the smoothed display range.
+ * The next frame range is used as is; this should be called on a stream
+ * discontinuity (e.g. seek).
+ * @param self: colorizer instance handle
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_colorizer_reset(struct tmeta_colorizer *self);
+
+
+/**
+ * Update the colorizer for a new frame.
+ * The function updates the display range according to the range mode and
+ * rebuilds the lookup table for the frame value_min..value_max scaling.
+ * @param self: colorizer instance handle
+ * @param meta: pointer to the thermal metadata of the frame
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_colorizer_update(struct tmeta_colorizer *self,
+			   const struct tmeta_data *meta);
+
+
+/**
+ * Get the current display range.
+ * @param self: colorizer instance handle
+ * @param min: pointer to the minimum raw value (output, optional)
+ * @param max: pointer to the maximum raw value (output, optional)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_colorizer_get_range(struct tmeta_colorizer *self,
+			      double *min,
+			      double *max);
+
+
+/**
+ * Get the current lookup table.
+ * The table has TMETA_PALETTE_SIZE entries indexed by the 8-bit JPEG value;
+ * it is valid until the next call to tmeta_colorizer_update() or
+ * tmeta_colorizer_destroy().
+ * @param self: colorizer instance handle
+ * @return a pointer to the lookup table, or NULL in case of error
+ */
+TMETA_API
+const struct tmeta_color *
+tmeta_colorizer_get_lut(struct tmeta_colorizer *self);
+
+
+/**
+ * Colorize an 8-bit thermal image.
+ * The source image is the decoded 8-bit JPEG image of the frame last
+ * passed to tmeta_colorizer_update(); the destination image is RGBA with
+ * 4 bytes per pixel.
+ * @param self: colorizer instance handle
+ * @param src: pointer to the 8-bit source image
+ * @param src_stride: source image stride in bytes
+ * @param dst: pointer to the RGBA destination image (output)
+ * @param dst_stride: destination image stride in bytes
+ * @param width: image width in pixels
+ * @param height: image height in pixels
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_colorizer_apply(struct tmeta_colorizer *self,
+			  const uint8_t *src,
+			  size_t src_stride,
+			  uint8_t *dst,
+			  size_t dst_stride,
+			  unsigned int width,
+			  unsigned int height);
+
+
+/**
+ * Get an enum tmeta_palette value from a string.
+ * Valid strings are only the suffix of the palette name (eg. 'IRON').
+ * The case is ignored.
+ * @param str: palette name to convert
+ * @return the enum tmeta_palette value or TMETA_PALETTE_IRON if unknown
+ */
+TMETA_API enum tmeta_palette tmeta_palette_from_str(const char *str);
+
+
+/**
+ * Get a string from an enum tmeta_palette value.
+ * @param palette: palette value to convert
+ * @return a string description of the palette
+ */
+TMETA_API const char *tmeta_palette_to_str(enum tmeta_palette palette);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !_TMETA_COLORIZE_H_ */
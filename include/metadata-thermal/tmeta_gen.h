@@ -0,0 +1,129 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_GEN_H_
+#define _TMETA_GEN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <metadata-thermal/tmeta.h>
+
+
+/* Synthetic thermal metadata generator configuration */
+struct tmeta_gen_config {
+	/* Pseudo-random generator seed; the same seed and configuration
+	 * produce the same sequence of frames */
+	uint64_t seed;
+
+	/* Minor version of the generated SEIs (1 to TMETA_MINOR_VERSION);
+	 * 0 selects the current version */
+	unsigned int minor_version;
+
+	/* Thermal frame rate in frames per second; 0 selects the default
+	 * value */
+	double frame_rate;
+
+	/* Camera angles rate in Hz; the number of camera angles per frame
+	 * follows a Poisson distribution of mean cam_angles_rate / frame_rate;
+	 * 0 selects the default value */
+	double cam_angles_rate;
+
+	/* Mean JPEG data size in bytes; the size follows a log-normal
+	 * distribution; 0 selects the default value */
+	unsigned int jpeg_size_mean;
+
+	/* Maximum JPEG data size in bytes; 0 selects the default value */
+	unsigned int jpeg_size_max;
+
+	/* Mean shutter (flat field correction) period in seconds;
+	 * 0 selects the default value */
+	double shutter_period;
+
+	/* Mean time between gain mode changes in seconds; 0 selects the
+	 * default value */
+	double gain_change_period;
+};
+
+
+/* Forward declaration */
+struct tmeta_gen;
+
+
+/**
+ * Create a synthetic thermal metadata generator.
+ * The generator produces a sequence of valid thermal metadata and user
+ * data SEIs with realistic values: camera angles count and timestamps,
+ * JPEG data sizes, shutter cycles (frame_state), gain mode changes and
+ * drifting calibration and temperature values. The JPEG data is random
+ * and does not decode as an image.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * tmeta_gen_destroy() function.
+ * @param config: generator configuration
+ * @param ret_obj: generator instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_gen_new(const struct tmeta_gen_config *config,
+		  struct tmeta_gen **ret_obj);
+
+
+/**
+ * Free a synthetic thermal metadata generator.
+ * @param self: generator instance handle
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_gen_destroy(struct tmeta_gen *self);
+
+
+/**
+ * Generate the next frame.
+ * The metadata fields that do not exist in the configured minor version
+ * are set to 0. The jpeg_data field points to a buffer owned by the
+ * generator, valid until the generator is destroyed. The SEI buffer is
+ * owned by the generator and is valid until the next call.
+ * @param self: generator instance handle
+ * @param meta: pointer to the thermal metadata structure to fill (output)
+ * @param sei: pointer to the serialized SEI (output, optional)
+ * @param sei_size: pointer to the serialized SEI size in bytes (output,
+ *                  optional)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_gen_next(struct tmeta_gen *self,
+		   struct tmeta_data *meta,
+		   const void **sei,
+		   size_t *sei_size);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !_TMETA_GEN_H_ */
@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_HOTSPOT_H_
+#define _TMETA_HOTSPOT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <metadata-thermal/tmeta.h>
+
+
+/* Hotspot detector configuration */
+struct tmeta_hotspot_config {
+	/* Frame width in pixels (up to UINT16_MAX) */
+	unsigned int width;
+
+	/* Frame height in pixels */
+	unsigned int height;
+
+	/* Number of threads used for the detection, including the calling
+	 * thread; 0 selects the default value */
+	unsigned int threads;
+
+	/* Tile height in rows; 0 selects the default value */
+	unsigned int tile_height;
+
+	/* Minimum area in pixels of the reported regions; 0 reports all
+	 * regions */
+	unsigned int min_area;
+
+	/* Use 8-connectivity (diagonal neighbours are connected) instead of
+	 * 4-connectivity */
+	bool connectivity_8;
+};
+
+
+/* Hotspot region */
+struct tmeta_hotspot_region {
+	/* Area in pixels */
+	unsigned int area;
+
+	/* Bounding box (inclusive coordinates) */
+	unsigned int x_min;
+	unsigned int y_min;
+	unsigned int x_max;
+	unsigned int y_max;
+
+	/* Centroid coordinates in pixels */
+	double centroid_x;
+	double centroid_y;
+
+	/* Peak 8-bit value and position (first peak pixel in raster order) */
+	uint8_t peak_value;
+	unsigned int peak_x;
+	unsigned int peak_y;
+
+	/* Peak temperature in Kelvin (NAN if outside of the range of the
+	 * calibration curve) */
+	double peak_temp;
+};
+
+
+/* Forward declaration */
+struct tmeta_hotspot;
+
+
+/**
+ * Get the 8-bit threshold corresponding to a temperature.
+ * The threshold temperature is converted once to a raw value using the
+ * calibration values of the frame, then to the 8-bit scale of the JPEG
+ * image using value_min and value_max: the 8-bit pixel values greater
+ * than or equal to the returned value are at or above the temperature.
+ * @param meta: pointer to the thermal metadata of the frame
+ * @param temp: threshold temperature in Kelvin
+ * @param value: pointer to the 8-bit threshold (output); 256 if no pixel
+ *               value can reach the temperature
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_hotspot_get_threshold(const struct tmeta_data *meta,
+				double temp,
+				unsigned int *value);
+
+
+/**
+ * Create a hotspot detector.
+ * The detector finds the connected regions of a frame above a threshold
+ * temperature. The 8-bit frame is thresholded directly (see
+ * tmeta_hotspot_get_threshold()) and split in tiles of rows that are
+ * labeled in parallel using run-based union-find connected component
+ * labeling; the regions crossing tile boundaries are then merged. All
+ * memory is allocated at creation, except for the region tables which
+ * grow with the number of regions.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * tmeta_hotspot_destroy() function.
+ * @param config: hotspot detector configuration
+ * @param ret_obj: hotspot detector instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_hotspot_new(const struct tmeta_hotspot_config *config,
+		      struct tmeta_hotspot **ret_obj);
+
+
+/**
+ * Free a hotspot detector.
+ * @param self: hotspot detector instance handle
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_hotspot_destroy(struct tmeta_hotspot *self);
+
+
+/**
+ * Detect the regions of a frame above a threshold temperature.
+ * The frame is the decoded 8-bit JPEG image of the thermal metadata and
+ * must have the configured size. The regions are sorted by decreasing
+ * peak value, then by decreasing area; only the first max_regions
+ * regions are copied to the regions array, but region_count is the total
+ * number of regions (of at least min_area pixels).
+ * @param self: hotspot detector instance handle
+ * @param frame: pointer to the 8-bit frame
+ * @param stride: frame stride in bytes
+ * @param meta: pointer to the thermal metadata of the frame
+ * @param threshold: threshold temperature in Kelvin
+ * @param regions: pointer to the regions array (output, optional if
+ *                 max_regions is 0)
+ * @param max_regions: capacity of the regions array
+ * @param region_count: pointer to the number of regions (output)
+ * @return 0 on success, -EAGAIN if the frame is not valid (see
+ *         frame_state), negative errno value in case of error
+ */
+TMETA_API
+int tmeta_hotspot_detect(struct tmeta_hotspot *self,
+			 const uint8_t *frame,
+			 size_t stride,
+			 const struct tmeta_data *meta,
+			 double threshold,
+			 struct tmeta_hotspot_region *regions,
+			 unsigned int max_regions,
+			 unsigned int *region_count);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !_TMETA_HOTSPOT_H_ */
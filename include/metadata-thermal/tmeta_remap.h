@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_REMAP_H_
+#define _TMETA_REMAP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <metadata-thermal/tmeta.h>
+
+
+/* Pinhole camera intrinsics; the camera frame is x right, y down,
+ * z forward and pixel centers are at integer coordinates */
+struct tmeta_camera_intrinsics {
+	/* Image width in pixels */
+	unsigned int width;
+
+	/* Image height in pixels */
+	unsigned int height;
+
+	/* Horizontal focal length in pixels */
+	double fx;
+
+	/* Vertical focal length in pixels */
+	double fy;
+
+	/* Principal point horizontal coordinate in pixels */
+	double cx;
+
+	/* Principal point vertical coordinate in pixels */
+	double cy;
+};
+
+
+/* Warp pixel format */
+enum tmeta_remap_format {
+	/* 8-bit values (decoded JPEG image), bilinear interpolation,
+	 * pixels outside of the thermal frame are set to 0 */
+	TMETA_REMAP_FORMAT_U8 = 0,
+
+	/* 32-bit floating point values (e.g. temperatures), bilinear
+	 * interpolation, pixels outside of the thermal frame are set to NaN */
+	TMETA_REMAP_FORMAT_F32,
+
+	/* RGBA colors (e.g. colorized image), bilinear interpolation,
+	 * pixels outside of the thermal frame are set to transparent black */
+	TMETA_REMAP_FORMAT_RGBA,
+};
+
+
+/* Reprojection configuration */
+struct tmeta_remap_config {
+	/* Thermal camera intrinsics */
+	struct tmeta_camera_intrinsics thermal;
+
+	/* Visible camera intrinsics; the warp output has the visible
+	 * image size */
+	struct tmeta_camera_intrinsics visible;
+
+	/* Remap grid spacing in visible pixels; the exact reprojection is
+	 * computed on the grid nodes and bilinearly interpolated in between;
+	 * 0 selects the default value */
+	unsigned int grid_step;
+
+	/* Alignment quaternion rotation angle in radians above which the
+	 * grid is rebuilt; 0 selects the default value */
+	double quat_tolerance;
+
+	/* Intrinsics change in pixels above which the grid is rebuilt;
+	 * 0 selects the default value */
+	double intrinsics_tolerance;
+};
+
+
+/* Forward declaration */
+struct tmeta_remap;
+
+
+/**
+ * Create a thermal to visible reprojection.
+ * The reprojection maps the visible frame pixels to thermal frame
+ * coordinates using the cameras intrinsics and the thermal_to_visible_quat
+ * alignment quaternion of the metadata. The remap grid is cached and only
+ * rebuilt when the quaternion or the intrinsics change beyond the
+ * configured tolerances.
+ * The instance handle is returned through the ret_obj parameter.
+ * When no longer needed, the instance must be freed using the
+ * tmeta_remap_destroy() function.
+ * @param config: reprojection configuration
+ * @param ret_obj: reprojection instance handle (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_remap_new(const struct tmeta_remap_config *config,
+		    struct tmeta_remap **ret_obj);
+
+
+/**
+ * Free a thermal to visible reprojection.
+ * @param self: reprojection instance handle
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_remap_destroy(struct tmeta_remap *self);
+
+
+/**
+ * Change the cameras intrinsics.
+ * The grid is rebuilt on the next call to tmeta_remap_update() if the
+ * intrinsics change beyond the tolerance. Changing the visible image size
+ * is not supported.
+ * @param self: reprojection instance handle
+ * @param thermal: thermal camera intrinsics
+ * @param visible: visible camera intrinsics
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_remap_set_intrinsics(struct tmeta_remap *self,
+			       const struct tmeta_camera_intrinsics *thermal,
+			       const struct tmeta_camera_intrinsics *visible);
+
+
+/**
+ * Update the reprojection for a new frame.
+ * The grid is rebuilt if the thermal_to_visible_quat alignment quaternion
+ * or the intrinsics changed beyond the tolerances. For metadata older than
+ * version 0.4 the identity rotation is used.
+ * @param self: reprojection instance handle
+ * @param meta: pointer to the thermal metadata of the frame
+ * @param rebuilt: pointer to the grid rebuild status (output, optional)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_remap_update(struct tmeta_remap *self,
+		       const struct tmeta_data *meta,
+		       bool *rebuilt);
+
+
+/**
+ * Warp a thermal frame into the visible frame coordinates.
+ * The source image has the thermal image size and the destination image
+ * has the visible image size. For TMETA_REMAP_FORMAT_F32 the strides must
+ * be multiples of sizeof(float). The pixels of the remap grid cells that
+ * have a node behind the thermal camera are handled as outside of the
+ * thermal frame.
+ * @param self: reprojection instance handle
+ * @param format: pixel format
+ * @param src: pointer to the thermal source image
+ * @param src_stride: source image stride in bytes
+ * @param dst: pointer to the destination image (output)
+ * @param dst_stride: destination image stride in bytes
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_remap_warp(struct tmeta_remap *self,
+		     enum tmeta_remap_format format,
+		     const void *src,
+		     size_t src_stride,
+		     void *dst,
+		     size_t dst_stride);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !_TMETA_REMAP_H_ */
@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_RESCALE_H_
+#define _TMETA_RESCALE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <metadata-thermal/tmeta.h>
+
+
+/* Raw frame rescale mode */
+enum tmeta_rescale_mode {
+	/* Exact range: a min/max reduction pass followed by a rescale
+	 * pass */
+	TMETA_RESCALE_MODE_EXACT = 0,
+
+	/* Predictive range: a single pass rescaling with the range of the
+	 * previous frame while computing the frame range; if values were
+	 * clamped, a correction pass rescales the frame with its own
+	 * range */
+	TMETA_RESCALE_MODE_PREDICTIVE,
+
+	/* Deferred predictive range: a single pass rescaling with the range
+	 * of the previous frame while computing the frame range; clamped
+	 * values are kept and the correction is deferred to the next frame
+	 * which uses this frame range */
+	TMETA_RESCALE_MODE_PREDICTIVE_DEFERRED,
+};
+
+
+/* Raw frame rescale result */
+struct tmeta_rescale_result {
+	/* Minimum raw value of the frame */
+	uint32_t frame_min;
+
+	/* Maximum raw value of the frame */
+	uint32_t frame_max;
+
+	/* True if values were clamped in the 8-bit output */
+	bool clamped;
+
+	/* Number of passes over the frame (0 if no frame was processed) */
+	unsigned int passes;
+};
+
+
+/**
+ * Rescale a raw thermal frame to 8 bits.
+ * The function computes the 8-bit payload to be encoded as the JPEG data
+ * along with the value_min/value_max range of the thermal metadata:
+ * a raw value v is stored as round((v - value_min) * 255 /
+ * (value_max - value_min)), clamped to 0..255.
+ * In predictive modes, the result parameter is used both as input (result
+ * of the previous frame, whose range is the prediction) and output; when
+ * no previous frame was processed (passes is 0) the exact mode is used.
+ * The value_min and value_max fields of the metadata are set to the range
+ * actually used for the 8-bit payload; other fields are not modified.
+ * @param src: pointer to the raw source frame (14 or 16 bits per pixel)
+ * @param src_stride: source frame stride in bytes
+ * @param width: frame width in pixels
+ * @param height: frame height in pixels
+ * @param dst: pointer to the 8-bit destination frame (output)
+ * @param dst_stride: destination frame stride in bytes
+ * @param mode: rescale mode
+ * @param meta: pointer to the thermal metadata structure to fill (output)
+ * @param result: pointer to the rescale result (input for predictive
+ *                modes, output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_rescale_raw_frame(const uint16_t *src,
+			    size_t src_stride,
+			    unsigned int width,
+			    unsigned int height,
+			    uint8_t *dst,
+			    size_t dst_stride,
+			    enum tmeta_rescale_mode mode,
+			    struct tmeta_data *meta,
+			    struct tmeta_rescale_result *result);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !_TMETA_RESCALE_H_ */
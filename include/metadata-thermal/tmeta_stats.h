@@ -0,0 +1,211 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_STATS_H_
+#define _TMETA_STATS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <metadata-thermal/tmeta.h>
+
+
+/* Number of minor version counters; the last counter also counts all
+ * higher minor versions */
+#define TMETA_STATS_VERSION_COUNT 16
+
+/* Number of histogram buckets */
+#define TMETA_STATS_HISTOGRAM_BUCKETS 32
+
+
+/* Stats flags */
+enum tmeta_stats_flags {
+	/* Frame, byte, failure, version and distribution counters */
+	TMETA_STATS_FLAG_COUNTERS = (1 << 0),
+
+	/* Serialize, deserialize and JSON writer latency histograms
+	 * (requires TMETA_STATS_FLAG_COUNTERS) */
+	TMETA_STATS_FLAG_LATENCY = (1 << 1),
+};
+
+
+/* Deserialization failure reasons */
+enum tmeta_stats_failure {
+	/* Not a thermal metadata SEI (-ENOENT) */
+	TMETA_STATS_FAILURE_NOT_THERMAL = 0,
+
+	/* TMETA_ERR_SHORT_HEADER */
+	TMETA_STATS_FAILURE_SHORT_HEADER,
+
+	/* TMETA_ERR_BAD_MAJOR_VERSION */
+	TMETA_STATS_FAILURE_BAD_MAJOR_VERSION,
+
+	/* TMETA_ERR_TRUNCATED_HEADER */
+	TMETA_STATS_FAILURE_TRUNCATED_HEADER,
+
+	/* TMETA_ERR_TOO_MANY_CAM_ANGLES */
+	TMETA_STATS_FAILURE_TOO_MANY_CAM_ANGLES,
+
+	/* TMETA_ERR_TRUNCATED_CAM_ANGLES */
+	TMETA_STATS_FAILURE_TRUNCATED_CAM_ANGLES,
+
+	/* TMETA_ERR_TRUNCATED_JPEG */
+	TMETA_STATS_FAILURE_TRUNCATED_JPEG,
+
+	/* TMETA_ERR_TRUNCATED_V0_2 */
+	TMETA_STATS_FAILURE_TRUNCATED_V0_2,
+
+	/* TMETA_ERR_TRUNCATED_V0_3 */
+	TMETA_STATS_FAILURE_TRUNCATED_V0_3,
+
+	/* TMETA_ERR_TRUNCATED_V0_4 */
+	TMETA_STATS_FAILURE_TRUNCATED_V0_4,
+
+	/* TMETA_ERR_TRUNCATED_V0_5 */
+	TMETA_STATS_FAILURE_TRUNCATED_V0_5,
+
+	/* TMETA_ERR_BAD_CHECKSUM */
+	TMETA_STATS_FAILURE_BAD_CHECKSUM,
+
+	/* Camera angles storage too small (-ENOBUFS), the header is decoded
+	 * (tmeta_deserialize_thermal_metadata_user_data_sei_ext() only) */
+	TMETA_STATS_FAILURE_NO_CAPACITY,
+
+	/* Any other error */
+	TMETA_STATS_FAILURE_OTHER,
+
+	/* Number of failure reasons */
+	TMETA_STATS_FAILURE_COUNT,
+};
+
+
+/* Power of 2 histogram */
+struct tmeta_stats_histogram {
+	/* Number of samples */
+	uint64_t count;
+
+	/* Sum of the samples */
+	uint64_t sum;
+
+	/* Maximum sample */
+	uint64_t max;
+
+	/* Bucket 0 counts the null samples, bucket i counts the samples in
+	 * [2^(i-1)..2^i[, the last bucket also counts all larger samples */
+	uint64_t buckets[TMETA_STATS_HISTOGRAM_BUCKETS];
+};
+
+
+/* Stats snapshot */
+struct tmeta_stats {
+	/* Serialized frames count */
+	uint64_t serialized_frames;
+
+	/* Serialized bytes count */
+	uint64_t serialized_bytes;
+
+	/* Successfully deserialized frames count */
+	uint64_t deserialized_frames;
+
+	/* Successfully deserialized bytes count */
+	uint64_t deserialized_bytes;
+
+	/* Deserialization failures count */
+	uint64_t deserialize_failures;
+
+	/* Deserialization failures count per reason */
+	uint64_t failures[TMETA_STATS_FAILURE_COUNT];
+
+	/* Deserialized frames count per minor version */
+	uint64_t versions[TMETA_STATS_VERSION_COUNT];
+
+	/* Frames written to JSON count */
+	uint64_t json_frames;
+
+	/* Distribution of the camera angles count of deserialized frames */
+	struct tmeta_stats_histogram cam_angles_count;
+
+	/* Distribution of the JPEG data size in bytes of deserialized
+	 * frames */
+	struct tmeta_stats_histogram jpeg_data_size;
+
+	/* Serialization latency in nanoseconds */
+	struct tmeta_stats_histogram serialize_ns;
+
+	/* Deserialization latency in nanoseconds */
+	struct tmeta_stats_histogram deserialize_ns;
+
+	/* JSON writer latency in nanoseconds */
+	struct tmeta_stats_histogram to_json_ns;
+};
+
+
+/**
+ * Enable or disable the library stats.
+ * Stats are disabled by default; when disabled, the cost on the
+ * serialization and deserialization functions is a single flag check.
+ * Counters are process-wide and updated with relaxed atomic operations on
+ * per-thread shards. Changing the flags does not reset the counters.
+ * @param flags: combination of enum tmeta_stats_flags values, 0 to disable
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_stats_enable(uint32_t flags);
+
+
+/**
+ * Get a snapshot of the library stats.
+ * The snapshot is not atomic with respect to concurrent updates.
+ * @param stats: pointer to the stats structure to fill (output)
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_stats_get(struct tmeta_stats *stats);
+
+
+/**
+ * Reset the library stats.
+ * @return 0 on success, negative errno value in case of error
+ */
+TMETA_API
+int tmeta_stats_reset(void);
+
+
+/**
+ * Get a string from an enum tmeta_stats_failure value.
+ * @param failure: failure reason value to convert
+ * @return a string description of the failure reason
+ */
+TMETA_API const char *
+tmeta_stats_failure_to_str(enum tmeta_stats_failure failure);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !_TMETA_STATS_H_ */
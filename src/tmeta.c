@@ -24,41 +24,12 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <errno.h>
-#include <math.h>
-#include <stdio.h>
-#include <string.h>
-
-#ifdef _WIN32
-#	include <winsock2.h>
-#else /* !_WIN32 */
-#	include <arpa/inet.h>
-#endif /* !_WIN32 */
-
 #include <json-c/json.h>
-#include <metadata-thermal/tmeta.h>
 
-#define ULOG_TAG tmeta
-#include <ulog.h>
-ULOG_DECLARE_TAG(ULOG_TAG);
+#include "tmeta_priv.h"
+#include "tmeta_schema.h"
 
-#ifdef __APPLE__
-#	include <machine/endian.h>
-#elif defined(_WIN32)
-#	define bswapll(y) (((uint64_t)ntohl(y)) << 32 | ntohl(y >> 32))
-#	define htonll(y) bswapll(y)
-#	define ntohll(y) bswapll(y)
-#else
-#	include <endian.h>
-#	if __BYTE_ORDER == __LITTLE_ENDIAN
-#		define bswapll(y) (((uint64_t)ntohl(y)) << 32 | ntohl(y >> 32))
-#		define htonll(y) bswapll(y)
-#		define ntohll(y) bswapll(y)
-#	else
-#		define htonll(y) (y)
-#		define ntohll(y) (y)
-#	endif
-#endif
+ULOG_DECLARE_TAG(ULOG_TAG);
 
 
 const char *TMETA_MBUF_ANCILLARY_KEY = "com.parrot.thermal.metadata";
@@ -80,231 +51,302 @@ static const struct uuid sei_uuid = {
 };
 
 
-static void serialize_thermal_metadata(const struct tmeta_data *meta, void *buf)
+/* Camera angles of struct tmeta_data: fixed size arrays */
+
+static inline int check_cam_angles(const struct tmeta_data *meta)
 {
-	uint32_t *pdw_buf = (uint32_t *)buf;
-	*(pdw_buf++) = htonl(sei_uuid.uuid0);
-	*(pdw_buf++) = htonl(sei_uuid.uuid1);
-	*(pdw_buf++) = htonl(sei_uuid.uuid2);
-	*(pdw_buf++) = htonl(sei_uuid.uuid3);
+	if (meta->cam_angles_count > TMETA_CAMANGLES_MAXCOUNT)
+		return TMETA_ERR_TOO_MANY_CAM_ANGLES;
+	return 0;
+}
 
-	uint8_t *pb_buf = (uint8_t *)pdw_buf;
 
-	/* Ignore the version, force it to TMETA_VERSION */
-	uint32_t tmp_u32;
-	tmp_u32 = TMETA_VERSION;
-	*(uint32_t *)pb_buf = htonl(tmp_u32);
-	pb_buf += TMETA_VERSION_SIZE;
-
-	/* V0.1 header data */
-	tmp_u32 = meta->gain_mode;
-	*(uint32_t *)pb_buf = htonl(tmp_u32);
-	pb_buf += sizeof(tmp_u32);
-
-	memcpy(pb_buf, &meta->calib_r, sizeof(double));
-	pb_buf += sizeof(double);
-	memcpy(pb_buf, &meta->calib_b, sizeof(double));
-	pb_buf += sizeof(double);
-	memcpy(pb_buf, &meta->calib_f, sizeof(double));
-	pb_buf += sizeof(double);
-	memcpy(pb_buf, &meta->calib_o, sizeof(double));
-	pb_buf += sizeof(double);
-	memcpy(pb_buf, &meta->calib_tau_win, sizeof(double));
-	pb_buf += sizeof(double);
-	memcpy(pb_buf, &meta->calib_t_win, sizeof(double));
-	pb_buf += sizeof(double);
-	memcpy(pb_buf, &meta->calib_t_bg, sizeof(double));
-	pb_buf += sizeof(double);
-	memcpy(pb_buf, &meta->calib_emissivity, sizeof(double));
-	pb_buf += sizeof(double);
-
-	*(uint32_t *)pb_buf = htonl(meta->jpeg_data_size);
-	pb_buf += sizeof(meta->jpeg_data_size);
-
-	*(uint32_t *)pb_buf = htonl(meta->value_min);
-	pb_buf += sizeof(uint32_t);
-	*(uint32_t *)pb_buf = htonl(meta->value_max);
-	pb_buf += sizeof(uint32_t);
-
-	memcpy(pb_buf, &meta->attitude_reference_quat, sizeof(float) * 4);
-	pb_buf += sizeof(float) * 4;
-
-	*(uint32_t *)pb_buf = htonl(meta->cam_angles_count);
-	pb_buf += sizeof(uint32_t);
-
-	/* V0.1 camera angles data */
-	memcpy(pb_buf,
-	       &meta->cam_angles,
-	       sizeof(float) * meta->cam_angles_count * 4);
-	pb_buf += sizeof(float) * meta->cam_angles_count * 4;
-
-	for (unsigned int i = 0; i < meta->cam_angles_count; ++i) {
-		*(uint64_t *)pb_buf =
-			htonll((uint64_t)meta->cam_angles_timestamps[i]);
-		pb_buf += sizeof(uint64_t);
+static inline void store_cam_angles(const struct tmeta_data *meta,
+				    uint8_t *p)
+{
+	tmeta_schema_store_cam_angles(p,
+				      meta->cam_angles,
+				      meta->cam_angles_timestamps,
+				      meta->cam_angles_count);
+}
+
+
+static inline int load_cam_angles(struct tmeta_data *meta, const uint8_t *p)
+{
+	tmeta_schema_load_cam_angles(p,
+				     meta->cam_angles_count,
+				     meta->cam_angles,
+				     meta->cam_angles_timestamps);
+	return 0;
+}
+
+
+/* Camera angles of struct tmeta_data_ext: caller-owned arrays or
+ * reference to the SEI buffer */
+
+static inline int check_cam_angles_ext(const struct tmeta_data_ext *meta)
+{
+	/* No maximum count: the capacity is checked when loading */
+	(void)meta;
+	return 0;
+}
+
+
+static inline void store_cam_angles_ext(const struct tmeta_data_ext *meta,
+					uint8_t *p)
+{
+	if ((meta->cam_angles != NULL) &&
+	    (meta->cam_angles_timestamps != NULL)) {
+		tmeta_schema_store_cam_angles(p,
+					      meta->cam_angles,
+					      meta->cam_angles_timestamps,
+					      meta->cam_angles_count);
+	} else if (meta->cam_angles_count > 0) {
+		/* Already in the serialized form */
+		memcpy(p,
+		       meta->cam_angles_data,
+		       (size_t)meta->cam_angles_count *
+			       TMETA_SCHEMA_CAM_ANGLE_SIZE);
 	}
+}
 
-	/* V0.1 JPEG data */
-	memcpy(pb_buf, meta->jpeg_data, meta->jpeg_data_size);
-	pb_buf += meta->jpeg_data_size;
 
-	/* V0.2 shutter state data */
-	tmp_u32 = meta->frame_state;
-	*(uint32_t *)pb_buf = htonl(tmp_u32);
-	pb_buf += sizeof(uint32_t);
+static inline int load_cam_angles_ext(struct tmeta_data_ext *meta,
+				      const uint8_t *p)
+{
+	meta->cam_angles_data = p;
+	if ((meta->cam_angles == NULL) && (meta->cam_angles_timestamps == NULL))
+		return 0;
+	if (meta->cam_angles_count > meta->cam_angles_capacity)
+		return -ENOBUFS;
+	tmeta_schema_load_cam_angles(p,
+				     meta->cam_angles_count,
+				     meta->cam_angles,
+				     meta->cam_angles_timestamps);
+	return 0;
+}
+
 
-	/* V0.3 temperatures */
-	memcpy(pb_buf, &meta->fpa_temp, sizeof(double));
-	pb_buf += sizeof(double);
-	memcpy(pb_buf, &meta->housing_temp, sizeof(double));
-	pb_buf += sizeof(double);
-	memcpy(pb_buf, &meta->window_reflection, sizeof(double));
-	pb_buf += sizeof(double);
+#define DEFINE_ENCODERS(_prefix, _type, _store)                                \
+	TMETA_SCHEMA_DEFINE_ENCODER(_prefix##_v0_1, _type, 1, _store)          \
+	TMETA_SCHEMA_DEFINE_ENCODER(_prefix##_v0_2, _type, 2, _store)          \
+	TMETA_SCHEMA_DEFINE_ENCODER(_prefix##_v0_3, _type, 3, _store)          \
+	TMETA_SCHEMA_DEFINE_ENCODER(_prefix##_v0_4, _type, 4, _store)          \
+	TMETA_SCHEMA_DEFINE_ENCODER(_prefix##_v0_5, _type, 5, _store)
 
-	/* V0.4 thermal camera alignment quaternion */
-	memcpy(pb_buf, &meta->thermal_to_visible_quat, sizeof(float) * 4);
+DEFINE_ENCODERS(encode, struct tmeta_data, store_cam_angles)
+DEFINE_ENCODERS(encode_ext, struct tmeta_data_ext, store_cam_angles_ext)
+
+
+/* Size and truncation error of the data added by each minor version, for
+ * the diagnosis of truncated buffers */
+static const struct {
+	size_t size;
+	int err;
+} tail_info[TMETA_SCHEMA_MINOR_VERSION + 1] = {
+	[2] = {TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_2), TMETA_ERR_TRUNCATED_V0_2},
+	[3] = {TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_3), TMETA_ERR_TRUNCATED_V0_3},
+	[4] = {TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_4), TMETA_ERR_TRUNCATED_V0_4},
+	[5] = {TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_5), TMETA_ERR_TRUNCATED_V0_5},
+};
+
+
+/* Find which part of a truncated buffer is missing; the decoders only
+ * check the total size */
+__attribute__((cold, noinline)) static int
+diagnose_truncation(size_t size,
+		    uint32_t cam_angles_count,
+		    uint32_t jpeg_data_size,
+		    unsigned int minor)
+{
+	uint64_t needed = TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_1_HEADER) +
+			  (uint64_t)cam_angles_count *
+				  TMETA_SCHEMA_CAM_ANGLE_SIZE;
+
+	if (size < needed)
+		return TMETA_ERR_TRUNCATED_CAM_ANGLES;
+	needed += jpeg_data_size;
+	if (size < needed)
+		return TMETA_ERR_TRUNCATED_JPEG;
+	for (unsigned int i = 2; i <= minor; i++) {
+		needed += tail_info[i].size;
+		if (size < needed)
+			return tail_info[i].err;
+	}
+
+	return -EPROTO;
 }
 
 
-static int deserialize_thermal_metadata(const void *buf,
-					size_t buf_size,
-					struct tmeta_data *meta)
+#define DEFINE_DECODERS(_prefix, _type, _check, _load)                         \
+	TMETA_SCHEMA_DEFINE_DECODER(                                           \
+		_prefix##_v0_1, _type, 1, _check, _load, diagnose_truncation)  \
+	TMETA_SCHEMA_DEFINE_DECODER(                                           \
+		_prefix##_v0_2, _type, 2, _check, _load, diagnose_truncation)  \
+	TMETA_SCHEMA_DEFINE_DECODER(                                           \
+		_prefix##_v0_3, _type, 3, _check, _load, diagnose_truncation)  \
+	TMETA_SCHEMA_DEFINE_DECODER(                                           \
+		_prefix##_v0_4, _type, 4, _check, _load, diagnose_truncation)  \
+	TMETA_SCHEMA_DEFINE_DECODER(                                           \
+		_prefix##_v0_5, _type, 5, _check, _load, diagnose_truncation)
+
+DEFINE_DECODERS(decode,
+		struct tmeta_data,
+		check_cam_angles,
+		load_cam_angles)
+DEFINE_DECODERS(decode_ext,
+		struct tmeta_data_ext,
+		check_cam_angles_ext,
+		load_cam_angles_ext)
+
+
+/* Newer minor versions only append data: decode the known part */
+#define DECODE_MINOR(_prefix, _minor, _buf, _size, _meta)                      \
+	do {                                                                   \
+		switch (_minor) {                                              \
+		case 0:                                                        \
+		case 1:                                                        \
+			return _prefix##_v0_1(_buf, _size, _meta);             \
+		case 2:                                                        \
+			return _prefix##_v0_2(_buf, _size, _meta);             \
+		case 3:                                                        \
+			return _prefix##_v0_3(_buf, _size, _meta);             \
+		case 4:                                                        \
+			return _prefix##_v0_4(_buf, _size, _meta);             \
+		default:                                                       \
+			return _prefix##_v0_5(_buf, _size, _meta);             \
+		}                                                              \
+	} while (0)
+
+
+static uint8_t *serialize_sei_uuid(uint8_t *p)
+{
+	tmeta_schema_store_u32(p, sei_uuid.uuid0);
+	tmeta_schema_store_u32(p + 4, sei_uuid.uuid1);
+	tmeta_schema_store_u32(p + 8, sei_uuid.uuid2);
+	tmeta_schema_store_u32(p + 12, sei_uuid.uuid3);
+	return p + TMETA_SEI_UUID_SIZE;
+}
+
+
+/* Call the encoder (or, with the _size suffix, the size function) of the
+ * given minor version; the minor version is validated by the caller */
+#define ENCODE_MINOR(_prefix, _suffix, _minor, _args)                          \
+	do {                                                                   \
+		switch (_minor) {                                              \
+		case 0:                                                        \
+		case 1:                                                        \
+			return TMETA_SEI_UUID_SIZE +                           \
+			       _prefix##_v0_1##_suffix _args;                  \
+		case 2:                                                        \
+			return TMETA_SEI_UUID_SIZE +                           \
+			       _prefix##_v0_2##_suffix _args;                  \
+		case 3:                                                        \
+			return TMETA_SEI_UUID_SIZE +                           \
+			       _prefix##_v0_3##_suffix _args;                  \
+		case 4:                                                        \
+			return TMETA_SEI_UUID_SIZE +                           \
+			       _prefix##_v0_4##_suffix _args;                  \
+		default:                                                       \
+			return TMETA_SEI_UUID_SIZE +                           \
+			       _prefix##_v0_5##_suffix _args;                  \
+		}                                                              \
+	} while (0)
+
+
+/* Serialized size from the SEI UUID to the end */
+static size_t serialized_size(const struct tmeta_data *meta,
+			      unsigned int minor)
 {
-	const uint8_t *pb_buf = (const uint8_t *)buf;
-	unsigned int cam_angles_size;
-	unsigned int cam_angles_timestamps_size;
+	ENCODE_MINOR(encode, _size, minor, (meta));
+}
+
+
+static size_t serialize_thermal_metadata(const struct tmeta_data *meta,
+					 unsigned int minor,
+					 void *buf)
+{
+	uint8_t *p = serialize_sei_uuid(buf);
+
+	ENCODE_MINOR(encode, , minor, (meta, p));
+}
+
+
+static size_t serialized_size_ext(const struct tmeta_data_ext *meta,
+				  unsigned int minor)
+{
+	ENCODE_MINOR(encode_ext, _size, minor, (meta));
+}
+
+
+static size_t serialize_thermal_metadata_ext(const struct tmeta_data_ext *meta,
+					     unsigned int minor,
+					     void *buf)
+{
+	uint8_t *p = serialize_sei_uuid(buf);
+
+	ENCODE_MINOR(encode_ext, , minor, (meta, p));
+}
+
 
-	ssize_t _buf_size = (ssize_t)buf_size;
+/* Read the version; returns the pointer to the version field, or NULL if
+ * the buffer is too short */
+static const uint8_t *
+deserialize_version(const void *buf, size_t buf_size, uint32_t *version)
+{
+	const uint8_t *p = (const uint8_t *)buf;
 
 	/* Check SEI UUID and version minimal buffer size */
-	if (_buf_size < (ssize_t)(TMETA_SEI_UUID_SIZE + TMETA_VERSION_SIZE))
-		return -1;
+	if (buf_size < TMETA_SEI_UUID_SIZE + TMETA_VERSION_SIZE)
+		return NULL;
 
 	/* Skip SEI UUID */
-	pb_buf += TMETA_SEI_UUID_SIZE;
-	_buf_size -= TMETA_SEI_UUID_SIZE;
+	p += TMETA_SEI_UUID_SIZE;
+	*version = tmeta_schema_load_u32(p);
+
+	return p;
+}
 
-	meta->version = ntohl(*(const uint32_t *)pb_buf);
-	pb_buf += sizeof(uint32_t);
-	_buf_size -= sizeof(uint32_t);
 
+static int deserialize_thermal_metadata(const void *buf,
+					size_t buf_size,
+					struct tmeta_data *meta)
+{
+	const uint8_t *p = deserialize_version(buf, buf_size, &meta->version);
+
+	if (p == NULL)
+		return TMETA_ERR_SHORT_HEADER;
 	if (TMETA_GET_MAJOR_VERSION(meta->version) > TMETA_MAJOR_VERSION) {
 		/* Only Major version 0 is supported for now */
-		return -1;
+		return TMETA_ERR_BAD_MAJOR_VERSION;
 	}
 
-	/* Check v0.1 header size */
-	if (_buf_size < (ssize_t)TMETA_V0_1_HEADER_SIZE)
-		return -1;
-
-	/* Deserialize v0.1 header data */
-	meta->gain_mode = ntohl(*(const uint32_t *)pb_buf);
-	pb_buf += sizeof(uint32_t);
-	_buf_size -= sizeof(uint32_t);
-
-	memcpy(&meta->calib_r, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-	memcpy(&meta->calib_b, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-	memcpy(&meta->calib_f, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-	memcpy(&meta->calib_o, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-	memcpy(&meta->calib_tau_win, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-	memcpy(&meta->calib_t_win, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-	memcpy(&meta->calib_t_bg, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-	memcpy(&meta->calib_emissivity, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-
-	meta->jpeg_data_size = ntohl(*(const uint32_t *)pb_buf);
-	pb_buf += sizeof(uint32_t);
-	_buf_size -= sizeof(uint32_t);
-
-	meta->value_min = ntohl(*(const uint32_t *)pb_buf);
-	pb_buf += sizeof(uint32_t);
-	_buf_size -= sizeof(uint32_t);
-	meta->value_max = ntohl(*(const uint32_t *)pb_buf);
-	pb_buf += sizeof(uint32_t);
-	_buf_size -= sizeof(uint32_t);
-
-	memcpy(&meta->attitude_reference_quat, pb_buf, sizeof(float) * 4);
-	pb_buf += sizeof(float) * 4;
-	_buf_size -= sizeof(float) * 4;
-
-	meta->cam_angles_count = ntohl(*(const uint32_t *)pb_buf);
-	pb_buf += sizeof(uint32_t);
-	_buf_size -= sizeof(uint32_t);
-
-	/* Check v0.1 camera angles size */
-	cam_angles_size = sizeof(float) * meta->cam_angles_count * 4;
-	cam_angles_timestamps_size = meta->cam_angles_count * sizeof(uint64_t);
-	if (_buf_size < (ssize_t)(cam_angles_size + cam_angles_timestamps_size))
-		return -1;
-
-	memcpy(&meta->cam_angles, pb_buf, cam_angles_size);
-	pb_buf += cam_angles_size;
-	_buf_size -= cam_angles_size;
-	for (unsigned int i = 0; i < meta->cam_angles_count; ++i) {
-		meta->cam_angles_timestamps[i] =
-			ntohll(*(const uint64_t *)pb_buf);
-		pb_buf += sizeof(uint64_t);
-		_buf_size -= sizeof(uint64_t);
+	DECODE_MINOR(decode,
+		     TMETA_GET_MINOR_VERSION(meta->version),
+		     p,
+		     buf_size - TMETA_SEI_UUID_SIZE,
+		     meta);
+}
+
+
+static int deserialize_thermal_metadata_ext(const void *buf,
+					    size_t buf_size,
+					    struct tmeta_data_ext *meta)
+{
+	const uint8_t *p = deserialize_version(buf, buf_size, &meta->version);
+
+	if (p == NULL)
+		return TMETA_ERR_SHORT_HEADER;
+	if (TMETA_GET_MAJOR_VERSION(meta->version) > TMETA_MAJOR_VERSION) {
+		/* Only Major version 0 is supported for now */
+		return TMETA_ERR_BAD_MAJOR_VERSION;
 	}
 
-	/* Check v0.1 JPEG data size */
-	if (_buf_size < (ssize_t)meta->jpeg_data_size)
-		return -1;
-	meta->jpeg_data = (void *)pb_buf;
-	pb_buf += meta->jpeg_data_size;
-	_buf_size -= meta->jpeg_data_size;
-
-	/* Stop here if minor version is lower than 2 */
-	if (TMETA_GET_MINOR_VERSION(meta->version) < 2)
-		goto end;
-	if (_buf_size < (ssize_t)TMETA_V0_2_DATA_SIZE)
-		return -1;
-
-	meta->frame_state = ntohl(*(const uint32_t *)pb_buf);
-	pb_buf += sizeof(uint32_t);
-	_buf_size -= sizeof(uint32_t);
-
-	/* Stop here if minor version is lower than 3 */
-	if (TMETA_GET_MINOR_VERSION(meta->version) < 3)
-		goto end;
-	if (_buf_size < (ssize_t)TMETA_V0_3_DATA_SIZE)
-		return -1;
-
-	memcpy(&meta->fpa_temp, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-	memcpy(&meta->housing_temp, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-	memcpy(&meta->window_reflection, pb_buf, sizeof(double));
-	pb_buf += sizeof(double);
-	_buf_size -= sizeof(double);
-
-	/* Stop here if minor version is lower than 4 */
-	if (TMETA_GET_MINOR_VERSION(meta->version) < 4)
-		goto end;
-	if (_buf_size < (ssize_t)TMETA_V0_4_DATA_SIZE)
-		return -1;
-
-	memcpy(&meta->thermal_to_visible_quat, pb_buf, sizeof(float) * 4);
-
-end:
-	return 0;
+	DECODE_MINOR(decode_ext,
+		     TMETA_GET_MINOR_VERSION(meta->version),
+		     p,
+		     buf_size - TMETA_SEI_UUID_SIZE,
+		     meta);
 }
 
 
@@ -314,17 +356,17 @@ bool tmeta_is_thermal_metadata_user_data_sei(const void *buf, size_t buf_size)
 	uint32_t uuid1;
 	uint32_t uuid2;
 	uint32_t uuid3;
-	const uint32_t *pdw_buf = (uint32_t *)buf;
+	const uint8_t *p = buf;
 
 	ULOG_ERRNO_RETURN_VAL_IF(buf == NULL, EINVAL, false);
 
 	if (buf_size < (TMETA_SEI_UUID_SIZE + TMETA_VERSION_SIZE))
 		return false;
 
-	uuid0 = ntohl(*(pdw_buf++));
-	uuid1 = ntohl(*(pdw_buf++));
-	uuid2 = ntohl(*(pdw_buf++));
-	uuid3 = ntohl(*(pdw_buf++));
+	uuid0 = tmeta_schema_load_u32(p);
+	uuid1 = tmeta_schema_load_u32(p + 4);
+	uuid2 = tmeta_schema_load_u32(p + 8);
+	uuid3 = tmeta_schema_load_u32(p + 12);
 	if (uuid0 != sei_uuid.uuid0 || uuid1 != sei_uuid.uuid1 ||
 	    uuid2 != sei_uuid.uuid2 || uuid3 != sei_uuid.uuid3)
 		return false;
@@ -339,18 +381,43 @@ int tmeta_serialize_thermal_metadata_user_data_sei(
 	size_t buf_size,
 	size_t *size)
 {
+	/* Ignore the version, force it to TMETA_VERSION */
+	return tmeta_serialize_thermal_metadata_user_data_sei_minor(
+		meta, TMETA_MINOR_VERSION, buf, buf_size, size);
+}
+
+
+int tmeta_serialize_thermal_metadata_user_data_sei_minor(
+	const struct tmeta_data *meta,
+	unsigned int minor,
+	void *buf,
+	size_t buf_size,
+	size_t *size)
+{
+	size_t _size;
+
 	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
 	ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((minor < 1) || (minor > TMETA_MINOR_VERSION),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta->cam_angles_count >
+					 TMETA_CAMANGLES_MAXCOUNT,
+				 EINVAL);
+
+	uint64_t start = tmeta_stats_start();
 
-	size_t _size = TMETA_BUF_SIZE(meta);
+	_size = serialized_size(meta, minor);
 	if (buf_size < _size)
 		return -ENOBUFS;
 
-	serialize_thermal_metadata(meta, buf);
+	serialize_thermal_metadata(meta, minor, buf);
 
 	if (size)
 		*size = _size;
 
+	if (tmeta_stats_enabled())
+		tmeta_stats_record_serialize(_size, start);
+
 	return 0;
 }
 
@@ -359,13 +426,205 @@ int tmeta_deserialize_thermal_metadata_user_data_sei(const void *buf,
 						     size_t buf_size,
 						     struct tmeta_data *meta)
 {
+	int res;
+
 	ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, EINVAL);
 	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
 
-	if (!tmeta_is_thermal_metadata_user_data_sei(buf, buf_size))
-		return -ENOENT;
+	uint64_t start = tmeta_stats_start();
+
+	if (buf_size < (TMETA_SEI_UUID_SIZE + TMETA_VERSION_SIZE))
+		res = TMETA_ERR_SHORT_HEADER;
+	else if (!tmeta_is_thermal_metadata_user_data_sei(buf, buf_size))
+		res = -ENOENT;
+	else
+		res = deserialize_thermal_metadata(buf, buf_size, meta);
+
+	if (tmeta_stats_enabled()) {
+		/* The structure is only partially filled on error */
+		bool ok = (res == 0);
+		tmeta_stats_record_deserialize(ok ? meta->version : 0,
+					       ok ? meta->cam_angles_count : 0,
+					       ok ? meta->jpeg_data_size : 0,
+					       buf_size,
+					       res,
+					       start);
+	}
 
-	return deserialize_thermal_metadata(buf, buf_size, meta);
+	return res;
+}
+
+
+int tmeta_serialize_thermal_metadata_user_data_sei_ext(
+	const struct tmeta_data_ext *meta,
+	void *buf,
+	size_t buf_size,
+	size_t *size)
+{
+	/* Ignore the version, force it to TMETA_VERSION */
+	return tmeta_serialize_thermal_metadata_user_data_sei_ext_minor(
+		meta, TMETA_MINOR_VERSION, buf, buf_size, size);
+}
+
+
+int tmeta_serialize_thermal_metadata_user_data_sei_ext_minor(
+	const struct tmeta_data_ext *meta,
+	unsigned int minor,
+	void *buf,
+	size_t buf_size,
+	size_t *size)
+{
+	size_t _size;
+
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((minor < 1) || (minor > TMETA_MINOR_VERSION),
+				 EINVAL);
+
+	bool arrays = (meta->cam_angles != NULL) &&
+		      (meta->cam_angles_timestamps != NULL);
+	ULOG_ERRNO_RETURN_ERR_IF(arrays && (meta->cam_angles_count >
+					    meta->cam_angles_capacity),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!arrays && (meta->cam_angles_count > 0) &&
+					 (meta->cam_angles_data == NULL),
+				 EINVAL);
+
+	uint64_t start = tmeta_stats_start();
+
+	_size = serialized_size_ext(meta, minor);
+	if (buf_size < _size)
+		return -ENOBUFS;
+
+	serialize_thermal_metadata_ext(meta, minor, buf);
+
+	if (size)
+		*size = _size;
+
+	if (tmeta_stats_enabled())
+		tmeta_stats_record_serialize(_size, start);
+
+	return 0;
+}
+
+
+int tmeta_deserialize_thermal_metadata_user_data_sei_ext(
+	const void *buf,
+	size_t buf_size,
+	struct tmeta_data_ext *meta)
+{
+	int res;
+
+	ULOG_ERRNO_RETURN_ERR_IF(buf == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+
+	uint64_t start = tmeta_stats_start();
+
+	if (buf_size < (TMETA_SEI_UUID_SIZE + TMETA_VERSION_SIZE))
+		res = TMETA_ERR_SHORT_HEADER;
+	else if (!tmeta_is_thermal_metadata_user_data_sei(buf, buf_size))
+		res = -ENOENT;
+	else
+		res = deserialize_thermal_metadata_ext(buf, buf_size, meta);
+
+	if (tmeta_stats_enabled()) {
+		/* The structure is only partially filled on error */
+		bool ok = (res == 0);
+		tmeta_stats_record_deserialize(ok ? meta->version : 0,
+					       ok ? meta->cam_angles_count : 0,
+					       ok ? meta->jpeg_data_size : 0,
+					       buf_size,
+					       res,
+					       start);
+	}
+
+	return res;
+}
+
+
+int tmeta_data_ext_get_cam_angle(const struct tmeta_data_ext *meta,
+				 uint32_t index,
+				 float quat[4],
+				 uint64_t *timestamp)
+{
+	const uint8_t *p;
+
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(index >= meta->cam_angles_count, EINVAL);
+
+	if ((meta->cam_angles != NULL) &&
+	    (meta->cam_angles_timestamps != NULL)) {
+		if (quat != NULL)
+			memcpy(quat, &meta->cam_angles[4 * index], 4 * sizeof(float));
+		if (timestamp != NULL)
+			*timestamp = meta->cam_angles_timestamps[index];
+		return 0;
+	}
+
+	ULOG_ERRNO_RETURN_ERR_IF(meta->cam_angles_data == NULL, EINVAL);
+
+	p = meta->cam_angles_data;
+	if (quat != NULL) {
+		memcpy(quat,
+		       p + (size_t)index * TMETA_SCHEMA_QUAT_SIZE,
+		       TMETA_SCHEMA_QUAT_SIZE);
+	}
+	if (timestamp != NULL) {
+		*timestamp = tmeta_schema_load_u64(
+			p +
+			(size_t)meta->cam_angles_count * TMETA_SCHEMA_QUAT_SIZE +
+			(size_t)index * sizeof(uint64_t));
+	}
+
+	return 0;
+}
+
+
+int tmeta_data_ext_to_data(const struct tmeta_data_ext *meta_ext,
+			   struct tmeta_data *meta)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(meta_ext == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+
+	if (meta_ext->cam_angles_count > TMETA_CAMANGLES_MAXCOUNT)
+		return TMETA_ERR_TOO_MANY_CAM_ANGLES;
+
+	meta->version = meta_ext->version;
+	meta->gain_mode = meta_ext->gain_mode;
+	meta->calib_r = meta_ext->calib_r;
+	meta->calib_b = meta_ext->calib_b;
+	meta->calib_f = meta_ext->calib_f;
+	meta->calib_o = meta_ext->calib_o;
+	meta->calib_tau_win = meta_ext->calib_tau_win;
+	meta->calib_t_win = meta_ext->calib_t_win;
+	meta->calib_t_bg = meta_ext->calib_t_bg;
+	meta->calib_emissivity = meta_ext->calib_emissivity;
+	meta->jpeg_data_size = meta_ext->jpeg_data_size;
+	meta->value_min = meta_ext->value_min;
+	meta->value_max = meta_ext->value_max;
+	memcpy(meta->attitude_reference_quat,
+	       meta_ext->attitude_reference_quat,
+	       sizeof(meta->attitude_reference_quat));
+	meta->cam_angles_count = meta_ext->cam_angles_count;
+	for (uint32_t i = 0; i < meta_ext->cam_angles_count; i++) {
+		int res = tmeta_data_ext_get_cam_angle(
+			meta_ext,
+			i,
+			&meta->cam_angles[4 * i],
+			&meta->cam_angles_timestamps[i]);
+		if (res < 0)
+			return res;
+	}
+	meta->jpeg_data = meta_ext->jpeg_data;
+	meta->frame_state = meta_ext->frame_state;
+	meta->fpa_temp = meta_ext->fpa_temp;
+	meta->housing_temp = meta_ext->housing_temp;
+	meta->window_reflection = meta_ext->window_reflection;
+	memcpy(meta->thermal_to_visible_quat,
+	       meta_ext->thermal_to_visible_quat,
+	       sizeof(meta->thermal_to_visible_quat));
+
+	return 0;
 }
 
 
@@ -444,12 +703,39 @@ static struct json_object *tmeta_json_object_new_quaternion(const float quat[4])
 }
 
 
+/* JSON output of the schema fields, per kind; the camera angles count is
+ * written as the cam_angles and cam_angles_timestamps arrays and the
+ * checksum is not written */
+#define TMETA_JSON_ADD_U32(_j, _m, _f)                                         \
+	json_object_object_add(_j, #_f, json_object_new_int((_m)->_f))
+#define TMETA_JSON_ADD_GAIN_MODE(_j, _m, _f)                                   \
+	json_object_object_add(                                                \
+		_j,                                                            \
+		#_f,                                                           \
+		json_object_new_string(tmeta_thermal_gain_mode_to_str((_m)->_f)))
+#define TMETA_JSON_ADD_FRAME_STATE(_j, _m, _f)                                 \
+	json_object_object_add(_j,                                             \
+			       #_f,                                            \
+			       json_object_new_string(                         \
+				       tmeta_thermal_frame_state_to_str((_m)->_f)))
+#define TMETA_JSON_ADD_COUNT(_j, _m, _f)
+#define TMETA_JSON_ADD_F64(_j, _m, _f)                                         \
+	json_object_object_add(_j, #_f, json_object_new_double((_m)->_f))
+#define TMETA_JSON_ADD_QUAT(_j, _m, _f)                                        \
+	json_object_object_add(                                                \
+		_j, #_f, tmeta_json_object_new_quaternion((_m)->_f))
+#define TMETA_JSON_ADD_CHECKSUM(_j, _m, _f)
+#define TMETA_JSON_ADD_FIELD(_kind, _f) TMETA_JSON_ADD_##_kind(jobj, meta, _f);
+
+
 int tmeta_thermal_metadata_to_json(const struct tmeta_data *meta,
 				   struct json_object *jobj)
 {
 	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
 	ULOG_ERRNO_RETURN_ERR_IF(jobj == NULL, EINVAL);
 
+	uint64_t start = tmeta_stats_start();
+
 	/* Structure format version (major number and minor number) */
 	json_object_object_add(
 		jobj,
@@ -460,65 +746,8 @@ int tmeta_thermal_metadata_to_json(const struct tmeta_data *meta,
 		"version_minor",
 		json_object_new_int(TMETA_GET_MINOR_VERSION(meta->version)));
 
-	/* Active gain mode for this frame */
-	json_object_object_add(
-		jobj,
-		"gain_mode",
-		json_object_new_string(
-			tmeta_thermal_gain_mode_to_str(meta->gain_mode)));
-
-	/* R calibration value for this frame */
-	json_object_object_add(
-		jobj, "calib_r", json_object_new_double(meta->calib_r));
-
-	/* B calibration value for this frame */
-	json_object_object_add(
-		jobj, "calib_b", json_object_new_double(meta->calib_b));
-
-	/* F calibration value for this frame */
-	json_object_object_add(
-		jobj, "calib_f", json_object_new_double(meta->calib_f));
-
-	/* O calibration value for this frame */
-	json_object_object_add(
-		jobj, "calib_o", json_object_new_double(meta->calib_o));
-
-	/* tauWin calibration value for this frame */
-	json_object_object_add(jobj,
-			       "calib_tau_win",
-			       json_object_new_double(meta->calib_tau_win));
-
-	/* tWin calibration value for this frame */
-	json_object_object_add(
-		jobj, "calib_t_win", json_object_new_double(meta->calib_t_win));
-
-	/* tBg calibration value for this frame */
-	json_object_object_add(
-		jobj, "calib_t_bg", json_object_new_double(meta->calib_t_bg));
-
-	/* Emissivity calibration value for this frame */
-	json_object_object_add(jobj,
-			       "calib_emissivity",
-			       json_object_new_double(meta->calib_emissivity));
-
-	/* Size in bytes of the JPEG data */
-	json_object_object_add(jobj,
-			       "jpeg_data_size",
-			       json_object_new_int(meta->jpeg_data_size));
-
-	/* Mininmum raw thermal value for this frame */
-	json_object_object_add(
-		jobj, "value_min", json_object_new_int(meta->value_min));
-
-	/* Maximum raw thermal value for this frame */
-	json_object_object_add(
-		jobj, "value_max", json_object_new_int(meta->value_max));
-
-	/* Drone attitude reference quaternion (x, y, z, w) */
-	json_object_object_add(jobj,
-			       "attitude_reference_quat",
-			       tmeta_json_object_new_quaternion(
-				       meta->attitude_reference_quat));
+	/* v0.1 header */
+	TMETA_SCHEMA_V0_1_HEADER(TMETA_JSON_ADD_FIELD)
 
 	/* Camera angles quaternions (x, y, z, w) and timestamps */
 	struct json_object *jcam_angles = json_object_new_array();
@@ -546,32 +775,155 @@ int tmeta_thermal_metadata_to_json(const struct tmeta_data *meta,
 	json_object_object_add(
 		jobj, "cam_angles_timestamps", jcam_angles_timestamps);
 
-	/* Thermal shutter state */
-	json_object_object_add(
-		jobj,
-		"frame_state",
-		json_object_new_string(
-			tmeta_thermal_frame_state_to_str(meta->frame_state)));
+	/* Fields added by the following versions */
+	TMETA_SCHEMA_TAIL_LATEST(TMETA_JSON_ADD_FIELD)
 
-	/* Temperature of the focal plane array */
-	json_object_object_add(
-		jobj, "fpa_temp", json_object_new_double(meta->fpa_temp));
-
-	/* Temperature measured by the housing thermistor */
-	json_object_object_add(jobj,
-			       "housing_temp",
-			       json_object_new_double(meta->housing_temp));
-
-	/* Window reflected temperature */
-	json_object_object_add(jobj,
-			       "window_reflection",
-			       json_object_new_double(meta->window_reflection));
-
-	/* Thermal camera alignment quaternion (x, y, z, w) */
-	json_object_object_add(jobj,
-			       "thermal_to_visible_quat",
-			       tmeta_json_object_new_quaternion(
-				       meta->thermal_to_visible_quat));
+	if (tmeta_stats_enabled())
+		tmeta_stats_record_to_json(start);
+
+	return 0;
+}
+
+
+static void tmeta_json_get_double(struct json_object *jobj,
+				  const char *key,
+				  double *val)
+{
+	struct json_object *jval;
+
+	if (json_object_object_get_ex(jobj, key, &jval))
+		*val = json_object_get_double(jval);
+}
+
+
+static void tmeta_json_get_uint32(struct json_object *jobj,
+				  const char *key,
+				  uint32_t *val)
+{
+	struct json_object *jval;
+
+	/* Values are written as 32-bit signed integers */
+	if (json_object_object_get_ex(jobj, key, &jval))
+		*val = (uint32_t)json_object_get_int(jval);
+}
+
+
+static void tmeta_json_object_get_quaternion(struct json_object *jobj,
+					     float quat[4])
+{
+	static const char *const names[4] = {"x", "y", "z", "w"};
+	double val;
+
+	for (unsigned int i = 0; i < 4; i++) {
+		val = 0.;
+		tmeta_json_get_double(jobj, names[i], &val);
+		quat[i] = (float)val;
+	}
+}
+
+
+static void tmeta_json_get_quaternion(struct json_object *jobj,
+				      const char *key,
+				      float quat[4])
+{
+	struct json_object *jval;
+
+	if (json_object_object_get_ex(jobj, key, &jval))
+		tmeta_json_object_get_quaternion(jval, quat);
+}
+
+
+static void tmeta_json_get_gain_mode(struct json_object *jobj,
+				     const char *key,
+				     enum tmeta_thermal_gain_mode *val)
+{
+	struct json_object *jval;
+
+	if (json_object_object_get_ex(jobj, key, &jval))
+		*val = tmeta_thermal_gain_mode_from_str(
+			json_object_get_string(jval));
+}
+
+
+static void tmeta_json_get_frame_state(struct json_object *jobj,
+				       const char *key,
+				       enum tmeta_thermal_frame_state *val)
+{
+	struct json_object *jval;
+
+	if (json_object_object_get_ex(jobj, key, &jval))
+		*val = tmeta_thermal_frame_state_from_str(
+			json_object_get_string(jval));
+}
+
+
+/* JSON input of the schema fields, per kind; the camera angles count is
+ * read from the cam_angles and cam_angles_timestamps arrays and there is
+ * no checksum */
+#define TMETA_JSON_GET_U32(_j, _m, _f) tmeta_json_get_uint32(_j, #_f, &(_m)->_f)
+#define TMETA_JSON_GET_GAIN_MODE(_j, _m, _f)                                   \
+	tmeta_json_get_gain_mode(_j, #_f, &(_m)->_f)
+#define TMETA_JSON_GET_FRAME_STATE(_j, _m, _f)                                 \
+	tmeta_json_get_frame_state(_j, #_f, &(_m)->_f)
+#define TMETA_JSON_GET_COUNT(_j, _m, _f)
+#define TMETA_JSON_GET_F64(_j, _m, _f) tmeta_json_get_double(_j, #_f, &(_m)->_f)
+#define TMETA_JSON_GET_QUAT(_j, _m, _f)                                        \
+	tmeta_json_get_quaternion(_j, #_f, (_m)->_f)
+#define TMETA_JSON_GET_CHECKSUM(_j, _m, _f)
+#define TMETA_JSON_GET_FIELD(_kind, _f) TMETA_JSON_GET_##_kind(jobj, meta, _f);
+
+
+int tmeta_thermal_metadata_from_json(struct json_object *jobj,
+				     struct tmeta_data *meta)
+{
+	struct json_object *jcam_angles = NULL;
+	struct json_object *jcam_angles_timestamps = NULL;
+	uint32_t version_major = 0, version_minor = 0;
+	size_t count, ts_count;
+
+	ULOG_ERRNO_RETURN_ERR_IF(jobj == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+
+	memset(meta, 0, sizeof(*meta));
+
+	/* Structure format version (major number and minor number) */
+	tmeta_json_get_uint32(jobj, "version_major", &version_major);
+	tmeta_json_get_uint32(jobj, "version_minor", &version_minor);
+	meta->version = (version_major & 0xFFFF) << 16 |
+			(version_minor & 0xFFFF);
+
+	/* v0.1 header */
+	TMETA_SCHEMA_V0_1_HEADER(TMETA_JSON_GET_FIELD)
+
+	/* Camera angles quaternions (x, y, z, w) and timestamps */
+	json_object_object_get_ex(jobj, "cam_angles", &jcam_angles);
+	json_object_object_get_ex(
+		jobj, "cam_angles_timestamps", &jcam_angles_timestamps);
+	count = (jcam_angles != NULL) ? json_object_array_length(jcam_angles)
+				      : 0;
+	ts_count = (jcam_angles_timestamps != NULL)
+			   ? json_object_array_length(jcam_angles_timestamps)
+			   : 0;
+	if (count != ts_count) {
+		ULOGE("%s: camera angles count mismatch (%zu vs. %zu)",
+		      __func__,
+		      count,
+		      ts_count);
+		return -EPROTO;
+	}
+	if (count > TMETA_CAMANGLES_MAXCOUNT)
+		return TMETA_ERR_TOO_MANY_CAM_ANGLES;
+	meta->cam_angles_count = count;
+	for (size_t i = 0; i < count; i++) {
+		tmeta_json_object_get_quaternion(
+			json_object_array_get_idx(jcam_angles, i),
+			meta->cam_angles + i * 4);
+		meta->cam_angles_timestamps[i] = (uint64_t)json_object_get_int64(
+			json_object_array_get_idx(jcam_angles_timestamps, i));
+	}
+
+	/* Fields added by the following versions */
+	TMETA_SCHEMA_TAIL_LATEST(TMETA_JSON_GET_FIELD)
 
 	return 0;
 }
@@ -0,0 +1,746 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tmeta_priv.h"
+
+#if defined(__ARM_NEON)
+#	include <arm_neon.h>
+#	define TMETA_ACCUM_NEON
+#endif
+
+
+#define DEFAULT_WINDOW 30
+#define MAX_WINDOW UINT16_MAX
+
+/* Temperatures are stored as unsigned 16-bit fixed point values in
+ * 1/64 K units (0..1024 K) */
+#define TEMP_SCALE 64.
+
+
+typedef void (*update_row_fn_t)(const uint16_t *row,
+				uint16_t *old,
+				uint32_t *sum,
+				uint16_t *count,
+				uint16_t *streak,
+				uint16_t *prefix,
+				bool restart,
+				const uint16_t *prev_max,
+				const uint16_t *suffix,
+				uint16_t *max,
+				unsigned int width,
+				uint16_t threshold);
+
+
+typedef void (*max_plane_fn_t)(uint16_t *dst,
+			       const uint16_t *a,
+			       const uint16_t *b,
+			       size_t size);
+
+
+/* The sliding window maximum uses a de-amortized two-stacks (van Herk /
+ * Gil-Werman) scheme: the frames are split in blocks of half the window
+ * length (block_len); for the current block a running maximum (prefix) is
+ * updated with each frame. With W = window and p the position in the
+ * current block, the window holds the current block frames 0..p, the
+ * whole previous block and the last W - 1 - p - block_len frames of the
+ * block before, so the window maximum is the maximum of the current block
+ * prefix, of the previous block maximum and of a suffix maximum of the
+ * block before. The suffix maxima of a block are computed one plane per
+ * frame while the next block is filled (all its frames are still in the
+ * ring buffer), so that the cost of a frame does not depend on the window
+ * length. Frames before the first one are zeros, which do not change the
+ * maxima.
+ * The mean uses a running sum and the persistence uses a running count;
+ * the evicted frame is read back from the ring buffer. */
+struct tmeta_accum {
+	unsigned int width;
+	unsigned int height;
+	unsigned int window;
+	unsigned int block_len;
+	uint16_t threshold;
+	size_t plane_size;
+
+	/* Window frames (ring buffer of window planes) */
+	uint16_t *ring;
+
+	/* Suffix maxima (block_len planes each) of the block before the
+	 * previous one, used for the window maximum, and of the previous
+	 * block, being computed */
+	uint16_t *suffix;
+	uint16_t *next_suffix;
+
+	/* Prefix maximum of the current block and maximum of the previous
+	 * block */
+	uint16_t *prefix;
+	uint16_t *prev_max;
+
+	/* Output maps */
+	uint16_t *max;
+	uint32_t *sum;
+	uint16_t *count;
+	uint16_t *streak;
+
+	/* Converted row of the current frame */
+	uint16_t *row;
+
+	/* 8-bit value to temperature table of the current frame */
+	uint16_t lut[256];
+
+	/* Row and plane functions, selected at creation */
+	update_row_fn_t update_row;
+	max_plane_fn_t max_plane;
+
+	/* Ring buffer slot of the next frame, its position in the current
+	 * block and ring buffer slot of the first frame of the previous
+	 * block */
+	unsigned int slot;
+	unsigned int pos;
+	unsigned int prev_slot;
+
+	unsigned int window_frames;
+	uint64_t frames;
+	uint64_t skipped_frames;
+};
+
+
+static uint16_t temp_to_fixed(double temp)
+{
+	double v = round(temp * TEMP_SCALE);
+	if (!(v > 0.))
+		return 0;
+	if (v >= UINT16_MAX)
+		return UINT16_MAX;
+	return (uint16_t)v;
+}
+
+
+static int build_lut(struct tmeta_accum *self, const struct tmeta_data *meta)
+{
+	int res;
+	bool in_range = false;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		double temp;
+		res = tmeta_raw_to_temperature(
+			meta, tmeta_u8_to_raw(meta, i), &temp);
+		if (res == 0) {
+			self->lut[i] = temp_to_fixed(temp);
+			in_range = true;
+		} else if (res == -EDOM) {
+			/* The temperature is monotonic: values outside of
+			 * the calibration curve are either below or above
+			 * all valid values */
+			self->lut[i] = in_range ? UINT16_MAX : 0;
+		} else {
+			return res;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Update the maps for the row pixels from index i */
+static void update_row_c(const uint16_t *row,
+			 uint16_t *old,
+			 uint32_t *sum,
+			 uint16_t *count,
+			 uint16_t *streak,
+			 uint16_t *prefix,
+			 bool restart,
+			 const uint16_t *prev_max,
+			 const uint16_t *suffix,
+			 uint16_t *max,
+			 unsigned int width,
+			 uint16_t threshold,
+			 unsigned int i)
+{
+	for (; i < width; i++) {
+		uint16_t n = row[i];
+		uint16_t o = old[i];
+		old[i] = n;
+		sum[i] = sum[i] + n - o;
+		count[i] = count[i] + (n > threshold) - (o > threshold);
+		streak[i] = (n > threshold)
+				    ? (streak[i] + (streak[i] < UINT16_MAX))
+				    : 0;
+		if (restart || (n > prefix[i]))
+			prefix[i] = n;
+		max[i] = prefix[i];
+		if ((prev_max != NULL) && (prev_max[i] > max[i]))
+			max[i] = prev_max[i];
+		if ((suffix != NULL) && (suffix[i] > max[i]))
+			max[i] = suffix[i];
+	}
+}
+
+
+static void update_row(const uint16_t *row,
+		       uint16_t *old,
+		       uint32_t *sum,
+		       uint16_t *count,
+		       uint16_t *streak,
+		       uint16_t *prefix,
+		       bool restart,
+		       const uint16_t *prev_max,
+		       const uint16_t *suffix,
+		       uint16_t *max,
+		       unsigned int width,
+		       uint16_t threshold)
+{
+	unsigned int i = 0;
+
+#if defined(TMETA_ACCUM_NEON)
+	const uint16x8_t vthr = vdupq_n_u16(threshold);
+	const uint16x8_t one = vdupq_n_u16(1);
+	for (; i + 8 <= width; i += 8) {
+		uint16x8_t n = vld1q_u16(row + i);
+		uint16x8_t o = vld1q_u16(old + i);
+		vst1q_u16(old + i, n);
+
+		/* Modulo 2^32 arithmetic: the sum is exact once the evicted
+		 * value is subtracted */
+		uint32x4_t s0 = vld1q_u32(sum + i);
+		uint32x4_t s1 = vld1q_u32(sum + i + 4);
+		s0 = vsubw_u16(vaddw_u16(s0, vget_low_u16(n)), vget_low_u16(o));
+		s1 = vsubw_u16(vaddw_u16(s1, vget_high_u16(n)),
+			       vget_high_u16(o));
+		vst1q_u32(sum + i, s0);
+		vst1q_u32(sum + i + 4, s1);
+
+		/* Masks are all ones for values above the threshold */
+		uint16x8_t an = vcgtq_u16(n, vthr);
+		uint16x8_t ao = vcgtq_u16(o, vthr);
+		uint16x8_t c = vld1q_u16(count + i);
+		c = vaddq_u16(vsubq_u16(c, an), ao);
+		vst1q_u16(count + i, c);
+		uint16x8_t st = vld1q_u16(streak + i);
+		st = vandq_u16(vqaddq_u16(st, one), an);
+		vst1q_u16(streak + i, st);
+
+		uint16x8_t p = restart ? n : vmaxq_u16(vld1q_u16(prefix + i), n);
+		vst1q_u16(prefix + i, p);
+		if (prev_max != NULL)
+			p = vmaxq_u16(p, vld1q_u16(prev_max + i));
+		if (suffix != NULL)
+			p = vmaxq_u16(p, vld1q_u16(suffix + i));
+		vst1q_u16(max + i, p);
+	}
+#endif
+
+	update_row_c(row, old, sum, count, streak, prefix, restart, prev_max, suffix, max, width, threshold, i);
+}
+
+
+/* Maximum of two planes from index i */
+static void max_plane_c(uint16_t *dst,
+			const uint16_t *a,
+			const uint16_t *b,
+			size_t size,
+			size_t i)
+{
+	for (; i < size; i++)
+		dst[i] = (a[i] > b[i]) ? a[i] : b[i];
+}
+
+
+static void max_plane(uint16_t *dst,
+		      const uint16_t *a,
+		      const uint16_t *b,
+		      size_t size)
+{
+	size_t i = 0;
+
+#if defined(TMETA_ACCUM_NEON)
+	for (; i + 8 <= size; i += 8)
+		vst1q_u16(dst + i, vmaxq_u16(vld1q_u16(a + i), vld1q_u16(b + i)));
+#endif
+
+	max_plane_c(dst, a, b, size, i);
+}
+
+
+#ifdef TMETA_AVX2
+
+TMETA_TARGET_AVX2 static void
+update_row_avx2(const uint16_t *row,
+		uint16_t *old,
+		uint32_t *sum,
+		uint16_t *count,
+		uint16_t *streak,
+		uint16_t *prefix,
+		bool restart,
+		const uint16_t *prev_max,
+		const uint16_t *suffix,
+		uint16_t *max,
+		unsigned int width,
+		uint16_t threshold)
+{
+	unsigned int i = 0;
+
+	/* Unsigned 'v > threshold' as 'max(v, threshold + 1) == v' */
+	const __m256i vthr = _mm256_set1_epi16((short)(threshold + 1));
+	const __m256i one = _mm256_set1_epi16(1);
+	for (; i + 16 <= width; i += 16) {
+		__m256i n = _mm256_loadu_si256((const __m256i *)(row + i));
+		__m256i o = _mm256_loadu_si256((const __m256i *)(old + i));
+		_mm256_storeu_si256((__m256i *)(old + i), n);
+
+		__m256i s0 = _mm256_loadu_si256((const __m256i *)(sum + i));
+		__m256i s1 = _mm256_loadu_si256((const __m256i *)(sum + i + 8));
+		s0 = _mm256_add_epi32(
+			s0,
+			_mm256_sub_epi32(
+				_mm256_cvtepu16_epi32(_mm256_castsi256_si128(n)),
+				_mm256_cvtepu16_epi32(
+					_mm256_castsi256_si128(o))));
+		s1 = _mm256_add_epi32(
+			s1,
+			_mm256_sub_epi32(
+				_mm256_cvtepu16_epi32(
+					_mm256_extracti128_si256(n, 1)),
+				_mm256_cvtepu16_epi32(
+					_mm256_extracti128_si256(o, 1))));
+		_mm256_storeu_si256((__m256i *)(sum + i), s0);
+		_mm256_storeu_si256((__m256i *)(sum + i + 8), s1);
+
+		/* Masks are -1 for values above the threshold */
+		__m256i an = _mm256_cmpeq_epi16(_mm256_max_epu16(n, vthr), n);
+		__m256i ao = _mm256_cmpeq_epi16(_mm256_max_epu16(o, vthr), o);
+		__m256i c = _mm256_loadu_si256((const __m256i *)(count + i));
+		c = _mm256_add_epi16(_mm256_sub_epi16(c, an), ao);
+		_mm256_storeu_si256((__m256i *)(count + i), c);
+		__m256i st = _mm256_loadu_si256((const __m256i *)(streak + i));
+		st = _mm256_and_si256(_mm256_adds_epu16(st, one), an);
+		_mm256_storeu_si256((__m256i *)(streak + i), st);
+
+		__m256i p = n;
+		if (!restart) {
+			p = _mm256_max_epu16(
+				p,
+				_mm256_loadu_si256(
+					(const __m256i *)(prefix + i)));
+		}
+		_mm256_storeu_si256((__m256i *)(prefix + i), p);
+		if (prev_max != NULL) {
+			p = _mm256_max_epu16(
+				p,
+				_mm256_loadu_si256(
+					(const __m256i *)(prev_max + i)));
+		}
+		if (suffix != NULL) {
+			p = _mm256_max_epu16(
+				p,
+				_mm256_loadu_si256(
+					(const __m256i *)(suffix + i)));
+		}
+		_mm256_storeu_si256((__m256i *)(max + i), p);
+	}
+
+	update_row_c(row, old, sum, count, streak, prefix, restart, prev_max, suffix, max, width, threshold, i);
+}
+
+
+TMETA_TARGET_AVX2 static void max_plane_avx2(uint16_t *dst,
+					     const uint16_t *a,
+					     const uint16_t *b,
+					     size_t size)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= size; i += 16) {
+		_mm256_storeu_si256(
+			(__m256i *)(dst + i),
+			_mm256_max_epu16(
+				_mm256_loadu_si256((const __m256i *)(a + i)),
+				_mm256_loadu_si256((const __m256i *)(b + i))));
+	}
+
+	max_plane_c(dst, a, b, size, i);
+}
+
+#endif /* TMETA_AVX2 */
+
+
+/* Compute one suffix maximum plane of the previous block: the planes are
+ * computed from the last one, one per frame of the current block; only
+ * the planes used for the window maximum are computed */
+static void build_suffix(struct tmeta_accum *self)
+{
+	size_t plane = self->plane_size;
+	unsigned int last = self->block_len - 1;
+	unsigned int k = last - self->pos;
+	const uint16_t *frame;
+
+	if (k + self->window < 2 * self->block_len + 1)
+		return;
+
+	frame = self->ring + ((self->prev_slot + k) % self->window) * plane;
+	if (k == last) {
+		memcpy(self->next_suffix + k * plane,
+		       frame,
+		       plane * sizeof(*self->next_suffix));
+	} else {
+		self->max_plane(self->next_suffix + k * plane,
+				frame,
+				self->next_suffix + (k + 1) * plane,
+				plane);
+	}
+}
+
+
+int tmeta_accum_new(const struct tmeta_accum_config *config,
+		    struct tmeta_accum **ret_obj)
+{
+	int res;
+	struct tmeta_accum *self;
+	unsigned int window;
+	size_t plane_size;
+
+	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->width == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->height == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->window > MAX_WINDOW, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(isnan(config->threshold), EINVAL);
+
+	window = (config->window > 0) ? config->window : DEFAULT_WINDOW;
+	plane_size = (size_t)config->width * config->height;
+	if (plane_size > SIZE_MAX / sizeof(uint16_t) / window) {
+		ULOGE("%s: window too large", __func__);
+		return -EINVAL;
+	}
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		return res;
+	}
+
+	self->width = config->width;
+	self->height = config->height;
+	self->window = window;
+	self->block_len = (window > 1) ? window / 2 : 1;
+	self->prev_slot = window - self->block_len;
+	self->plane_size = plane_size;
+	self->update_row = update_row;
+	self->max_plane = max_plane;
+#ifdef TMETA_AVX2
+	if (tmeta_cpu_has_avx2()) {
+		self->update_row = update_row_avx2;
+		self->max_plane = max_plane_avx2;
+	}
+#endif
+	/* Strictly above the threshold: the largest threshold value leaves
+	 * room for the 'threshold + 1' comparisons */
+	self->threshold = temp_to_fixed(config->threshold);
+	if (self->threshold == UINT16_MAX)
+		self->threshold = UINT16_MAX - 1;
+
+	self->ring = calloc(window * plane_size, sizeof(*self->ring));
+	self->suffix =
+		calloc(self->block_len * plane_size, sizeof(*self->suffix));
+	self->next_suffix =
+		calloc(self->block_len * plane_size, sizeof(*self->next_suffix));
+	self->prefix = calloc(plane_size, sizeof(*self->prefix));
+	self->prev_max = calloc(plane_size, sizeof(*self->prev_max));
+	self->max = calloc(plane_size, sizeof(*self->max));
+	self->sum = calloc(plane_size, sizeof(*self->sum));
+	self->count = calloc(plane_size, sizeof(*self->count));
+	self->streak = calloc(plane_size, sizeof(*self->streak));
+	self->row = calloc(self->width, sizeof(*self->row));
+	if ((self->ring == NULL) || (self->suffix == NULL) ||
+	    (self->next_suffix == NULL) || (self->prefix == NULL) ||
+	    (self->prev_max == NULL) || (self->max == NULL) ||
+	    (self->sum == NULL) || (self->count == NULL) ||
+	    (self->streak == NULL) || (self->row == NULL)) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		goto error;
+	}
+
+	*ret_obj = self;
+
+	return 0;
+
+error:
+	tmeta_accum_destroy(self);
+	return res;
+}
+
+
+int tmeta_accum_destroy(struct tmeta_accum *self)
+{
+	if (self == NULL)
+		return 0;
+
+	free(self->ring);
+	free(self->suffix);
+	free(self->next_suffix);
+	free(self->prefix);
+	free(self->prev_max);
+	free(self->max);
+	free(self->sum);
+	free(self->count);
+	free(self->streak);
+	free(self->row);
+	free(self);
+
+	return 0;
+}
+
+
+int tmeta_accum_reset(struct tmeta_accum *self)
+{
+	size_t plane;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+
+	plane = self->plane_size;
+	memset(self->ring, 0, self->window * plane * sizeof(*self->ring));
+	memset(self->suffix,
+	       0,
+	       self->block_len * plane * sizeof(*self->suffix));
+	memset(self->next_suffix,
+	       0,
+	       self->block_len * plane * sizeof(*self->next_suffix));
+	memset(self->prefix, 0, plane * sizeof(*self->prefix));
+	memset(self->prev_max, 0, plane * sizeof(*self->prev_max));
+	memset(self->max, 0, plane * sizeof(*self->max));
+	memset(self->sum, 0, plane * sizeof(*self->sum));
+	memset(self->count, 0, plane * sizeof(*self->count));
+	memset(self->streak, 0, plane * sizeof(*self->streak));
+	self->slot = 0;
+	self->pos = 0;
+	self->prev_slot = self->window - self->block_len;
+	self->window_frames = 0;
+	self->frames = 0;
+	self->skipped_frames = 0;
+
+	return 0;
+}
+
+
+int tmeta_accum_push(struct tmeta_accum *self,
+		     const uint8_t *frame,
+		     size_t stride,
+		     const struct tmeta_data *meta)
+{
+	int res;
+	size_t plane;
+	uint16_t *old, *tmp;
+	const uint16_t *prev_max = NULL, *suffix = NULL;
+	unsigned int before;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(frame == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(stride < self->width, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+
+	if (!tmeta_frame_is_valid(meta)) {
+		self->skipped_frames++;
+		return 0;
+	}
+
+	res = build_lut(self, meta);
+	if (res < 0) {
+		ULOG_ERRNO("build_lut", -res);
+		return res;
+	}
+
+	/* The ring buffer slot of the new frame holds the evicted frame (or
+	 * zeros while the window is not full, which do not change the maps) */
+	plane = self->plane_size;
+	old = self->ring + self->slot * plane;
+
+	/* Window frames before the current block: the previous block and
+	 * the end of the block before */
+	before = self->window - 1 - self->pos;
+	if (before >= self->block_len) {
+		prev_max = self->prev_max;
+		before -= self->block_len;
+		if (before > 0) {
+			suffix = self->suffix +
+				 (self->block_len - before) * plane;
+		}
+	}
+
+	for (unsigned int y = 0; y < self->height; y++) {
+		const uint8_t *src = frame + y * stride;
+		size_t offset = (size_t)y * self->width;
+		for (unsigned int x = 0; x < self->width; x++)
+			self->row[x] = self->lut[src[x]];
+		self->update_row(self->row,
+				 old + offset,
+				 self->sum + offset,
+				 self->count + offset,
+				 self->streak + offset,
+				 self->prefix + offset,
+				 self->pos == 0,
+				 (prev_max != NULL) ? prev_max + offset : NULL,
+				 (suffix != NULL) ? suffix + offset : NULL,
+				 self->max + offset,
+				 self->width,
+				 self->threshold);
+	}
+
+	build_suffix(self);
+
+	self->slot = (self->slot + 1) % self->window;
+	self->pos++;
+	if (self->pos == self->block_len) {
+		/* Block complete */
+		tmp = self->suffix;
+		self->suffix = self->next_suffix;
+		self->next_suffix = tmp;
+		tmp = self->prev_max;
+		self->prev_max = self->prefix;
+		self->prefix = tmp;
+		self->prev_slot = (self->slot + self->window - self->block_len) %
+				  self->window;
+		self->pos = 0;
+	}
+	if (self->window_frames < self->window)
+		self->window_frames++;
+	self->frames++;
+
+	return 0;
+}
+
+
+int tmeta_accum_get_info(struct tmeta_accum *self,
+			 struct tmeta_accum_info *info)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(info == NULL, EINVAL);
+
+	memset(info, 0, sizeof(*info));
+	info->window_frames = self->window_frames;
+	info->frames = self->frames;
+	info->skipped_frames = self->skipped_frames;
+
+	return 0;
+}
+
+
+int tmeta_accum_get_max(struct tmeta_accum *self,
+			float *dst,
+			size_t dst_stride)
+{
+	const float scale = (float)(1. / TEMP_SCALE);
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst_stride < self->width * sizeof(float),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((dst_stride % sizeof(float)) != 0, EINVAL);
+
+	if (self->window_frames == 0)
+		return -EAGAIN;
+
+	for (unsigned int y = 0; y < self->height; y++) {
+		const uint16_t *src = self->max + (size_t)y * self->width;
+		float *d = (float *)((uint8_t *)dst + y * dst_stride);
+		for (unsigned int x = 0; x < self->width; x++)
+			d[x] = (float)src[x] * scale;
+	}
+
+	return 0;
+}
+
+
+int tmeta_accum_get_mean(struct tmeta_accum *self,
+			 float *dst,
+			 size_t dst_stride)
+{
+	float scale;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst_stride < self->width * sizeof(float),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((dst_stride % sizeof(float)) != 0, EINVAL);
+
+	if (self->window_frames == 0)
+		return -EAGAIN;
+
+	scale = (float)(1. / (TEMP_SCALE * self->window_frames));
+	for (unsigned int y = 0; y < self->height; y++) {
+		const uint32_t *src = self->sum + (size_t)y * self->width;
+		float *d = (float *)((uint8_t *)dst + y * dst_stride);
+		for (unsigned int x = 0; x < self->width; x++)
+			d[x] = (float)src[x] * scale;
+	}
+
+	return 0;
+}
+
+
+static void copy_map(const uint16_t *src,
+		     unsigned int width,
+		     unsigned int height,
+		     uint16_t *dst,
+		     size_t dst_stride)
+{
+	for (unsigned int y = 0; y < height; y++) {
+		memcpy((uint8_t *)dst + y * dst_stride,
+		       src + (size_t)y * width,
+		       width * sizeof(*src));
+	}
+}
+
+
+int tmeta_accum_get_persistence(struct tmeta_accum *self,
+				uint16_t *count,
+				size_t count_stride,
+				uint16_t *streak,
+				size_t streak_stride)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(count != NULL) &&
+			((count_stride < self->width * sizeof(uint16_t)) ||
+			 ((count_stride % sizeof(uint16_t)) != 0)),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(streak != NULL) &&
+			((streak_stride < self->width * sizeof(uint16_t)) ||
+			 ((streak_stride % sizeof(uint16_t)) != 0)),
+		EINVAL);
+
+	if (self->window_frames == 0)
+		return -EAGAIN;
+
+	if (count != NULL)
+		copy_map(self->count, self->width, self->height, count,
+			 count_stride);
+	if (streak != NULL)
+		copy_map(self->streak, self->width, self->height, streak,
+			 streak_stride);
+
+	return 0;
+}
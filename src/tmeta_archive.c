@@ -0,0 +1,956 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <float.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#	include <sys/mman.h>
+#endif /* !_WIN32 */
+
+#include "tmeta_priv.h"
+
+
+/* Archive file format (native byte order):
+ * - header (struct archive_header)
+ * - frames: record header (struct archive_record, version 2 and later)
+ *   followed by the serialized user data SEI, padded to ARCHIVE_ALIGN
+ *   bytes
+ * - frame index (struct archive_frame), sorted by timestamp
+ * - block index (struct archive_block), with per-block summaries
+ * - trailer (struct archive_trailer)
+ * The indexes and trailer are only written when the writer is destroyed;
+ * if they are missing (e.g. the writer process crashed), the reader
+ * rebuilds the indexes by scanning the frame records. */
+
+#define ARCHIVE_MAGIC 0x544d4152 /* "TMAR" */
+#define ARCHIVE_RECORD_MAGIC 0x544d4652 /* "TMFR" */
+#define ARCHIVE_TRAILER_MAGIC 0x544d4145 /* "TMAE" */
+#define ARCHIVE_BYTE_ORDER 0x01020304
+#define ARCHIVE_VERSION 2
+#define ARCHIVE_VERSION_NO_RECORDS 1
+#define ARCHIVE_ALIGN 8
+
+/* Default number of frames per index block */
+#define DEFAULT_BLOCK_FRAMES 64
+
+
+struct archive_header {
+	uint32_t magic;
+	uint32_t byte_order;
+	uint16_t version;
+	uint16_t header_size;
+	uint32_t block_frames;
+	uint64_t reserved[2];
+};
+
+
+struct archive_record {
+	uint32_t magic;
+	uint32_t size;
+	uint64_t timestamp;
+};
+
+
+struct archive_frame {
+	uint64_t timestamp;
+	uint64_t offset;
+	uint32_t size;
+	uint32_t frame_state;
+	uint32_t value_min;
+	uint32_t value_max;
+};
+
+
+struct archive_block {
+	uint64_t ts_first;
+	uint64_t ts_last;
+	uint64_t cam_ts_min;
+	uint64_t cam_ts_max;
+	uint32_t first_frame;
+	uint32_t frame_count;
+	uint32_t value_min;
+	uint32_t value_max;
+	uint32_t frame_state_mask;
+	uint32_t reserved;
+	double fpa_temp_min;
+	double fpa_temp_max;
+	double housing_temp_min;
+	double housing_temp_max;
+	double window_reflection_min;
+	double window_reflection_max;
+};
+
+
+struct archive_trailer {
+	uint64_t frame_index_offset;
+	uint64_t block_index_offset;
+	uint32_t frame_count;
+	uint32_t block_count;
+	uint32_t magic;
+	uint32_t reserved;
+};
+
+
+_Static_assert(sizeof(struct archive_header) == 32, "archive header size");
+_Static_assert(sizeof(struct archive_record) == 16, "archive record size");
+_Static_assert(sizeof(struct archive_frame) == 32, "archive frame size");
+_Static_assert(sizeof(struct archive_block) == 104, "archive block size");
+_Static_assert(sizeof(struct archive_trailer) == 32, "archive trailer size");
+
+
+struct tmeta_archive_writer {
+	FILE *file;
+	uint64_t offset;
+	unsigned int block_frames;
+
+	uint8_t *buf;
+	size_t buf_size;
+
+	struct archive_frame *frames;
+	unsigned int frame_count;
+	unsigned int frame_capacity;
+
+	struct archive_block *blocks;
+	unsigned int block_count;
+	unsigned int block_capacity;
+};
+
+
+struct tmeta_archive_reader {
+	const uint8_t *data;
+	size_t size;
+	uint64_t data_end;
+	const struct archive_frame *frames;
+	unsigned int frame_count;
+	const struct archive_block *blocks;
+	unsigned int block_count;
+
+	/* Indexes rebuilt by scanning the frame records when the archive
+	 * was not finalized */
+	struct archive_frame *rebuilt_frames;
+	unsigned int rebuilt_frame_capacity;
+	struct archive_block *rebuilt_blocks;
+	unsigned int rebuilt_block_capacity;
+};
+
+
+static int writer_write(struct tmeta_archive_writer *self,
+			const void *data,
+			size_t size)
+{
+	int res;
+
+	if (size == 0)
+		return 0;
+
+	if (fwrite(data, size, 1, self->file) != 1) {
+		res = -EIO;
+		ULOG_ERRNO("fwrite", -res);
+		return res;
+	}
+	self->offset += size;
+
+	return 0;
+}
+
+
+int tmeta_archive_writer_new(const char *path,
+			     unsigned int block_frames,
+			     struct tmeta_archive_writer **ret_obj)
+{
+	int res;
+	struct tmeta_archive_writer *self;
+	struct archive_header header;
+
+	ULOG_ERRNO_RETURN_ERR_IF(path == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		return res;
+	}
+	self->block_frames =
+		(block_frames > 0) ? block_frames : DEFAULT_BLOCK_FRAMES;
+
+	self->file = fopen(path, "wb");
+	if (self->file == NULL) {
+		res = -errno;
+		ULOG_ERRNO("fopen:'%s'", -res, path);
+		free(self);
+		return res;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = ARCHIVE_MAGIC;
+	header.byte_order = ARCHIVE_BYTE_ORDER;
+	header.version = ARCHIVE_VERSION;
+	header.header_size = sizeof(header);
+	header.block_frames = self->block_frames;
+	res = writer_write(self, &header, sizeof(header));
+	if (res < 0) {
+		fclose(self->file);
+		free(self);
+		return res;
+	}
+
+	*ret_obj = self;
+
+	return 0;
+}
+
+
+int tmeta_archive_writer_destroy(struct tmeta_archive_writer *self)
+{
+	int res;
+	struct archive_trailer trailer;
+
+	if (self == NULL)
+		return 0;
+
+	memset(&trailer, 0, sizeof(trailer));
+	trailer.frame_count = self->frame_count;
+	trailer.block_count = self->block_count;
+	trailer.magic = ARCHIVE_TRAILER_MAGIC;
+
+	trailer.frame_index_offset = self->offset;
+	res = writer_write(self,
+			   self->frames,
+			   self->frame_count * sizeof(*self->frames));
+	if (res < 0)
+		goto out;
+
+	trailer.block_index_offset = self->offset;
+	res = writer_write(self,
+			   self->blocks,
+			   self->block_count * sizeof(*self->blocks));
+	if (res < 0)
+		goto out;
+
+	res = writer_write(self, &trailer, sizeof(trailer));
+
+out:
+	if ((fclose(self->file) != 0) && (res == 0)) {
+		res = -errno;
+		ULOG_ERRNO("fclose", -res);
+	}
+	free(self->buf);
+	free(self->frames);
+	free(self->blocks);
+	free(self);
+	return res;
+}
+
+
+static int writer_grow(void **array,
+		       unsigned int *capacity,
+		       unsigned int count,
+		       size_t elem_size)
+{
+	int res;
+	unsigned int new_capacity;
+	void *new_array;
+
+	if (count < *capacity)
+		return 0;
+
+	new_capacity = (*capacity > 0) ? *capacity * 2 : 1024;
+	new_array = realloc(*array, new_capacity * elem_size);
+	if (new_array == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("realloc", -res);
+		return res;
+	}
+	*array = new_array;
+	*capacity = new_capacity;
+
+	return 0;
+}
+
+
+static void block_add_frame(struct archive_block *block,
+			    const struct archive_frame *frame,
+			    const struct tmeta_data *meta)
+{
+	if (block->frame_count == 0) {
+		block->ts_first = frame->timestamp;
+		block->cam_ts_min = UINT64_MAX;
+		block->cam_ts_max = 0;
+		block->value_min = UINT32_MAX;
+		block->value_max = 0;
+		block->fpa_temp_min = DBL_MAX;
+		block->fpa_temp_max = -DBL_MAX;
+		block->housing_temp_min = DBL_MAX;
+		block->housing_temp_max = -DBL_MAX;
+		block->window_reflection_min = DBL_MAX;
+		block->window_reflection_max = -DBL_MAX;
+	}
+	block->frame_count++;
+	block->ts_last = frame->timestamp;
+
+	for (unsigned int i = 0; i < meta->cam_angles_count; i++) {
+		uint64_t ts = meta->cam_angles_timestamps[i];
+		if (ts < block->cam_ts_min)
+			block->cam_ts_min = ts;
+		if (ts > block->cam_ts_max)
+			block->cam_ts_max = ts;
+	}
+	if (meta->value_min < block->value_min)
+		block->value_min = meta->value_min;
+	if (meta->value_max > block->value_max)
+		block->value_max = meta->value_max;
+	if (frame->frame_state < 32)
+		block->frame_state_mask |= 1u << frame->frame_state;
+	block->fpa_temp_min = fmin(block->fpa_temp_min, meta->fpa_temp);
+	block->fpa_temp_max = fmax(block->fpa_temp_max, meta->fpa_temp);
+	block->housing_temp_min =
+		fmin(block->housing_temp_min, meta->housing_temp);
+	block->housing_temp_max =
+		fmax(block->housing_temp_max, meta->housing_temp);
+	block->window_reflection_min =
+		fmin(block->window_reflection_min, meta->window_reflection);
+	block->window_reflection_max =
+		fmax(block->window_reflection_max, meta->window_reflection);
+}
+
+
+int tmeta_archive_writer_append(struct tmeta_archive_writer *self,
+				uint64_t timestamp,
+				const struct tmeta_data *meta)
+{
+	int res;
+	size_t size, padded_size;
+	struct archive_record *record;
+	struct archive_frame *frame;
+	struct archive_block *block;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta->cam_angles_count >
+					 TMETA_CAMANGLES_MAXCOUNT,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(self->frame_count >= INT32_MAX, ENOSPC);
+
+	if ((self->frame_count > 0) &&
+	    (timestamp < self->frames[self->frame_count - 1].timestamp)) {
+		ULOGE("%s: non-monotonic timestamp %" PRIu64 " < %" PRIu64,
+		      __func__,
+		      timestamp,
+		      self->frames[self->frame_count - 1].timestamp);
+		return -EINVAL;
+	}
+
+	/* Serialize the metadata after the record header */
+	size = TMETA_BUF_SIZE(meta);
+	padded_size = sizeof(*record) +
+		      ((size + ARCHIVE_ALIGN - 1) &
+		       ~(size_t)(ARCHIVE_ALIGN - 1));
+	if (padded_size > self->buf_size) {
+		uint8_t *buf = realloc(self->buf, padded_size);
+		if (buf == NULL) {
+			res = -ENOMEM;
+			ULOG_ERRNO("realloc", -res);
+			return res;
+		}
+		self->buf = buf;
+		self->buf_size = padded_size;
+	}
+	res = tmeta_serialize_thermal_metadata_user_data_sei(
+		meta,
+		self->buf + sizeof(*record),
+		self->buf_size - sizeof(*record),
+		&size);
+	if (res < 0)
+		return res;
+	memset(self->buf + sizeof(*record) + size,
+	       0,
+	       padded_size - sizeof(*record) - size);
+	record = (struct archive_record *)self->buf;
+	record->magic = ARCHIVE_RECORD_MAGIC;
+	record->size = size;
+	record->timestamp = timestamp;
+
+	/* Index the frame */
+	res = writer_grow((void **)&self->frames,
+			  &self->frame_capacity,
+			  self->frame_count,
+			  sizeof(*self->frames));
+	if (res < 0)
+		return res;
+	if ((self->block_count == 0) ||
+	    (self->blocks[self->block_count - 1].frame_count >=
+	     self->block_frames)) {
+		res = writer_grow((void **)&self->blocks,
+				  &self->block_capacity,
+				  self->block_count,
+				  sizeof(*self->blocks));
+		if (res < 0)
+			return res;
+		block = &self->blocks[self->block_count++];
+		memset(block, 0, sizeof(*block));
+		block->first_frame = self->frame_count;
+	} else {
+		block = &self->blocks[self->block_count - 1];
+	}
+
+	frame = &self->frames[self->frame_count];
+	frame->timestamp = timestamp;
+	frame->offset = self->offset + sizeof(*record);
+	frame->size = size;
+	frame->frame_state = meta->frame_state;
+	frame->value_min = meta->value_min;
+	frame->value_max = meta->value_max;
+
+	res = writer_write(self, self->buf, padded_size);
+	if (res < 0)
+		return res;
+
+	self->frame_count++;
+	block_add_frame(block, frame, meta);
+
+	/* Flush the completed blocks so that they can be recovered by
+	 * scanning if the writer is not destroyed */
+	if ((block->frame_count == self->block_frames) &&
+	    (fflush(self->file) != 0)) {
+		res = -errno;
+		ULOG_ERRNO("fflush", -res);
+		return res;
+	}
+
+	return 0;
+}
+
+
+#ifndef _WIN32
+
+/* Use the indexes written when the writer was destroyed; returns -ENOENT
+ * if the archive was not finalized */
+static int reader_load_indexes(struct tmeta_archive_reader *self,
+			       const struct archive_header *header)
+{
+	struct archive_trailer trailer;
+	uint64_t index_end;
+
+	/* The file size is a multiple of ARCHIVE_ALIGN in a finalized
+	 * archive, but the trailer is copied anyway in case it is not */
+	if ((self->size < header->header_size + sizeof(trailer)) ||
+	    ((self->size % ARCHIVE_ALIGN) != 0))
+		return -ENOENT;
+	memcpy(&trailer,
+	       self->data + self->size - sizeof(trailer),
+	       sizeof(trailer));
+	if (trailer.magic != ARCHIVE_TRAILER_MAGIC)
+		return -ENOENT;
+
+	/* Check the indexes bounds; each term is checked against the index
+	 * area size so that the sums cannot wrap around */
+	index_end = self->size - sizeof(trailer);
+	if ((trailer.frame_index_offset < header->header_size) ||
+	    (trailer.frame_index_offset > index_end) ||
+	    ((trailer.frame_index_offset % ARCHIVE_ALIGN) != 0) ||
+	    (trailer.frame_count > INT32_MAX) ||
+	    (trailer.frame_count > (index_end - trailer.frame_index_offset) /
+					   sizeof(struct archive_frame))) {
+		ULOGE("%s: invalid archive frame index", __func__);
+		return -EPROTO;
+	}
+	if ((trailer.block_index_offset !=
+	     trailer.frame_index_offset +
+		     (uint64_t)trailer.frame_count *
+			     sizeof(struct archive_frame)) ||
+	    (trailer.block_count > (index_end - trailer.block_index_offset) /
+					   sizeof(struct archive_block)) ||
+	    ((uint64_t)trailer.block_count * sizeof(struct archive_block) !=
+	     index_end - trailer.block_index_offset)) {
+		ULOGE("%s: invalid archive block index", __func__);
+		return -EPROTO;
+	}
+	self->data_end = trailer.frame_index_offset;
+	self->frames = (const struct archive_frame *)(self->data +
+						      trailer.frame_index_offset);
+	self->frame_count = trailer.frame_count;
+	self->blocks = (const struct archive_block *)(self->data +
+						      trailer.block_index_offset);
+	self->block_count = trailer.block_count;
+	for (unsigned int i = 0; i < self->frame_count; i++) {
+		if ((self->frames[i].offset < header->header_size) ||
+		    (self->frames[i].offset > self->data_end) ||
+		    (self->frames[i].size >
+		     self->data_end - self->frames[i].offset)) {
+			ULOGE("%s: invalid archive frame %u", __func__, i);
+			return -EPROTO;
+		}
+	}
+	for (unsigned int i = 0; i < self->block_count; i++) {
+		if ((uint64_t)self->blocks[i].first_frame +
+			    self->blocks[i].frame_count >
+		    self->frame_count) {
+			ULOGE("%s: invalid archive block %u", __func__, i);
+			return -EPROTO;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Rebuild the indexes of an archive that was not finalized by scanning
+ * the frame records, up to the first incomplete or invalid one */
+static int reader_rebuild_indexes(struct tmeta_archive_reader *self,
+				  const struct archive_header *header)
+{
+	int res;
+	uint64_t offset = header->header_size;
+	struct archive_record record;
+	struct archive_frame *frame;
+	struct archive_block *block = NULL;
+	struct tmeta_data meta;
+	size_t padded_size;
+
+	while ((self->size - offset >= sizeof(record)) &&
+	       (self->frame_count < INT32_MAX)) {
+		memcpy(&record, self->data + offset, sizeof(record));
+		if (record.magic != ARCHIVE_RECORD_MAGIC)
+			break;
+		padded_size = sizeof(record) +
+			      ((record.size + ARCHIVE_ALIGN - 1) &
+			       ~(size_t)(ARCHIVE_ALIGN - 1));
+		if (padded_size > self->size - offset)
+			break;
+		if ((self->frame_count > 0) &&
+		    (record.timestamp <
+		     self->rebuilt_frames[self->frame_count - 1].timestamp))
+			break;
+		res = tmeta_deserialize_thermal_metadata_user_data_sei(
+			self->data + offset + sizeof(record),
+			record.size,
+			&meta);
+		if (res < 0)
+			break;
+
+		res = writer_grow((void **)&self->rebuilt_frames,
+				  &self->rebuilt_frame_capacity,
+				  self->frame_count,
+				  sizeof(*self->rebuilt_frames));
+		if (res < 0)
+			return res;
+		if ((block == NULL) ||
+		    (block->frame_count >= header->block_frames)) {
+			res = writer_grow((void **)&self->rebuilt_blocks,
+					  &self->rebuilt_block_capacity,
+					  self->block_count,
+					  sizeof(*self->rebuilt_blocks));
+			if (res < 0)
+				return res;
+			block = &self->rebuilt_blocks[self->block_count++];
+			memset(block, 0, sizeof(*block));
+			block->first_frame = self->frame_count;
+		}
+
+		frame = &self->rebuilt_frames[self->frame_count++];
+		frame->timestamp = record.timestamp;
+		frame->offset = offset + sizeof(record);
+		frame->size = record.size;
+		frame->frame_state = meta.frame_state;
+		frame->value_min = meta.value_min;
+		frame->value_max = meta.value_max;
+		block_add_frame(block, frame, &meta);
+
+		offset += padded_size;
+	}
+
+	self->data_end = offset;
+	self->frames = self->rebuilt_frames;
+	self->blocks = self->rebuilt_blocks;
+
+	return 0;
+}
+
+#endif /* !_WIN32 */
+
+
+int tmeta_archive_reader_new(const char *path,
+			     struct tmeta_archive_reader **ret_obj)
+{
+#ifdef _WIN32
+	ULOG_ERRNO_RETURN_ERR_IF(path == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+	return -ENOSYS;
+#else /* !_WIN32 */
+	int res, fd;
+	struct stat st;
+	struct tmeta_archive_reader *self;
+	struct archive_header header;
+	void *data;
+
+	ULOG_ERRNO_RETURN_ERR_IF(path == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		res = -errno;
+		ULOG_ERRNO("open:'%s'", -res, path);
+		return res;
+	}
+	if (fstat(fd, &st) < 0) {
+		res = -errno;
+		ULOG_ERRNO("fstat", -res);
+		close(fd);
+		return res;
+	}
+	if ((size_t)st.st_size < sizeof(struct archive_header)) {
+		ULOGE("%s: '%s' is too small", __func__, path);
+		close(fd);
+		return -EPROTO;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		res = -errno;
+		ULOG_ERRNO("mmap", -res);
+		return res;
+	}
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		munmap(data, st.st_size);
+		return res;
+	}
+	self->data = data;
+	self->size = st.st_size;
+
+	/* Check the header */
+	memcpy(&header, self->data, sizeof(header));
+	if (header.magic != ARCHIVE_MAGIC) {
+		ULOGE("%s: '%s' is not an archive", __func__, path);
+		res = -EPROTO;
+		goto error;
+	}
+	if ((header.byte_order != ARCHIVE_BYTE_ORDER) ||
+	    (header.version < ARCHIVE_VERSION_NO_RECORDS) ||
+	    (header.version > ARCHIVE_VERSION) ||
+	    (header.header_size < sizeof(header)) ||
+	    (header.header_size % ARCHIVE_ALIGN != 0) ||
+	    (header.header_size > self->size) ||
+	    (header.block_frames == 0)) {
+		ULOGE("%s: unsupported archive version %u or byte order",
+		      __func__,
+		      header.version);
+		res = -EPROTONOSUPPORT;
+		goto error;
+	}
+
+	res = reader_load_indexes(self, &header);
+	if ((res == -ENOENT) && (header.version > ARCHIVE_VERSION_NO_RECORDS)) {
+		ULOGW("%s: '%s' was not finalized, rebuilding the indexes",
+		      __func__,
+		      path);
+		res = reader_rebuild_indexes(self, &header);
+	} else if (res == -ENOENT) {
+		ULOGE("%s: '%s' was not finalized", __func__, path);
+		res = -EPROTO;
+	}
+	if (res < 0)
+		goto error;
+
+	*ret_obj = self;
+
+	return 0;
+
+error:
+	tmeta_archive_reader_destroy(self);
+	return res;
+#endif /* !_WIN32 */
+}
+
+
+int tmeta_archive_reader_destroy(struct tmeta_archive_reader *self)
+{
+	if (self == NULL)
+		return 0;
+
+#ifndef _WIN32
+	if (self->data != NULL)
+		munmap((void *)self->data, self->size);
+#endif /* !_WIN32 */
+	free(self->rebuilt_frames);
+	free(self->rebuilt_blocks);
+	free(self);
+
+	return 0;
+}
+
+
+int tmeta_archive_reader_get_frame_count(struct tmeta_archive_reader *self)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+
+	return (int)self->frame_count;
+}
+
+
+/* Index of the first frame with a timestamp greater than the given
+ * timestamp */
+static unsigned int upper_bound(const struct tmeta_archive_reader *self,
+				uint64_t timestamp)
+{
+	unsigned int lo = 0, hi = self->frame_count;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (self->frames[mid].timestamp <= timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+
+int tmeta_archive_reader_find(struct tmeta_archive_reader *self,
+			      uint64_t timestamp,
+			      unsigned int *index)
+{
+	unsigned int i;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(index == NULL, EINVAL);
+
+	i = upper_bound(self, timestamp);
+	if (i == 0)
+		return -ENOENT;
+
+	*index = i - 1;
+
+	return 0;
+}
+
+
+static void frame_to_info(const struct archive_frame *frame,
+			  struct tmeta_archive_frame_info *info)
+{
+	info->timestamp = frame->timestamp;
+	info->frame_state = frame->frame_state;
+	info->value_min = frame->value_min;
+	info->value_max = frame->value_max;
+	info->size = frame->size;
+}
+
+
+int tmeta_archive_reader_get_info(struct tmeta_archive_reader *self,
+				  unsigned int index,
+				  struct tmeta_archive_frame_info *info)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(info == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(index >= self->frame_count, ENOENT);
+
+	frame_to_info(&self->frames[index], info);
+
+	return 0;
+}
+
+
+int tmeta_archive_reader_get(struct tmeta_archive_reader *self,
+			     unsigned int index,
+			     struct tmeta_data *meta)
+{
+	const struct archive_frame *frame;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(index >= self->frame_count, ENOENT);
+
+	frame = &self->frames[index];
+	if ((frame->offset > self->data_end) ||
+	    (frame->size > self->data_end - frame->offset)) {
+		ULOGE("%s: invalid archive frame %u", __func__, index);
+		return -EPROTO;
+	}
+
+	return tmeta_deserialize_thermal_metadata_user_data_sei(
+		self->data + frame->offset, frame->size, meta);
+}
+
+
+static bool block_matches(const struct archive_block *block,
+			  const struct tmeta_archive_query *query)
+{
+	uint32_t filters = query->filters;
+
+	if ((filters & TMETA_ARCHIVE_FILTER_FRAME_STATE) &&
+	    !(block->frame_state_mask & query->frame_state_mask))
+		return false;
+	if ((filters & TMETA_ARCHIVE_FILTER_RAW_VALUE) &&
+	    ((block->value_max < query->raw_min) ||
+	     (block->value_min > query->raw_max)))
+		return false;
+	if ((filters & TMETA_ARCHIVE_FILTER_CAM_ANGLES_TIME) &&
+	    ((block->cam_ts_max < query->cam_ts_start) ||
+	     (block->cam_ts_min > query->cam_ts_end)))
+		return false;
+	if ((filters & TMETA_ARCHIVE_FILTER_FPA_TEMP) &&
+	    ((block->fpa_temp_max < query->fpa_temp_min) ||
+	     (block->fpa_temp_min > query->fpa_temp_max)))
+		return false;
+	if ((filters & TMETA_ARCHIVE_FILTER_HOUSING_TEMP) &&
+	    ((block->housing_temp_max < query->housing_temp_min) ||
+	     (block->housing_temp_min > query->housing_temp_max)))
+		return false;
+
+	return true;
+}
+
+
+static bool frame_matches(const struct archive_frame *frame,
+			  const struct tmeta_archive_query *query)
+{
+	uint32_t filters = query->filters;
+
+	if ((filters & TMETA_ARCHIVE_FILTER_FRAME_STATE) &&
+	    ((frame->frame_state >= 32) ||
+	     !((1u << frame->frame_state) & query->frame_state_mask)))
+		return false;
+	if ((filters & TMETA_ARCHIVE_FILTER_RAW_VALUE) &&
+	    ((frame->value_max < query->raw_min) ||
+	     (frame->value_min > query->raw_max)))
+		return false;
+
+	return true;
+}
+
+
+static bool meta_matches(const struct tmeta_data *meta,
+			 const struct tmeta_archive_query *query)
+{
+	uint32_t filters = query->filters;
+
+	if ((filters & TMETA_ARCHIVE_FILTER_FPA_TEMP) &&
+	    ((meta->fpa_temp < query->fpa_temp_min) ||
+	     (meta->fpa_temp > query->fpa_temp_max)))
+		return false;
+	if ((filters & TMETA_ARCHIVE_FILTER_HOUSING_TEMP) &&
+	    ((meta->housing_temp < query->housing_temp_min) ||
+	     (meta->housing_temp > query->housing_temp_max)))
+		return false;
+	if (filters & TMETA_ARCHIVE_FILTER_CAM_ANGLES_TIME) {
+		for (unsigned int i = 0; i < meta->cam_angles_count; i++) {
+			uint64_t ts = meta->cam_angles_timestamps[i];
+			if ((ts >= query->cam_ts_start) &&
+			    (ts <= query->cam_ts_end))
+				return true;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+
+int tmeta_archive_reader_query(struct tmeta_archive_reader *self,
+			       const struct tmeta_archive_query *query,
+			       tmeta_archive_query_cb_t cb,
+			       void *userdata)
+{
+	int res, count = 0;
+	unsigned int first = 0, last = 0, b;
+	bool parse;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(query == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(cb == NULL, EINVAL);
+
+	parse = (query->filters & (TMETA_ARCHIVE_FILTER_CAM_ANGLES_TIME |
+				   TMETA_ARCHIVE_FILTER_FPA_TEMP |
+				   TMETA_ARCHIVE_FILTER_HOUSING_TEMP)) != 0;
+
+	/* Frame range from the time filter */
+	first = 0;
+	last = self->frame_count;
+	if (query->filters & TMETA_ARCHIVE_FILTER_TIME) {
+		if (query->ts_end < query->ts_start)
+			return 0;
+		first = (query->ts_start > 0)
+				? upper_bound(self, query->ts_start - 1)
+				: 0;
+		last = upper_bound(self, query->ts_end);
+	}
+	if (first >= last)
+		return 0;
+
+	/* First block containing the first frame (blocks are contiguous
+	 * and ordered) */
+	unsigned int lo = 0, hi = self->block_count;
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (self->blocks[mid].first_frame +
+			    self->blocks[mid].frame_count <=
+		    first)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (b = lo; b < self->block_count; b++) {
+		const struct archive_block *block = &self->blocks[b];
+		unsigned int start, end;
+		if (block->first_frame >= last)
+			break;
+		if (!block_matches(block, query))
+			continue;
+		start = (block->first_frame > first) ? block->first_frame
+						     : first;
+		end = block->first_frame + block->frame_count;
+		if (end > last)
+			end = last;
+		for (unsigned int i = start; i < end; i++) {
+			const struct archive_frame *frame = &self->frames[i];
+			struct tmeta_archive_frame_info info;
+			if (!frame_matches(frame, query))
+				continue;
+			if (parse) {
+				struct tmeta_data meta;
+				res = tmeta_archive_reader_get(self, i, &meta);
+				if ((res < 0) || !meta_matches(&meta, query))
+					continue;
+			}
+			count++;
+			frame_to_info(frame, &info);
+			if (cb(self, i, &info, userdata) != 0)
+				return count;
+		}
+	}
+
+	return count;
+}
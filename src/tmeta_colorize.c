@@ -0,0 +1,503 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tmeta_priv.h"
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#	include <arm_neon.h>
+#	define TMETA_COLORIZE_NEON
+#endif
+
+
+/* Default smoothing factor of the display range moving average */
+#define DEFAULT_SMOOTHING 0.1f
+
+
+struct palette_stop {
+	float pos;
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+};
+
+
+typedef void (*apply_row_fn_t)(const struct tmeta_colorizer *self,
+			       const uint8_t *src,
+			       uint8_t *dst,
+			       unsigned int width);
+
+
+struct tmeta_colorizer {
+	enum tmeta_palette palette_id;
+	enum tmeta_range_mode range_mode;
+	float smoothing;
+	uint32_t fixed_min;
+	uint32_t fixed_max;
+
+	/* Smoothed display range */
+	bool range_valid;
+	double range_min;
+	double range_max;
+
+	/* Palette (from coldest to hottest) */
+	struct tmeta_color palette[TMETA_PALETTE_SIZE];
+
+	/* Lookup table indexed by the 8-bit JPEG value */
+	struct tmeta_color lut[TMETA_PALETTE_SIZE];
+
+#ifdef TMETA_COLORIZE_NEON
+	/* Planar copy of the lookup table for table lookup instructions */
+	uint8_t lut_planar[4][TMETA_PALETTE_SIZE];
+#endif
+
+	/* Row function, selected at creation */
+	apply_row_fn_t apply_row;
+};
+
+
+static const struct palette_stop iron_stops[] = {
+	{0.00f, 0, 0, 0},
+	{0.15f, 32, 0, 110},
+	{0.35f, 140, 10, 155},
+	{0.55f, 220, 55, 60},
+	{0.70f, 245, 115, 0},
+	{0.85f, 255, 195, 10},
+	{1.00f, 255, 255, 255},
+};
+
+
+static const struct palette_stop rainbow_stops[] = {
+	{0.00f, 0, 0, 96},
+	{0.15f, 0, 0, 255},
+	{0.35f, 0, 255, 255},
+	{0.50f, 0, 255, 0},
+	{0.70f, 255, 255, 0},
+	{1.00f, 255, 0, 0},
+};
+
+
+static const struct palette_stop white_hot_stops[] = {
+	{0.00f, 0, 0, 0},
+	{1.00f, 255, 255, 255},
+};
+
+
+static const struct palette_stop black_hot_stops[] = {
+	{0.00f, 255, 255, 255},
+	{1.00f, 0, 0, 0},
+};
+
+
+static void palette_from_stops(const struct palette_stop *stops,
+			       size_t count,
+			       struct tmeta_color *palette)
+{
+	size_t s = 0;
+
+	for (unsigned int i = 0; i < TMETA_PALETTE_SIZE; i++) {
+		float pos = (float)i / (TMETA_PALETTE_SIZE - 1);
+		while (s + 2 < count && pos > stops[s + 1].pos)
+			s++;
+		const struct palette_stop *s0 = &stops[s];
+		const struct palette_stop *s1 = &stops[s + 1];
+		float t = (pos - s0->pos) / (s1->pos - s0->pos);
+		if (t < 0.f)
+			t = 0.f;
+		else if (t > 1.f)
+			t = 1.f;
+		palette[i].r = (uint8_t)(s0->r + (s1->r - s0->r) * t + 0.5f);
+		palette[i].g = (uint8_t)(s0->g + (s1->g - s0->g) * t + 0.5f);
+		palette[i].b = (uint8_t)(s0->b + (s1->b - s0->b) * t + 0.5f);
+		palette[i].a = 255;
+	}
+}
+
+
+int tmeta_colorizer_set_palette(struct tmeta_colorizer *self,
+				enum tmeta_palette palette,
+				const struct tmeta_color *user_palette)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(palette == TMETA_PALETTE_USER) && (user_palette == NULL),
+		EINVAL);
+
+	switch (palette) {
+	case TMETA_PALETTE_IRON:
+		palette_from_stops(iron_stops,
+				   sizeof(iron_stops) / sizeof(iron_stops[0]),
+				   self->palette);
+		break;
+	case TMETA_PALETTE_RAINBOW:
+		palette_from_stops(
+			rainbow_stops,
+			sizeof(rainbow_stops) / sizeof(rainbow_stops[0]),
+			self->palette);
+		break;
+	case TMETA_PALETTE_WHITE_HOT:
+		palette_from_stops(
+			white_hot_stops,
+			sizeof(white_hot_stops) / sizeof(white_hot_stops[0]),
+			self->palette);
+		break;
+	case TMETA_PALETTE_BLACK_HOT:
+		palette_from_stops(
+			black_hot_stops,
+			sizeof(black_hot_stops) / sizeof(black_hot_stops[0]),
+			self->palette);
+		break;
+	case TMETA_PALETTE_USER:
+		memcpy(self->palette,
+		       user_palette,
+		       TMETA_PALETTE_SIZE * sizeof(*user_palette));
+		break;
+	default:
+		ULOGE("%s: invalid palette %d", __func__, palette);
+		return -EINVAL;
+	}
+
+	self->palette_id = palette;
+
+	return 0;
+}
+
+
+#ifdef TMETA_COLORIZE_NEON
+static inline uint8x16_t lut_lookup_neon(const uint8_t *lut, uint8x16_t idx)
+{
+	const uint8x16_t off = vdupq_n_u8(64);
+	uint8x16x4_t t;
+	uint8x16_t res;
+
+	/* 256-entry lookup as 4 chained 64-byte table lookups; out of range
+	 * indices leave the result unchanged with vqtbx4q_u8 */
+	t.val[0] = vld1q_u8(lut);
+	t.val[1] = vld1q_u8(lut + 16);
+	t.val[2] = vld1q_u8(lut + 32);
+	t.val[3] = vld1q_u8(lut + 48);
+	res = vqtbl4q_u8(t, idx);
+	for (unsigned int k = 1; k < 4; k++) {
+		idx = vsubq_u8(idx, off);
+		t.val[0] = vld1q_u8(lut + 64 * k);
+		t.val[1] = vld1q_u8(lut + 64 * k + 16);
+		t.val[2] = vld1q_u8(lut + 64 * k + 32);
+		t.val[3] = vld1q_u8(lut + 64 * k + 48);
+		res = vqtbx4q_u8(res, t, idx);
+	}
+
+	return res;
+}
+#endif
+
+
+/* Colorize the row pixels from index i */
+static void apply_row_c(const struct tmeta_colorizer *self,
+			const uint8_t *src,
+			uint8_t *dst,
+			unsigned int width,
+			unsigned int i)
+{
+	for (; i < width; i++)
+		memcpy(dst + 4 * i, &self->lut[src[i]], sizeof(self->lut[0]));
+}
+
+
+static void apply_row(const struct tmeta_colorizer *self,
+		      const uint8_t *src,
+		      uint8_t *dst,
+		      unsigned int width)
+{
+	unsigned int i = 0;
+
+#if defined(TMETA_COLORIZE_NEON)
+	for (; i + 16 <= width; i += 16) {
+		uint8x16_t idx = vld1q_u8(src + i);
+		uint8x16x4_t rgba;
+		rgba.val[0] = lut_lookup_neon(self->lut_planar[0], idx);
+		rgba.val[1] = lut_lookup_neon(self->lut_planar[1], idx);
+		rgba.val[2] = lut_lookup_neon(self->lut_planar[2], idx);
+		rgba.val[3] = lut_lookup_neon(self->lut_planar[3], idx);
+		vst4q_u8(dst + 4 * i, rgba);
+	}
+#endif
+
+	apply_row_c(self, src, dst, width, i);
+}
+
+
+#ifdef TMETA_AVX2
+
+TMETA_TARGET_AVX2 static void
+apply_row_avx2(const struct tmeta_colorizer *self,
+	       const uint8_t *src,
+	       uint8_t *dst,
+	       unsigned int width)
+{
+	unsigned int i = 0;
+
+	/* One 32-bit gather per 8 pixels straight from the RGBA table. A
+	 * byte shuffle lookup as on NEON needs 16 sub-tables per channel
+	 * (4.5 instructions per pixel plus the RGBA interleave) and was
+	 * measured 4x slower than the gather on Intel cores */
+	const int *lut = (const int *)self->lut;
+	for (; i + 8 <= width; i += 8) {
+		__m256i idx = _mm256_cvtepu8_epi32(
+			_mm_loadl_epi64((const __m128i *)(src + i)));
+		__m256i rgba = _mm256_i32gather_epi32(lut, idx, 4);
+		_mm256_storeu_si256((__m256i *)(dst + 4 * i), rgba);
+	}
+
+	apply_row_c(self, src, dst, width, i);
+}
+
+#endif /* TMETA_AVX2 */
+
+
+int tmeta_colorizer_new(const struct tmeta_colorizer_config *config,
+			struct tmeta_colorizer **ret_obj)
+{
+	int res;
+	struct tmeta_colorizer *self;
+
+	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(
+		(config->smoothing < 0.f) || (config->smoothing > 1.f),
+		EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((config->range_mode == TMETA_RANGE_MODE_FIXED) &&
+					 (config->fixed_max <= config->fixed_min),
+				 EINVAL);
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		return res;
+	}
+
+	self->range_mode = config->range_mode;
+	self->smoothing = (config->smoothing > 0.f) ? config->smoothing
+						    : DEFAULT_SMOOTHING;
+	self->fixed_min = config->fixed_min;
+	self->fixed_max = config->fixed_max;
+	self->apply_row = apply_row;
+#ifdef TMETA_AVX2
+	if (tmeta_cpu_has_avx2())
+		self->apply_row = apply_row_avx2;
+#endif
+
+	res = tmeta_colorizer_set_palette(
+		self, config->palette, config->user_palette);
+	if (res < 0) {
+		free(self);
+		return res;
+	}
+
+	*ret_obj = self;
+
+	return 0;
+}
+
+
+int tmeta_colorizer_destroy(struct tmeta_colorizer *self)
+{
+	if (self == NULL)
+		return 0;
+
+	free(self);
+
+	return 0;
+}
+
+
+int tmeta_colorizer_reset(struct tmeta_colorizer *self)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+
+	self->range_valid = false;
+
+	return 0;
+}
+
+
+static void update_range(struct tmeta_colorizer *self,
+			 const struct tmeta_data *meta)
+{
+	double frame_min = meta->value_min;
+	double frame_max = meta->value_max;
+	bool frame_valid;
+
+	switch (self->range_mode) {
+	case TMETA_RANGE_MODE_FIXED:
+		self->range_min = self->fixed_min;
+		self->range_max = self->fixed_max;
+		return;
+	case TMETA_RANGE_MODE_SMOOTHED:
+		frame_valid = tmeta_frame_is_valid(meta);
+		if (!self->range_valid) {
+			/* Start from the frame range; only lock it once a
+			 * valid frame has been seen */
+			self->range_min = frame_min;
+			self->range_max = frame_max;
+			self->range_valid = frame_valid;
+		} else if (frame_valid) {
+			self->range_min +=
+				self->smoothing * (frame_min - self->range_min);
+			self->range_max +=
+				self->smoothing * (frame_max - self->range_max);
+		}
+		/* Otherwise the range is locked during the shutter event */
+		return;
+	case TMETA_RANGE_MODE_FRAME:
+	default:
+		self->range_min = frame_min;
+		self->range_max = frame_max;
+		return;
+	}
+}
+
+
+int tmeta_colorizer_update(struct tmeta_colorizer *self,
+			   const struct tmeta_data *meta)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+
+	update_range(self, meta);
+
+	/* Compose the 8-bit to raw rescale with the display range and the
+	 * palette */
+	double span = self->range_max - self->range_min;
+	if (span < 1.)
+		span = 1.;
+	double scale = (TMETA_PALETTE_SIZE - 1) / span;
+	for (unsigned int i = 0; i < TMETA_PALETTE_SIZE; i++) {
+		double idx =
+			(tmeta_u8_to_raw(meta, i) - self->range_min) * scale +
+			0.5;
+		if (idx < 0.)
+			idx = 0.;
+		else if (idx > TMETA_PALETTE_SIZE - 1)
+			idx = TMETA_PALETTE_SIZE - 1;
+		self->lut[i] = self->palette[(unsigned int)idx];
+	}
+
+#ifdef TMETA_COLORIZE_NEON
+	for (unsigned int i = 0; i < TMETA_PALETTE_SIZE; i++) {
+		self->lut_planar[0][i] = self->lut[i].r;
+		self->lut_planar[1][i] = self->lut[i].g;
+		self->lut_planar[2][i] = self->lut[i].b;
+		self->lut_planar[3][i] = self->lut[i].a;
+	}
+#endif
+
+	return 0;
+}
+
+
+int tmeta_colorizer_get_range(struct tmeta_colorizer *self,
+			      double *min,
+			      double *max)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+
+	if (min)
+		*min = self->range_min;
+	if (max)
+		*max = self->range_max;
+
+	return 0;
+}
+
+
+const struct tmeta_color *tmeta_colorizer_get_lut(struct tmeta_colorizer *self)
+{
+	ULOG_ERRNO_RETURN_VAL_IF(self == NULL, EINVAL, NULL);
+
+	return self->lut;
+}
+
+
+int tmeta_colorizer_apply(struct tmeta_colorizer *self,
+			  const uint8_t *src,
+			  size_t src_stride,
+			  uint8_t *dst,
+			  size_t dst_stride,
+			  unsigned int width,
+			  unsigned int height)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(src == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(src_stride < width, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst_stride < (size_t)width * 4, EINVAL);
+
+	for (unsigned int y = 0; y < height; y++) {
+		self->apply_row(self, src, dst, width);
+		src += src_stride;
+		dst += dst_stride;
+	}
+
+	return 0;
+}
+
+
+enum tmeta_palette tmeta_palette_from_str(const char *str)
+{
+	if (strcasecmp(str, "IRON") == 0) {
+		return TMETA_PALETTE_IRON;
+	} else if (strcasecmp(str, "RAINBOW") == 0) {
+		return TMETA_PALETTE_RAINBOW;
+	} else if (strcasecmp(str, "WHITE_HOT") == 0) {
+		return TMETA_PALETTE_WHITE_HOT;
+	} else if (strcasecmp(str, "BLACK_HOT") == 0) {
+		return TMETA_PALETTE_BLACK_HOT;
+	} else if (strcasecmp(str, "USER") == 0) {
+		return TMETA_PALETTE_USER;
+	} else {
+		ULOGW("%s: unknown palette '%s'", __func__, str);
+		return TMETA_PALETTE_IRON;
+	}
+}
+
+
+const char *tmeta_palette_to_str(enum tmeta_palette palette)
+{
+	switch (palette) {
+	case TMETA_PALETTE_IRON:
+		return "IRON";
+	case TMETA_PALETTE_RAINBOW:
+		return "RAINBOW";
+	case TMETA_PALETTE_WHITE_HOT:
+		return "WHITE_HOT";
+	case TMETA_PALETTE_BLACK_HOT:
+		return "BLACK_HOT";
+	case TMETA_PALETTE_USER:
+		return "USER";
+	default:
+		return "UNKNOWN";
+	}
+}
@@ -0,0 +1,468 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tmeta_priv.h"
+
+
+#define DEFAULT_FRAME_RATE 9.
+#define DEFAULT_CAM_ANGLES_RATE 30.
+#define DEFAULT_JPEG_SIZE_MEAN 12000
+#define DEFAULT_JPEG_SIZE_MAX 65536
+#define DEFAULT_SHUTTER_PERIOD 120.
+#define DEFAULT_GAIN_CHANGE_PERIOD 600.
+
+#define JPEG_SIZE_MIN 160
+#define JPEG_SIZE_SIGMA 0.25
+
+/* Shutter cycle durations in seconds */
+#define SHUTTER_DESIRED_DURATION 0.5
+#define SHUTTER_IN_PROGRESS_DURATION 0.3
+
+/* Probability of an unexpected frame state per frame */
+#define UNEXPECTED_STATE_PROBABILITY 1e-4
+
+
+/* Calibration values per gain mode */
+static const struct {
+	double r;
+	double b;
+	double f;
+	double o;
+} gain_calib[] = {
+	[TMETA_THERMAL_GAIN_MODE_FLIR_LOW_GAIN] = {183272., 1428., 1., -171.},
+	[TMETA_THERMAL_GAIN_MODE_FLIR_HIGH_GAIN] = {366545., 1428., 1., -342.},
+};
+
+
+struct tmeta_gen {
+	unsigned int minor_version;
+	double frame_rate;
+	double cam_angles_rate;
+	unsigned int jpeg_size_mean;
+	unsigned int jpeg_size_max;
+	double shutter_period;
+	double gain_change_period;
+
+	/* xoshiro256** state */
+	uint64_t prng[4];
+
+	uint64_t frame_index;
+	struct tmeta_data meta;
+
+	/* Shutter cycle: start time of the next cycle */
+	double shutter_next;
+
+	/* Temperatures in Kelvin */
+	double ambient_temp;
+	double scene_center;
+	double scene_span;
+
+	/* Attitude in radians */
+	double yaw;
+
+	uint8_t *jpeg;
+	uint8_t *sei;
+	size_t sei_capacity;
+};
+
+
+static uint64_t splitmix64(uint64_t *x)
+{
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+
+static uint64_t prng_next(struct tmeta_gen *self)
+{
+	uint64_t *s = self->prng;
+	uint64_t res = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return res;
+}
+
+
+/* Uniform value in [0, 1) */
+static double prng_uniform(struct tmeta_gen *self)
+{
+	return (double)(prng_next(self) >> 11) * 0x1.0p-53;
+}
+
+
+/* Standard normal value (Box-Muller) */
+static double prng_normal(struct tmeta_gen *self)
+{
+	double u1 = 1. - prng_uniform(self);
+	double u2 = prng_uniform(self);
+	return sqrt(-2. * log(u1)) * cos(2. * M_PI * u2);
+}
+
+
+static unsigned int prng_poisson(struct tmeta_gen *self, double lambda)
+{
+	if (lambda > 30.) {
+		/* Normal approximation */
+		double v = round(lambda + sqrt(lambda) * prng_normal(self));
+		return (v > 0.) ? (unsigned int)v : 0;
+	}
+
+	double l = exp(-lambda);
+	double p = 1.;
+	unsigned int k = 0;
+	do {
+		k++;
+		p *= prng_uniform(self);
+	} while (p > l);
+	return k - 1;
+}
+
+
+/* Quaternion (x, y, z, w) from yaw, pitch and roll angles (ZYX) */
+static void euler_to_quat(double yaw, double pitch, double roll, float q[4])
+{
+	double cy = cos(yaw / 2.), sy = sin(yaw / 2.);
+	double cp = cos(pitch / 2.), sp = sin(pitch / 2.);
+	double cr = cos(roll / 2.), sr = sin(roll / 2.);
+
+	q[0] = (float)(sr * cp * cy - cr * sp * sy);
+	q[1] = (float)(cr * sp * cy + sr * cp * sy);
+	q[2] = (float)(cr * cp * sy - sr * sp * cy);
+	q[3] = (float)(cr * cp * cy + sr * sp * sy);
+}
+
+
+static void set_gain_mode(struct tmeta_gen *self,
+			  enum tmeta_thermal_gain_mode gain_mode)
+{
+	self->meta.gain_mode = gain_mode;
+	self->meta.calib_r = gain_calib[gain_mode].r;
+	self->meta.calib_b = gain_calib[gain_mode].b;
+	self->meta.calib_f = gain_calib[gain_mode].f;
+	self->meta.calib_o = gain_calib[gain_mode].o;
+}
+
+
+static uint32_t temp_to_raw(struct tmeta_gen *self, double temp)
+{
+	double raw;
+	int res = tmeta_temperature_to_raw(&self->meta, temp, &raw);
+	if ((res < 0) || !(raw > 0.))
+		return 0;
+	if (raw > UINT16_MAX)
+		return UINT16_MAX;
+	return (uint32_t)round(raw);
+}
+
+
+static void update_frame_state(struct tmeta_gen *self, double t)
+{
+	struct tmeta_data *meta = &self->meta;
+	double dt = t - self->shutter_next;
+
+	if (dt < 0.) {
+		meta->frame_state =
+			(prng_uniform(self) < UNEXPECTED_STATE_PROBABILITY)
+				? TMETA_THERMAL_FRAME_STATE_UNEXPECTED
+				: TMETA_THERMAL_FRAME_STATE_VALID;
+	} else if (dt < SHUTTER_DESIRED_DURATION) {
+		meta->frame_state = TMETA_THERMAL_FRAME_STATE_SHUTTER_DESIRED;
+	} else if (dt < SHUTTER_DESIRED_DURATION +
+				SHUTTER_IN_PROGRESS_DURATION) {
+		meta->frame_state =
+			TMETA_THERMAL_FRAME_STATE_SHUTTER_IN_PROGRESS;
+	} else {
+		/* End of the cycle: the flat field correction slightly
+		 * changes the offset calibration */
+		meta->frame_state = TMETA_THERMAL_FRAME_STATE_VALID;
+		meta->calib_o = gain_calib[meta->gain_mode].o +
+				round(2. * prng_normal(self));
+		self->shutter_next =
+			t + self->shutter_period * (0.75 + 0.5 * prng_uniform(self));
+	}
+}
+
+
+static void generate(struct tmeta_gen *self)
+{
+	struct tmeta_data *meta = &self->meta;
+	double t = (double)self->frame_index / self->frame_rate;
+	double size;
+
+	/* Gain mode changes */
+	if (prng_uniform(self) <
+	    1. / (self->gain_change_period * self->frame_rate)) {
+		set_gain_mode(self,
+			      (meta->gain_mode ==
+			       TMETA_THERMAL_GAIN_MODE_FLIR_HIGH_GAIN)
+				      ? TMETA_THERMAL_GAIN_MODE_FLIR_LOW_GAIN
+				      : TMETA_THERMAL_GAIN_MODE_FLIR_HIGH_GAIN);
+	}
+
+	update_frame_state(self, t);
+
+	/* Temperatures: the camera warms up towards a steady state */
+	self->ambient_temp += 0.002 * prng_normal(self);
+	meta->fpa_temp = self->ambient_temp + 15. - 10. * exp(-t / 600.) +
+			 0.01 * prng_normal(self);
+	meta->housing_temp = meta->fpa_temp - 1.5 + 0.02 * prng_normal(self);
+	meta->window_reflection = meta->housing_temp - 0.5;
+	meta->calib_t_win = meta->housing_temp;
+	meta->calib_t_bg = self->ambient_temp;
+
+	/* Scene range: mean-reverting random walks */
+	self->scene_center += 0.05 * (self->ambient_temp + 5. -
+				      self->scene_center) +
+			      0.1 * prng_normal(self);
+	self->scene_span += 0.02 * (20. - self->scene_span) +
+			    0.2 * prng_normal(self);
+	if (self->scene_span < 2.)
+		self->scene_span = 2.;
+	meta->value_min =
+		temp_to_raw(self, self->scene_center - self->scene_span / 2.);
+	meta->value_max =
+		temp_to_raw(self, self->scene_center + self->scene_span / 2.);
+
+	/* JPEG data size: log-normal, flat images during the shutter
+	 * compress better */
+	size = exp(log((double)self->jpeg_size_mean) -
+		   JPEG_SIZE_SIGMA * JPEG_SIZE_SIGMA / 2. +
+		   JPEG_SIZE_SIGMA * prng_normal(self));
+	if (meta->frame_state == TMETA_THERMAL_FRAME_STATE_SHUTTER_IN_PROGRESS)
+		size *= 0.3;
+	if (size < JPEG_SIZE_MIN)
+		size = JPEG_SIZE_MIN;
+	if (size > self->jpeg_size_max)
+		size = self->jpeg_size_max;
+	meta->jpeg_data_size = (uint32_t)size;
+	meta->jpeg_data = self->jpeg;
+
+	/* Attitude: slow yaw random walk, small pitch and roll
+	 * oscillations (the same as the camera angles, at the frame time) */
+	uint64_t frame_ts = (uint64_t)(t * 1e6) + 1000000;
+	double frame_t = (double)frame_ts * 1e-6;
+	self->yaw += 0.01 * prng_normal(self);
+	euler_to_quat(self->yaw,
+		      0.05 * sin(0.3 * frame_t),
+		      0.03 * sin(0.7 * frame_t),
+		      meta->attitude_reference_quat);
+
+	/* Camera angles sampled up to the frame time */
+	double period_us = 1e6 / self->cam_angles_rate;
+	unsigned int count = prng_poisson(
+		self, self->cam_angles_rate / self->frame_rate);
+	if (count > TMETA_CAMANGLES_MAXCOUNT)
+		count = TMETA_CAMANGLES_MAXCOUNT;
+	meta->cam_angles_count = count;
+	for (unsigned int i = 0; i < count; i++) {
+		double dt = (double)(count - 1 - i) * period_us;
+		double ts = (double)frame_ts - dt;
+		double ti = ts * 1e-6;
+		meta->cam_angles_timestamps[i] = (ts > 0.) ? (uint64_t)ts : 0;
+		euler_to_quat(self->yaw + 0.002 * prng_normal(self),
+			      0.05 * sin(0.3 * ti) + 0.002 * prng_normal(self),
+			      0.03 * sin(0.7 * ti) + 0.002 * prng_normal(self),
+			      meta->cam_angles + i * 4);
+	}
+
+	self->frame_index++;
+}
+
+
+int tmeta_gen_new(const struct tmeta_gen_config *config,
+		  struct tmeta_gen **ret_obj)
+{
+	int res;
+	struct tmeta_gen *self;
+	struct tmeta_data max_meta;
+	uint64_t seed;
+
+	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->minor_version > TMETA_MINOR_VERSION,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->frame_rate < 0., EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->cam_angles_rate < 0., EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->shutter_period < 0., EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->gain_change_period < 0., EINVAL);
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		return res;
+	}
+
+	self->minor_version = (config->minor_version > 0)
+				      ? config->minor_version
+				      : TMETA_MINOR_VERSION;
+	self->frame_rate = (config->frame_rate > 0.) ? config->frame_rate
+						     : DEFAULT_FRAME_RATE;
+	self->cam_angles_rate = (config->cam_angles_rate > 0.)
+					? config->cam_angles_rate
+					: DEFAULT_CAM_ANGLES_RATE;
+	self->jpeg_size_max = (config->jpeg_size_max > 0)
+				      ? config->jpeg_size_max
+				      : DEFAULT_JPEG_SIZE_MAX;
+	if (self->jpeg_size_max < JPEG_SIZE_MIN)
+		self->jpeg_size_max = JPEG_SIZE_MIN;
+	self->jpeg_size_mean = (config->jpeg_size_mean > 0)
+				       ? config->jpeg_size_mean
+				       : DEFAULT_JPEG_SIZE_MEAN;
+	self->shutter_period = (config->shutter_period > 0.)
+				       ? config->shutter_period
+				       : DEFAULT_SHUTTER_PERIOD;
+	self->gain_change_period = (config->gain_change_period > 0.)
+					   ? config->gain_change_period
+					   : DEFAULT_GAIN_CHANGE_PERIOD;
+
+	seed = config->seed;
+	for (unsigned int i = 0; i < 4; i++)
+		self->prng[i] = splitmix64(&seed);
+
+	/* Random JPEG data, starting with a JPEG SOI marker */
+	self->jpeg = malloc(self->jpeg_size_max);
+	if (self->jpeg == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("malloc", -res);
+		goto error;
+	}
+	for (unsigned int i = 0; i < self->jpeg_size_max; i++)
+		self->jpeg[i] = (uint8_t)(prng_next(self) >> 56);
+	self->jpeg[0] = 0xff;
+	self->jpeg[1] = 0xd8;
+
+	memset(&max_meta, 0, sizeof(max_meta));
+	max_meta.cam_angles_count = TMETA_CAMANGLES_MAXCOUNT;
+	max_meta.jpeg_data_size = self->jpeg_size_max;
+	self->sei_capacity = TMETA_BUF_SIZE(&max_meta);
+	self->sei = malloc(self->sei_capacity);
+	if (self->sei == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("malloc", -res);
+		goto error;
+	}
+
+	/* Initial state */
+	self->meta.version =
+		TMETA_MAJOR_VERSION << 16 | (self->minor_version & 0xFFFF);
+	set_gain_mode(self, TMETA_THERMAL_GAIN_MODE_FLIR_HIGH_GAIN);
+	self->meta.calib_emissivity = 0.95;
+	self->meta.calib_tau_win = 0.94;
+	self->ambient_temp = 288. + 15. * prng_uniform(self);
+	self->scene_center = self->ambient_temp + 5.;
+	self->scene_span = 20.;
+	self->yaw = 2. * M_PI * prng_uniform(self);
+	self->shutter_next = self->shutter_period * prng_uniform(self);
+	euler_to_quat(0.002 * prng_normal(self),
+		      0.002 * prng_normal(self),
+		      0.002 * prng_normal(self),
+		      self->meta.thermal_to_visible_quat);
+
+	*ret_obj = self;
+
+	return 0;
+
+error:
+	tmeta_gen_destroy(self);
+	return res;
+}
+
+
+int tmeta_gen_destroy(struct tmeta_gen *self)
+{
+	if (self == NULL)
+		return 0;
+
+	free(self->jpeg);
+	free(self->sei);
+	free(self);
+
+	return 0;
+}
+
+
+int tmeta_gen_next(struct tmeta_gen *self,
+		   struct tmeta_data *meta,
+		   const void **sei,
+		   size_t *sei_size)
+{
+	int res;
+	size_t size;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+
+	generate(self);
+
+	*meta = self->meta;
+
+	/* Fields that do not exist in the generated version */
+	if (self->minor_version < 2)
+		meta->frame_state = TMETA_THERMAL_FRAME_STATE_VALID;
+	if (self->minor_version < 3) {
+		meta->fpa_temp = 0.;
+		meta->housing_temp = 0.;
+		meta->window_reflection = 0.;
+	}
+	if (self->minor_version < 4)
+		memset(meta->thermal_to_visible_quat,
+		       0,
+		       sizeof(meta->thermal_to_visible_quat));
+
+	if ((sei == NULL) && (sei_size == NULL))
+		return 0;
+
+	res = tmeta_serialize_thermal_metadata_user_data_sei_minor(
+		meta, self->minor_version, self->sei, self->sei_capacity, &size);
+	if (res < 0) {
+		ULOG_ERRNO("tmeta_serialize_thermal_metadata_user_data_sei_minor",
+			   -res);
+		return res;
+	}
+
+	if (sei != NULL)
+		*sei = self->sei;
+	if (sei_size != NULL)
+		*sei_size = size;
+
+	return 0;
+}
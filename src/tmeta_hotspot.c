@@ -0,0 +1,922 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tmeta_priv.h"
+
+#include <pthread.h>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#	include <arm_neon.h>
+#	define TMETA_HOTSPOT_NEON
+#endif
+
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_TILE_HEIGHT 32
+#define INITIAL_REGION_CAPACITY 64
+
+/* 8-bit threshold that no pixel value can reach */
+#define THRESHOLD_NONE 256
+
+
+/* Horizontal run of pixels at or above the threshold */
+struct run {
+	/* First column and last column + 1 */
+	uint16_t x0;
+	uint16_t x1;
+
+	/* Peak value and column (first peak pixel of the run) */
+	uint16_t peak_x;
+	uint8_t peak;
+};
+
+
+/* Region statistics */
+struct region {
+	uint32_t area;
+	uint16_t x_min;
+	uint16_t x_max;
+	uint32_t y_min;
+	uint32_t y_max;
+	uint64_t sum_x;
+	uint64_t sum_y;
+	uint32_t peak_y;
+	uint16_t peak_x;
+	uint8_t peak;
+};
+
+
+/* Tile of rows, labeled independently of the other tiles */
+struct tile {
+	unsigned int y0;
+	unsigned int rows;
+
+	/* Runs of the tile: the run, parent and label arrays of the detector
+	 * are shared by the tiles, each tile uses the entries from run_base;
+	 * the parent and label values are relative to run_base */
+	uint32_t run_base;
+	uint32_t run_count;
+
+	/* Index of the first run of each row (rows + 1 entries) */
+	uint32_t *row_start;
+
+	/* Regions of the tile */
+	struct region *regions;
+	uint32_t region_count;
+	uint32_t region_capacity;
+
+	/* Thresholded row, 1 bit per pixel */
+	uint64_t *mask;
+
+	int err;
+};
+
+
+typedef void (*threshold_row_fn_t)(const uint8_t *src,
+				   unsigned int width,
+				   uint8_t threshold,
+				   uint64_t *mask);
+
+
+/* The frame is split in tiles of full rows; each tile is labeled by a
+ * worker thread (or by the calling thread) using run-based union-find:
+ * the thresholded rows are converted to runs, which are united with the
+ * overlapping runs of the previous row, then the regions statistics are
+ * accumulated on the root runs. The regions crossing the tile boundaries
+ * are merged afterwards with a second union-find on the tiles regions,
+ * using the runs of the last row of a tile and of the first row of the
+ * next tile. In both union-finds the root is the element with the
+ * smallest index, i.e. the first one in raster order. */
+struct tmeta_hotspot {
+	unsigned int width;
+	unsigned int height;
+	unsigned int min_area;
+	bool connectivity_8;
+	unsigned int words;
+
+	/* Row threshold function, selected at creation */
+	threshold_row_fn_t threshold_row;
+
+	struct tile *tiles;
+	unsigned int tile_count;
+
+	struct run *runs;
+	uint32_t *parent;
+	uint32_t *label;
+
+	/* Merged regions */
+	struct region *regions;
+	uint32_t *region_parent;
+	uint32_t region_capacity;
+
+	/* Current frame */
+	const uint8_t *frame;
+	size_t stride;
+	uint8_t threshold;
+	unsigned int next_tile;
+	unsigned int pending_tiles;
+
+	/* Worker threads (the calling thread also labels tiles) */
+	pthread_t *threads;
+	unsigned int thread_count;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_cond_t done_cond;
+	bool sync_initialized;
+	unsigned int generation;
+	bool stop;
+};
+
+
+static inline uint32_t uf_find(uint32_t *parent, uint32_t i)
+{
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+
+static inline void uf_union(uint32_t *parent, uint32_t a, uint32_t b)
+{
+	a = uf_find(parent, a);
+	b = uf_find(parent, b);
+	if (a < b)
+		parent[b] = a;
+	else if (b < a)
+		parent[a] = b;
+}
+
+
+/* Threshold the row pixels from x (multiple of 64) to a bit mask; the
+ * bits past the width are cleared */
+static void threshold_row_c(const uint8_t *src,
+			    unsigned int width,
+			    uint8_t threshold,
+			    uint64_t *mask,
+			    unsigned int x)
+{
+	unsigned int words = (width + 63) / 64;
+
+	for (unsigned int w = x / 64; w < words; w++) {
+		unsigned int end = (w * 64 + 64 < width) ? w * 64 + 64 : width;
+		uint64_t m = 0;
+		for (unsigned int i = w * 64; i < end; i++)
+			m |= (uint64_t)(src[i] >= threshold) << (i - w * 64);
+		mask[w] = m;
+	}
+}
+
+
+/* Threshold a row to a bit mask (pixel >= threshold) */
+static void threshold_row(const uint8_t *src,
+			  unsigned int width,
+			  uint8_t threshold,
+			  uint64_t *mask)
+{
+	unsigned int x = 0;
+
+#if defined(TMETA_HOTSPOT_NEON)
+	static const uint8_t bits[16] = {
+		1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+	const uint8x16_t vthr = vdupq_n_u8(threshold);
+	const uint8x16_t vbits = vld1q_u8(bits);
+	for (; x + 64 <= width; x += 64) {
+		uint64_t m = 0;
+		for (unsigned int k = 0; k < 4; k++) {
+			uint8x16_t c = vandq_u8(
+				vcgeq_u8(vld1q_u8(src + x + 16 * k), vthr),
+				vbits);
+			uint64_t m16 = vaddv_u8(vget_low_u8(c)) |
+				       ((uint64_t)vaddv_u8(vget_high_u8(c))
+					<< 8);
+			m |= m16 << (16 * k);
+		}
+		mask[x / 64] = m;
+	}
+#endif
+
+	threshold_row_c(src, width, threshold, mask, x);
+}
+
+
+#ifdef TMETA_AVX2
+
+TMETA_TARGET_AVX2 static void threshold_row_avx2(const uint8_t *src,
+						 unsigned int width,
+						 uint8_t threshold,
+						 uint64_t *mask)
+{
+	unsigned int x = 0;
+	const __m256i vthr = _mm256_set1_epi8((char)threshold);
+
+	for (; x + 64 <= width; x += 64) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(src + x));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + x + 32));
+		/* v >= threshold <=> max(v, threshold) == v */
+		uint32_t ma = (uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_max_epu8(a, vthr), a));
+		uint32_t mb = (uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_max_epu8(b, vthr), b));
+		mask[x / 64] = (uint64_t)mb << 32 | ma;
+	}
+
+	threshold_row_c(src, width, threshold, mask, x);
+}
+
+#endif /* TMETA_AVX2 */
+
+
+/* Add a run and unite it with the overlapping runs of the previous row
+ * (prev is the first candidate run of the previous row, updated) */
+static inline void add_run(struct tmeta_hotspot *self,
+			   struct tile *tile,
+			   const uint8_t *src,
+			   unsigned int x0,
+			   unsigned int x1,
+			   uint32_t *prev,
+			   uint32_t prev_end)
+{
+	struct run *runs = self->runs + tile->run_base;
+	uint32_t *parent = self->parent + tile->run_base;
+	uint32_t n = tile->run_count++;
+	unsigned int c = self->connectivity_8 ? 1 : 0;
+	struct run *run = &runs[n];
+	uint8_t peak = src[x0];
+	unsigned int peak_x = x0;
+
+	for (unsigned int x = x0 + 1; x < x1; x++) {
+		if (src[x] > peak) {
+			peak = src[x];
+			peak_x = x;
+		}
+	}
+	run->x0 = x0;
+	run->x1 = x1;
+	run->peak = peak;
+	run->peak_x = peak_x;
+	parent[n] = n;
+
+	while ((*prev < prev_end) && (runs[*prev].x1 + c <= x0))
+		(*prev)++;
+	for (uint32_t k = *prev; (k < prev_end) && (runs[k].x0 < x1 + c); k++)
+		uf_union(parent, k, n);
+}
+
+
+static inline void
+region_add_run(struct region *reg, const struct run *run, unsigned int y)
+{
+	uint32_t len = run->x1 - run->x0;
+
+	reg->area += len;
+	reg->sum_x += (uint64_t)(run->x0 + run->x1 - 1) * len / 2;
+	reg->sum_y += (uint64_t)y * len;
+	if (run->x0 < reg->x_min)
+		reg->x_min = run->x0;
+	if (run->x1 - 1 > reg->x_max)
+		reg->x_max = run->x1 - 1;
+	reg->y_max = y;
+	if (run->peak > reg->peak) {
+		reg->peak = run->peak;
+		reg->peak_x = run->peak_x;
+		reg->peak_y = y;
+	}
+}
+
+
+static inline void region_init(struct region *reg,
+			       const struct run *run,
+			       unsigned int y)
+{
+	memset(reg, 0, sizeof(*reg));
+	reg->x_min = run->x0;
+	reg->x_max = run->x1 - 1;
+	reg->y_min = y;
+	reg->peak = run->peak;
+	reg->peak_x = run->peak_x;
+	reg->peak_y = y;
+	region_add_run(reg, run, y);
+}
+
+
+static void region_merge(struct region *dst, const struct region *src)
+{
+	dst->area += src->area;
+	dst->sum_x += src->sum_x;
+	dst->sum_y += src->sum_y;
+	if (src->x_min < dst->x_min)
+		dst->x_min = src->x_min;
+	if (src->x_max > dst->x_max)
+		dst->x_max = src->x_max;
+	if (src->y_min < dst->y_min)
+		dst->y_min = src->y_min;
+	if (src->y_max > dst->y_max)
+		dst->y_max = src->y_max;
+	if ((src->peak > dst->peak) ||
+	    ((src->peak == dst->peak) &&
+	     ((src->peak_y < dst->peak_y) ||
+	      ((src->peak_y == dst->peak_y) && (src->peak_x < dst->peak_x))))) {
+		dst->peak = src->peak;
+		dst->peak_x = src->peak_x;
+		dst->peak_y = src->peak_y;
+	}
+}
+
+
+static void label_tile(struct tmeta_hotspot *self, struct tile *tile)
+{
+	struct run *runs = self->runs + tile->run_base;
+	uint32_t *parent = self->parent + tile->run_base;
+	uint32_t *label = self->label + tile->run_base;
+	uint32_t prev_start = 0, prev_end = 0;
+
+	tile->run_count = 0;
+	tile->region_count = 0;
+	tile->err = 0;
+
+	for (unsigned int r = 0; r < tile->rows; r++) {
+		const uint8_t *src =
+			self->frame + (size_t)(tile->y0 + r) * self->stride;
+		uint32_t prev = prev_start;
+		uint64_t carry = 0;
+		unsigned int x0 = 0;
+
+		tile->row_start[r] = tile->run_count;
+		self->threshold_row(
+			src, self->width, self->threshold, tile->mask);
+
+		/* Runs start and end on the bit transitions */
+		for (unsigned int w = 0; w < self->words; w++) {
+			uint64_t m = tile->mask[w];
+			uint64_t t = m ^ ((m << 1) | carry);
+			carry = m >> 63;
+			while (t != 0) {
+				unsigned int b = __builtin_ctzll(t);
+				t &= t - 1;
+				if ((m >> b) & 1) {
+					x0 = w * 64 + b;
+					continue;
+				}
+				add_run(self,
+					tile,
+					src,
+					x0,
+					w * 64 + b,
+					&prev,
+					prev_end);
+			}
+		}
+		if (carry) {
+			add_run(self,
+				tile,
+				src,
+				x0,
+				self->width,
+				&prev,
+				prev_end);
+		}
+
+		prev_start = tile->row_start[r];
+		prev_end = tile->run_count;
+	}
+	tile->row_start[tile->rows] = tile->run_count;
+
+	/* Accumulate the regions statistics; a root run is the first run of
+	 * its region, so the region is created before the other runs are
+	 * added */
+	for (unsigned int r = 0; r < tile->rows; r++) {
+		unsigned int y = tile->y0 + r;
+		for (uint32_t i = tile->row_start[r]; i < tile->row_start[r + 1];
+		     i++) {
+			uint32_t root = uf_find(parent, i);
+			if (root != i) {
+				label[i] = label[root];
+				region_add_run(
+					&tile->regions[label[i]], &runs[i], y);
+				continue;
+			}
+			if (tile->region_count == tile->region_capacity) {
+				uint32_t capacity = 2 * tile->region_capacity;
+				struct region *regions = realloc(
+					tile->regions,
+					capacity * sizeof(*regions));
+				if (regions == NULL) {
+					tile->err = -ENOMEM;
+					return;
+				}
+				tile->regions = regions;
+				tile->region_capacity = capacity;
+			}
+			label[i] = tile->region_count++;
+			region_init(&tile->regions[label[i]], &runs[i], y);
+		}
+	}
+}
+
+
+static void process_tiles(struct tmeta_hotspot *self)
+{
+	unsigned int t;
+
+	while ((t = __atomic_fetch_add(&self->next_tile, 1, __ATOMIC_ACQUIRE)) <
+	       self->tile_count) {
+		label_tile(self, &self->tiles[t]);
+		if (__atomic_sub_fetch(
+			    &self->pending_tiles, 1, __ATOMIC_ACQ_REL) == 0) {
+			pthread_mutex_lock(&self->mutex);
+			pthread_cond_signal(&self->done_cond);
+			pthread_mutex_unlock(&self->mutex);
+		}
+	}
+}
+
+
+static void *worker_thread(void *userdata)
+{
+	struct tmeta_hotspot *self = userdata;
+	unsigned int generation = 0;
+
+	pthread_mutex_lock(&self->mutex);
+	while (true) {
+		while (!self->stop && (self->generation == generation))
+			pthread_cond_wait(&self->cond, &self->mutex);
+		if (self->stop)
+			break;
+		generation = self->generation;
+		pthread_mutex_unlock(&self->mutex);
+		process_tiles(self);
+		pthread_mutex_lock(&self->mutex);
+	}
+	pthread_mutex_unlock(&self->mutex);
+
+	return NULL;
+}
+
+
+static int label_tiles(struct tmeta_hotspot *self)
+{
+	if (self->thread_count == 0) {
+		for (unsigned int t = 0; t < self->tile_count; t++)
+			label_tile(self, &self->tiles[t]);
+	} else {
+		/* A worker may still be leaving the previous frame: the
+		 * pending count must be set before the tiles are released */
+		__atomic_store_n(
+			&self->pending_tiles, self->tile_count, __ATOMIC_RELAXED);
+		__atomic_store_n(&self->next_tile, 0, __ATOMIC_RELEASE);
+		pthread_mutex_lock(&self->mutex);
+		self->generation++;
+		pthread_cond_broadcast(&self->cond);
+		pthread_mutex_unlock(&self->mutex);
+
+		process_tiles(self);
+
+		pthread_mutex_lock(&self->mutex);
+		while (__atomic_load_n(&self->pending_tiles, __ATOMIC_ACQUIRE) >
+		       0)
+			pthread_cond_wait(&self->done_cond, &self->mutex);
+		pthread_mutex_unlock(&self->mutex);
+	}
+
+	for (unsigned int t = 0; t < self->tile_count; t++) {
+		if (self->tiles[t].err < 0) {
+			ULOG_ERRNO("realloc", -self->tiles[t].err);
+			return self->tiles[t].err;
+		}
+	}
+
+	return 0;
+}
+
+
+/* Unite the regions crossing the boundary between two tiles */
+static void merge_boundary(struct tmeta_hotspot *self,
+			   const struct tile *a,
+			   uint32_t a_offset,
+			   const struct tile *b,
+			   uint32_t b_offset)
+{
+	const struct run *a_runs = self->runs + a->run_base;
+	const struct run *b_runs = self->runs + b->run_base;
+	const uint32_t *a_label = self->label + a->run_base;
+	const uint32_t *b_label = self->label + b->run_base;
+	uint32_t prev = a->row_start[a->rows - 1];
+	uint32_t prev_end = a->run_count;
+	unsigned int c = self->connectivity_8 ? 1 : 0;
+
+	for (uint32_t i = 0; i < b->row_start[1]; i++) {
+		while ((prev < prev_end) && (a_runs[prev].x1 + c <= b_runs[i].x0))
+			prev++;
+		for (uint32_t k = prev;
+		     (k < prev_end) && (a_runs[k].x0 < b_runs[i].x1 + c);
+		     k++) {
+			uf_union(self->region_parent,
+				 a_offset + a_label[k],
+				 b_offset + b_label[i]);
+		}
+	}
+}
+
+
+static int region_cmp(const void *a, const void *b)
+{
+	const struct region *ra = a;
+	const struct region *rb = b;
+
+	if (ra->peak != rb->peak)
+		return (ra->peak > rb->peak) ? -1 : 1;
+	if (ra->area != rb->area)
+		return (ra->area > rb->area) ? -1 : 1;
+	if (ra->peak_y != rb->peak_y)
+		return (ra->peak_y < rb->peak_y) ? -1 : 1;
+	return (ra->peak_x < rb->peak_x) ? -1 : (ra->peak_x > rb->peak_x);
+}
+
+
+/* Merge the tiles regions; the resulting regions are sorted at the
+ * beginning of the regions array */
+static int merge_tiles(struct tmeta_hotspot *self, uint32_t *count)
+{
+	uint32_t total = 0, offset = 0, n = 0;
+
+	for (unsigned int t = 0; t < self->tile_count; t++)
+		total += self->tiles[t].region_count;
+
+	if (total > self->region_capacity) {
+		uint32_t capacity = self->region_capacity;
+		while (capacity < total)
+			capacity *= 2;
+		struct region *regions =
+			realloc(self->regions, capacity * sizeof(*regions));
+		if (regions == NULL)
+			goto nomem;
+		self->regions = regions;
+		uint32_t *region_parent = realloc(
+			self->region_parent, capacity * sizeof(*region_parent));
+		if (region_parent == NULL)
+			goto nomem;
+		self->region_parent = region_parent;
+		self->region_capacity = capacity;
+	}
+
+	for (unsigned int t = 0; t < self->tile_count; t++) {
+		const struct tile *tile = &self->tiles[t];
+		memcpy(&self->regions[offset],
+		       tile->regions,
+		       tile->region_count * sizeof(*tile->regions));
+		for (uint32_t i = 0; i < tile->region_count; i++)
+			self->region_parent[offset + i] = offset + i;
+		if ((t > 0) && (tile->region_count > 0) &&
+		    (self->tiles[t - 1].region_count > 0)) {
+			merge_boundary(self,
+				       &self->tiles[t - 1],
+				       offset - self->tiles[t - 1].region_count,
+				       tile,
+				       offset);
+		}
+		offset += tile->region_count;
+	}
+
+	/* The root is the region with the smallest index: the merged
+	 * regions are only added to regions that are already complete */
+	for (uint32_t i = 0; i < total; i++) {
+		uint32_t root = uf_find(self->region_parent, i);
+		if (root != i)
+			region_merge(&self->regions[root], &self->regions[i]);
+	}
+	for (uint32_t i = 0; i < total; i++) {
+		if ((self->region_parent[i] != i) ||
+		    (self->regions[i].area < self->min_area))
+			continue;
+		self->regions[n++] = self->regions[i];
+	}
+
+	qsort(self->regions, n, sizeof(*self->regions), region_cmp);
+	*count = n;
+
+	return 0;
+
+nomem:
+	ULOG_ERRNO("realloc", ENOMEM);
+	return -ENOMEM;
+}
+
+
+int tmeta_hotspot_get_threshold(const struct tmeta_data *meta,
+				double temp,
+				unsigned int *value)
+{
+	int res;
+	double raw, x;
+	unsigned int v;
+
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(value == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!(temp > 0.), EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta->value_max < meta->value_min, EINVAL);
+
+	res = tmeta_temperature_to_raw(meta, temp, &raw);
+	if (res == -EDOM) {
+		/* Above the asymptote of the calibration curve */
+		*value = THRESHOLD_NONE;
+		return 0;
+	} else if (res < 0) {
+		return res;
+	}
+
+	if (meta->value_max == meta->value_min) {
+		*value = (tmeta_u8_to_raw(meta, 0) >= raw) ? 0 : THRESHOLD_NONE;
+		return 0;
+	}
+
+	/* Smallest 8-bit value whose raw value is at or above the threshold;
+	 * the closed form result is adjusted for rounding errors */
+	x = ceil((raw - (double)meta->value_min) * 255. /
+		 ((double)meta->value_max - (double)meta->value_min));
+	if (!(x > 0.))
+		v = 0;
+	else if (x > THRESHOLD_NONE)
+		v = THRESHOLD_NONE;
+	else
+		v = (unsigned int)x;
+	while ((v > 0) && (tmeta_u8_to_raw(meta, v - 1) >= raw))
+		v--;
+	while ((v < THRESHOLD_NONE) && (tmeta_u8_to_raw(meta, v) < raw))
+		v++;
+
+	*value = v;
+	return 0;
+}
+
+
+int tmeta_hotspot_new(const struct tmeta_hotspot_config *config,
+		      struct tmeta_hotspot **ret_obj)
+{
+	int res;
+	struct tmeta_hotspot *self;
+	unsigned int threads, tile_height;
+	uint32_t runs_per_row;
+
+	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->width == 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->width > UINT16_MAX, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->height == 0, EINVAL);
+
+	/* At most one run every other pixel */
+	runs_per_row = (config->width + 1) / 2;
+	if (config->height > UINT32_MAX / runs_per_row) {
+		ULOGE("%s: frame too large", __func__);
+		return -EINVAL;
+	}
+
+	threads = (config->threads > 0) ? config->threads : DEFAULT_THREADS;
+	tile_height = (config->tile_height > 0) ? config->tile_height
+						: DEFAULT_TILE_HEIGHT;
+	if (tile_height > config->height)
+		tile_height = config->height;
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		return res;
+	}
+
+	self->width = config->width;
+	self->height = config->height;
+	self->min_area = config->min_area;
+	self->connectivity_8 = config->connectivity_8;
+	self->words = (config->width + 63) / 64;
+	self->threshold_row = threshold_row;
+#ifdef TMETA_AVX2
+	if (tmeta_cpu_has_avx2())
+		self->threshold_row = threshold_row_avx2;
+#endif
+	self->tile_count = (config->height + tile_height - 1) / tile_height;
+	if (threads > self->tile_count)
+		threads = self->tile_count;
+
+	self->tiles = calloc(self->tile_count, sizeof(*self->tiles));
+	self->runs = calloc((size_t)config->height * runs_per_row,
+			    sizeof(*self->runs));
+	self->parent = calloc((size_t)config->height * runs_per_row,
+			      sizeof(*self->parent));
+	self->label = calloc((size_t)config->height * runs_per_row,
+			     sizeof(*self->label));
+	self->region_capacity = INITIAL_REGION_CAPACITY;
+	self->regions =
+		calloc(self->region_capacity, sizeof(*self->regions));
+	self->region_parent =
+		calloc(self->region_capacity, sizeof(*self->region_parent));
+	if ((self->tiles == NULL) || (self->runs == NULL) ||
+	    (self->parent == NULL) || (self->label == NULL) ||
+	    (self->regions == NULL) || (self->region_parent == NULL)) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		goto error;
+	}
+
+	for (unsigned int t = 0; t < self->tile_count; t++) {
+		struct tile *tile = &self->tiles[t];
+		tile->y0 = t * tile_height;
+		tile->rows = (tile->y0 + tile_height <= config->height)
+				     ? tile_height
+				     : config->height - tile->y0;
+		tile->run_base = tile->y0 * runs_per_row;
+		tile->row_start =
+			calloc(tile->rows + 1, sizeof(*tile->row_start));
+		tile->region_capacity = INITIAL_REGION_CAPACITY;
+		tile->regions =
+			calloc(tile->region_capacity, sizeof(*tile->regions));
+		tile->mask = calloc(self->words, sizeof(*tile->mask));
+		if ((tile->row_start == NULL) || (tile->regions == NULL) ||
+		    (tile->mask == NULL)) {
+			res = -ENOMEM;
+			ULOG_ERRNO("calloc", -res);
+			goto error;
+		}
+	}
+
+	if (threads > 1) {
+		res = pthread_mutex_init(&self->mutex, NULL);
+		if (res != 0) {
+			res = -res;
+			ULOG_ERRNO("pthread_mutex_init", -res);
+			goto error;
+		}
+		res = pthread_cond_init(&self->cond, NULL);
+		if (res != 0) {
+			res = -res;
+			ULOG_ERRNO("pthread_cond_init", -res);
+			pthread_mutex_destroy(&self->mutex);
+			goto error;
+		}
+		res = pthread_cond_init(&self->done_cond, NULL);
+		if (res != 0) {
+			res = -res;
+			ULOG_ERRNO("pthread_cond_init", -res);
+			pthread_cond_destroy(&self->cond);
+			pthread_mutex_destroy(&self->mutex);
+			goto error;
+		}
+		self->sync_initialized = true;
+
+		self->threads = calloc(threads - 1, sizeof(*self->threads));
+		if (self->threads == NULL) {
+			res = -ENOMEM;
+			ULOG_ERRNO("calloc", -res);
+			goto error;
+		}
+		for (unsigned int i = 0; i < threads - 1; i++) {
+			res = pthread_create(
+				&self->threads[i], NULL, worker_thread, self);
+			if (res != 0) {
+				res = -res;
+				ULOG_ERRNO("pthread_create", -res);
+				goto error;
+			}
+			self->thread_count++;
+		}
+	}
+
+	*ret_obj = self;
+
+	return 0;
+
+error:
+	tmeta_hotspot_destroy(self);
+	return res;
+}
+
+
+int tmeta_hotspot_destroy(struct tmeta_hotspot *self)
+{
+	if (self == NULL)
+		return 0;
+
+	if (self->sync_initialized) {
+		pthread_mutex_lock(&self->mutex);
+		self->stop = true;
+		pthread_cond_broadcast(&self->cond);
+		pthread_mutex_unlock(&self->mutex);
+		for (unsigned int i = 0; i < self->thread_count; i++)
+			pthread_join(self->threads[i], NULL);
+		pthread_cond_destroy(&self->done_cond);
+		pthread_cond_destroy(&self->cond);
+		pthread_mutex_destroy(&self->mutex);
+	}
+	free(self->threads);
+
+	if (self->tiles != NULL) {
+		for (unsigned int t = 0; t < self->tile_count; t++) {
+			free(self->tiles[t].row_start);
+			free(self->tiles[t].regions);
+			free(self->tiles[t].mask);
+		}
+	}
+	free(self->tiles);
+	free(self->runs);
+	free(self->parent);
+	free(self->label);
+	free(self->regions);
+	free(self->region_parent);
+	free(self);
+
+	return 0;
+}
+
+
+int tmeta_hotspot_detect(struct tmeta_hotspot *self,
+			 const uint8_t *frame,
+			 size_t stride,
+			 const struct tmeta_data *meta,
+			 double threshold,
+			 struct tmeta_hotspot_region *regions,
+			 unsigned int max_regions,
+			 unsigned int *region_count)
+{
+	int res;
+	unsigned int value;
+	uint32_t count;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(frame == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(stride < self->width, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((regions == NULL) && (max_regions > 0),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(region_count == NULL, EINVAL);
+
+	if (!tmeta_frame_is_valid(meta))
+		return -EAGAIN;
+
+	res = tmeta_hotspot_get_threshold(meta, threshold, &value);
+	if (res < 0)
+		return res;
+	if (value == THRESHOLD_NONE) {
+		*region_count = 0;
+		return 0;
+	}
+
+	self->frame = frame;
+	self->stride = stride;
+	self->threshold = (uint8_t)value;
+
+	res = label_tiles(self);
+	if (res < 0)
+		return res;
+
+	res = merge_tiles(self, &count);
+	if (res < 0)
+		return res;
+
+	for (uint32_t i = 0; (i < count) && (i < max_regions); i++) {
+		const struct region *reg = &self->regions[i];
+		struct tmeta_hotspot_region *out = &regions[i];
+		double temp;
+
+		out->area = reg->area;
+		out->x_min = reg->x_min;
+		out->y_min = reg->y_min;
+		out->x_max = reg->x_max;
+		out->y_max = reg->y_max;
+		out->centroid_x = (double)reg->sum_x / reg->area;
+		out->centroid_y = (double)reg->sum_y / reg->area;
+		out->peak_value = reg->peak;
+		out->peak_x = reg->peak_x;
+		out->peak_y = reg->peak_y;
+		res = tmeta_raw_to_temperature(
+			meta, tmeta_u8_to_raw(meta, reg->peak), &temp);
+		out->peak_temp = (res == 0) ? temp : NAN;
+	}
+
+	*region_count = count;
+
+	return 0;
+}
@@ -0,0 +1,774 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GNU_SOURCE
+#	define _GNU_SOURCE /* strtod_l() */
+#endif
+
+#include <locale.h>
+#ifdef __APPLE__
+#	include <xlocale.h>
+#endif
+
+#include "tmeta_priv.h"
+
+
+/* Allocation-free parser for the JSON format written by
+ * tmeta_thermal_metadata_to_json(). Keys are dispatched with a switch on
+ * their length; numbers are parsed in a single pass, using an exact fast
+ * path for short decimal numbers and strtod_l() with the "C" locale
+ * otherwise, so that doubles written with 17 significant digits are read
+ * back exactly whatever the locale of the process. */
+
+
+/* Maximum nesting depth of skipped values */
+#define MAX_DEPTH 32
+
+/* Maximum length of a number token */
+#define MAX_NUMBER_LEN 64
+
+/* Maximum length of an enum string value */
+#define MAX_ENUM_LEN 32
+
+
+enum field {
+	FIELD_UNKNOWN = 0,
+	FIELD_VERSION_MAJOR,
+	FIELD_VERSION_MINOR,
+	FIELD_GAIN_MODE,
+	FIELD_CALIB_R,
+	FIELD_CALIB_B,
+	FIELD_CALIB_F,
+	FIELD_CALIB_O,
+	FIELD_CALIB_TAU_WIN,
+	FIELD_CALIB_T_WIN,
+	FIELD_CALIB_T_BG,
+	FIELD_CALIB_EMISSIVITY,
+	FIELD_JPEG_DATA_SIZE,
+	FIELD_VALUE_MIN,
+	FIELD_VALUE_MAX,
+	FIELD_ATTITUDE_REFERENCE_QUAT,
+	FIELD_CAM_ANGLES,
+	FIELD_CAM_ANGLES_TIMESTAMPS,
+	FIELD_FRAME_STATE,
+	FIELD_FPA_TEMP,
+	FIELD_HOUSING_TEMP,
+	FIELD_WINDOW_REFLECTION,
+	FIELD_THERMAL_TO_VISIBLE_QUAT,
+};
+
+
+struct parser {
+	const char *p;
+	const char *end;
+};
+
+
+/* Exact powers of 10 as doubles */
+static const double pow10_tab[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+	1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+	1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+
+#ifdef _WIN32
+typedef _locale_t c_locale_t;
+#	define c_locale_new() _create_locale(LC_NUMERIC, "C")
+#	define c_locale_free(_loc) _free_locale(_loc)
+#	define c_locale_strtod(_str, _loc) _strtod_l((_str), NULL, (_loc))
+#else
+typedef locale_t c_locale_t;
+#	define c_locale_new() newlocale(LC_NUMERIC_MASK, "C", (locale_t)0)
+#	define c_locale_free(_loc) freelocale(_loc)
+#	define c_locale_strtod(_str, _loc) strtod_l((_str), NULL, (_loc))
+#endif
+
+
+/* "C" locale for strtod_l(), created on first use and never freed */
+static c_locale_t c_locale;
+
+
+static double strtod_c(const char *str)
+{
+	c_locale_t loc = __atomic_load_n(&c_locale, __ATOMIC_ACQUIRE);
+
+	if (loc == (c_locale_t)0) {
+		c_locale_t expected = (c_locale_t)0;
+		loc = c_locale_new();
+		if (loc == (c_locale_t)0) {
+			/* Should not happen: fall back to the process
+			 * locale */
+			ULOG_ERRNO("newlocale", errno);
+			return strtod(str, NULL);
+		}
+		if (!__atomic_compare_exchange_n(&c_locale,
+						 &expected,
+						 loc,
+						 false,
+						 __ATOMIC_ACQ_REL,
+						 __ATOMIC_ACQUIRE)) {
+			/* Created concurrently by another thread */
+			c_locale_free(loc);
+			loc = expected;
+		}
+	}
+
+	return c_locale_strtod(str, loc);
+}
+
+
+#define KEY_IS(_key, _len, _str)                                               \
+	(((_len) == sizeof(_str) - 1) && (memcmp((_key), (_str), (_len)) == 0))
+
+
+static enum field lookup_key(const char *key, size_t len)
+{
+	switch (len) {
+	case 7:
+		if (memcmp(key, "calib_", 6) != 0)
+			break;
+		switch (key[6]) {
+		case 'r':
+			return FIELD_CALIB_R;
+		case 'b':
+			return FIELD_CALIB_B;
+		case 'f':
+			return FIELD_CALIB_F;
+		case 'o':
+			return FIELD_CALIB_O;
+		default:
+			break;
+		}
+		break;
+	case 8:
+		if (KEY_IS(key, len, "fpa_temp"))
+			return FIELD_FPA_TEMP;
+		break;
+	case 9:
+		if (KEY_IS(key, len, "gain_mode"))
+			return FIELD_GAIN_MODE;
+		else if (KEY_IS(key, len, "value_min"))
+			return FIELD_VALUE_MIN;
+		else if (KEY_IS(key, len, "value_max"))
+			return FIELD_VALUE_MAX;
+		break;
+	case 10:
+		if (KEY_IS(key, len, "calib_t_bg"))
+			return FIELD_CALIB_T_BG;
+		else if (KEY_IS(key, len, "cam_angles"))
+			return FIELD_CAM_ANGLES;
+		break;
+	case 11:
+		if (KEY_IS(key, len, "calib_t_win"))
+			return FIELD_CALIB_T_WIN;
+		else if (KEY_IS(key, len, "frame_state"))
+			return FIELD_FRAME_STATE;
+		break;
+	case 12:
+		if (KEY_IS(key, len, "housing_temp"))
+			return FIELD_HOUSING_TEMP;
+		break;
+	case 13:
+		if (KEY_IS(key, len, "version_major"))
+			return FIELD_VERSION_MAJOR;
+		else if (KEY_IS(key, len, "version_minor"))
+			return FIELD_VERSION_MINOR;
+		else if (KEY_IS(key, len, "calib_tau_win"))
+			return FIELD_CALIB_TAU_WIN;
+		break;
+	case 14:
+		if (KEY_IS(key, len, "jpeg_data_size"))
+			return FIELD_JPEG_DATA_SIZE;
+		break;
+	case 16:
+		if (KEY_IS(key, len, "calib_emissivity"))
+			return FIELD_CALIB_EMISSIVITY;
+		break;
+	case 17:
+		if (KEY_IS(key, len, "window_reflection"))
+			return FIELD_WINDOW_REFLECTION;
+		break;
+	case 21:
+		if (KEY_IS(key, len, "cam_angles_timestamps"))
+			return FIELD_CAM_ANGLES_TIMESTAMPS;
+		break;
+	case 23:
+		if (KEY_IS(key, len, "attitude_reference_quat"))
+			return FIELD_ATTITUDE_REFERENCE_QUAT;
+		else if (KEY_IS(key, len, "thermal_to_visible_quat"))
+			return FIELD_THERMAL_TO_VISIBLE_QUAT;
+		break;
+	default:
+		break;
+	}
+
+	return FIELD_UNKNOWN;
+}
+
+
+static void skip_ws(struct parser *ps)
+{
+	while ((ps->p < ps->end) && ((*ps->p == ' ') || (*ps->p == '\t') ||
+				      (*ps->p == '\n') || (*ps->p == '\r')))
+		ps->p++;
+}
+
+
+static int expect(struct parser *ps, char c)
+{
+	skip_ws(ps);
+	if ((ps->p >= ps->end) || (*ps->p != c))
+		return -EPROTO;
+	ps->p++;
+	return 0;
+}
+
+
+/* Check for a character after optional whitespace and consume it */
+static bool accept_char(struct parser *ps, char c)
+{
+	skip_ws(ps);
+	if ((ps->p < ps->end) && (*ps->p == c)) {
+		ps->p++;
+		return true;
+	}
+	return false;
+}
+
+
+/* Parse a string; the returned span is not unescaped */
+static int parse_string(struct parser *ps, const char **str, size_t *len)
+{
+	const char *start;
+
+	if (expect(ps, '"') < 0)
+		return -EPROTO;
+	start = ps->p;
+	while (ps->p < ps->end) {
+		char c = *ps->p;
+		if (c == '"') {
+			*str = start;
+			*len = ps->p - start;
+			ps->p++;
+			return 0;
+		}
+		if (c == '\\')
+			ps->p++;
+		ps->p++;
+	}
+
+	return -EPROTO;
+}
+
+
+static bool match_literal(struct parser *ps, const char *lit)
+{
+	size_t len = strlen(lit);
+
+	if ((size_t)(ps->end - ps->p) < len || memcmp(ps->p, lit, len) != 0)
+		return false;
+	ps->p += len;
+	return true;
+}
+
+
+static int parse_double(struct parser *ps, double *val)
+{
+	const char *start, *p;
+	bool neg = false, exp_neg = false, exact = true;
+	uint64_t mant = 0;
+	int digits = 0, exp10 = 0, e = 0;
+
+	skip_ws(ps);
+	start = p = ps->p;
+
+	if ((p < ps->end) && (*p == '-')) {
+		neg = true;
+		p++;
+	}
+
+	/* Non-finite values as written by json-c */
+	ps->p = p;
+	if (match_literal(ps, "NaN")) {
+		*val = NAN;
+		return 0;
+	} else if (match_literal(ps, "Infinity")) {
+		*val = neg ? -INFINITY : INFINITY;
+		return 0;
+	}
+
+	/* Integer part */
+	if ((p >= ps->end) || (*p < '0') || (*p > '9'))
+		return -EPROTO;
+	for (; (p < ps->end) && (*p >= '0') && (*p <= '9'); p++) {
+		if (digits < 19) {
+			mant = mant * 10 + (*p - '0');
+			if (mant != 0)
+				digits++;
+		} else {
+			exp10++;
+			exact = false;
+		}
+	}
+
+	/* Fraction part */
+	if ((p < ps->end) && (*p == '.')) {
+		p++;
+		if ((p >= ps->end) || (*p < '0') || (*p > '9'))
+			return -EPROTO;
+		for (; (p < ps->end) && (*p >= '0') && (*p <= '9'); p++) {
+			if (digits < 19) {
+				mant = mant * 10 + (*p - '0');
+				if (mant != 0)
+					digits++;
+				exp10--;
+			} else {
+				exact = false;
+			}
+		}
+	}
+
+	/* Exponent part */
+	if ((p < ps->end) && ((*p == 'e') || (*p == 'E'))) {
+		p++;
+		if ((p < ps->end) && ((*p == '+') || (*p == '-'))) {
+			exp_neg = (*p == '-');
+			p++;
+		}
+		if ((p >= ps->end) || (*p < '0') || (*p > '9'))
+			return -EPROTO;
+		for (; (p < ps->end) && (*p >= '0') && (*p <= '9'); p++) {
+			if (e < 10000)
+				e = e * 10 + (*p - '0');
+		}
+		exp10 += exp_neg ? -e : e;
+	}
+	ps->p = p;
+
+	/* Exact when the mantissa and the power of 10 are both exactly
+	 * representable: a single correctly rounded operation */
+	if (exact && (mant <= (1ULL << 53)) && (exp10 >= -22) &&
+	    (exp10 <= 22)) {
+		double d = (double)mant;
+		d = (exp10 < 0) ? d / pow10_tab[-exp10] : d * pow10_tab[exp10];
+		*val = neg ? -d : d;
+		return 0;
+	}
+
+	/* Slow path */
+	char tmp[MAX_NUMBER_LEN];
+	size_t len = p - start;
+	if (len >= sizeof(tmp))
+		return -EPROTO;
+	memcpy(tmp, start, len);
+	tmp[len] = '\0';
+	*val = strtod_c(tmp);
+
+	return 0;
+}
+
+
+static int parse_int64(struct parser *ps, int64_t *val)
+{
+	bool neg = false;
+	uint64_t v = 0;
+
+	skip_ws(ps);
+	if ((ps->p < ps->end) && (*ps->p == '-')) {
+		neg = true;
+		ps->p++;
+	}
+	if ((ps->p >= ps->end) || (*ps->p < '0') || (*ps->p > '9'))
+		return -EPROTO;
+	for (; (ps->p < ps->end) && (*ps->p >= '0') && (*ps->p <= '9');
+	     ps->p++) {
+		unsigned int d = *ps->p - '0';
+		if (v > (UINT64_MAX - d) / 10)
+			return -ERANGE;
+		v = v * 10 + d;
+	}
+	if (v > (neg ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX))
+		return -ERANGE;
+	*val = neg ? (int64_t)(0 - v) : (int64_t)v;
+
+	return 0;
+}
+
+
+/* Parse a 32-bit value written as a signed integer */
+static int parse_uint32(struct parser *ps, uint32_t *val)
+{
+	int res;
+	int64_t v;
+
+	res = parse_int64(ps, &v);
+	if (res < 0)
+		return res;
+	if ((v < INT32_MIN) || (v > UINT32_MAX))
+		return -ERANGE;
+	*val = (uint32_t)v;
+
+	return 0;
+}
+
+
+static int skip_value(struct parser *ps)
+{
+	int depth = 0;
+	const char *str;
+	size_t len;
+
+	do {
+		skip_ws(ps);
+		if (ps->p >= ps->end)
+			return -EPROTO;
+		switch (*ps->p) {
+		case '{':
+		case '[':
+			if (++depth > MAX_DEPTH)
+				return -EPROTO;
+			ps->p++;
+			break;
+		case '}':
+		case ']':
+			if (--depth < 0)
+				return -EPROTO;
+			ps->p++;
+			break;
+		case ',':
+		case ':':
+			ps->p++;
+			break;
+		case '"':
+			if (parse_string(ps, &str, &len) < 0)
+				return -EPROTO;
+			break;
+		default:
+			/* Number or literal */
+			if (!((*ps->p == '-') || (*ps->p == '+') ||
+			      (*ps->p == '.') ||
+			      ((*ps->p >= '0') && (*ps->p <= '9')) ||
+			      ((*ps->p >= 'a') && (*ps->p <= 'z')) ||
+			      ((*ps->p >= 'A') && (*ps->p <= 'Z'))))
+				return -EPROTO;
+			while ((ps->p < ps->end) &&
+			       ((*ps->p == '-') || (*ps->p == '+') ||
+				(*ps->p == '.') ||
+				((*ps->p >= '0') && (*ps->p <= '9')) ||
+				((*ps->p >= 'a') && (*ps->p <= 'z')) ||
+				((*ps->p >= 'A') && (*ps->p <= 'Z'))))
+				ps->p++;
+			break;
+		}
+	} while (depth > 0);
+
+	return 0;
+}
+
+
+static int parse_enum_str(struct parser *ps, char *buf, size_t size)
+{
+	int res;
+	const char *str;
+	size_t len;
+
+	res = parse_string(ps, &str, &len);
+	if (res < 0)
+		return res;
+	if (len >= size)
+		len = size - 1;
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+
+	return 0;
+}
+
+
+static int parse_quaternion(struct parser *ps, float quat[4])
+{
+	int res;
+	const char *key;
+	size_t len;
+	double val;
+
+	quat[0] = quat[1] = quat[2] = quat[3] = 0.f;
+
+	if (expect(ps, '{') < 0)
+		return -EPROTO;
+	if (accept_char(ps, '}'))
+		return 0;
+	do {
+		res = parse_string(ps, &key, &len);
+		if (res < 0)
+			return res;
+		if (expect(ps, ':') < 0)
+			return -EPROTO;
+		if (len != 1) {
+			res = skip_value(ps);
+			if (res < 0)
+				return res;
+			continue;
+		}
+		res = parse_double(ps, &val);
+		if (res < 0)
+			return res;
+		switch (key[0]) {
+		case 'x':
+			quat[0] = (float)val;
+			break;
+		case 'y':
+			quat[1] = (float)val;
+			break;
+		case 'z':
+			quat[2] = (float)val;
+			break;
+		case 'w':
+			quat[3] = (float)val;
+			break;
+		default:
+			break;
+		}
+	} while (accept_char(ps, ','));
+
+	return expect(ps, '}');
+}
+
+
+static int parse_cam_angles(struct parser *ps, struct tmeta_data *meta)
+{
+	int res;
+	uint32_t count = 0;
+
+	if (expect(ps, '[') < 0)
+		return -EPROTO;
+	if (!accept_char(ps, ']')) {
+		do {
+			if (count >= TMETA_CAMANGLES_MAXCOUNT)
+				return TMETA_ERR_TOO_MANY_CAM_ANGLES;
+			res = parse_quaternion(ps, meta->cam_angles + count * 4);
+			if (res < 0)
+				return res;
+			count++;
+		} while (accept_char(ps, ','));
+		if (expect(ps, ']') < 0)
+			return -EPROTO;
+	}
+
+	return count;
+}
+
+
+static int parse_cam_angles_timestamps(struct parser *ps,
+				       struct tmeta_data *meta)
+{
+	int res;
+	uint32_t count = 0;
+	int64_t ts;
+
+	if (expect(ps, '[') < 0)
+		return -EPROTO;
+	if (!accept_char(ps, ']')) {
+		do {
+			if (count >= TMETA_CAMANGLES_MAXCOUNT)
+				return TMETA_ERR_TOO_MANY_CAM_ANGLES;
+			res = parse_int64(ps, &ts);
+			if (res < 0)
+				return res;
+			meta->cam_angles_timestamps[count++] = (uint64_t)ts;
+		} while (accept_char(ps, ','));
+		if (expect(ps, ']') < 0)
+			return -EPROTO;
+	}
+
+	return count;
+}
+
+
+static int parse_field(struct parser *ps,
+		       enum field field,
+		       struct tmeta_data *meta,
+		       uint32_t *version_major,
+		       uint32_t *version_minor,
+		       int *cam_angles_count,
+		       int *cam_angles_ts_count)
+{
+	char str[MAX_ENUM_LEN];
+	int res;
+
+	switch (field) {
+	case FIELD_VERSION_MAJOR:
+		return parse_uint32(ps, version_major);
+	case FIELD_VERSION_MINOR:
+		return parse_uint32(ps, version_minor);
+	case FIELD_GAIN_MODE:
+		res = parse_enum_str(ps, str, sizeof(str));
+		if (res == 0)
+			meta->gain_mode = tmeta_thermal_gain_mode_from_str(str);
+		return res;
+	case FIELD_CALIB_R:
+		return parse_double(ps, &meta->calib_r);
+	case FIELD_CALIB_B:
+		return parse_double(ps, &meta->calib_b);
+	case FIELD_CALIB_F:
+		return parse_double(ps, &meta->calib_f);
+	case FIELD_CALIB_O:
+		return parse_double(ps, &meta->calib_o);
+	case FIELD_CALIB_TAU_WIN:
+		return parse_double(ps, &meta->calib_tau_win);
+	case FIELD_CALIB_T_WIN:
+		return parse_double(ps, &meta->calib_t_win);
+	case FIELD_CALIB_T_BG:
+		return parse_double(ps, &meta->calib_t_bg);
+	case FIELD_CALIB_EMISSIVITY:
+		return parse_double(ps, &meta->calib_emissivity);
+	case FIELD_JPEG_DATA_SIZE:
+		return parse_uint32(ps, &meta->jpeg_data_size);
+	case FIELD_VALUE_MIN:
+		return parse_uint32(ps, &meta->value_min);
+	case FIELD_VALUE_MAX:
+		return parse_uint32(ps, &meta->value_max);
+	case FIELD_ATTITUDE_REFERENCE_QUAT:
+		return parse_quaternion(ps, meta->attitude_reference_quat);
+	case FIELD_CAM_ANGLES:
+		res = parse_cam_angles(ps, meta);
+		if (res < 0)
+			return res;
+		*cam_angles_count = res;
+		return 0;
+	case FIELD_CAM_ANGLES_TIMESTAMPS:
+		res = parse_cam_angles_timestamps(ps, meta);
+		if (res < 0)
+			return res;
+		*cam_angles_ts_count = res;
+		return 0;
+	case FIELD_FRAME_STATE:
+		res = parse_enum_str(ps, str, sizeof(str));
+		if (res == 0)
+			meta->frame_state =
+				tmeta_thermal_frame_state_from_str(str);
+		return res;
+	case FIELD_FPA_TEMP:
+		return parse_double(ps, &meta->fpa_temp);
+	case FIELD_HOUSING_TEMP:
+		return parse_double(ps, &meta->housing_temp);
+	case FIELD_WINDOW_REFLECTION:
+		return parse_double(ps, &meta->window_reflection);
+	case FIELD_THERMAL_TO_VISIBLE_QUAT:
+		return parse_quaternion(ps, meta->thermal_to_visible_quat);
+	case FIELD_UNKNOWN:
+	default:
+		return skip_value(ps);
+	}
+}
+
+
+int tmeta_thermal_metadata_from_json_str(const char *str,
+					 size_t len,
+					 struct tmeta_data *meta,
+					 size_t *consumed)
+{
+	int res;
+	struct parser ps;
+	const char *key, *start, *eol;
+	size_t key_len;
+	uint32_t version_major = 0, version_minor = 0;
+	int cam_angles_count = 0, cam_angles_ts_count = 0;
+
+	ULOG_ERRNO_RETURN_ERR_IF(str == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+
+	ps.p = str;
+	ps.end = str + len;
+
+	skip_ws(&ps);
+	if (ps.p >= ps.end) {
+		if (consumed)
+			*consumed = len;
+		return -ENODATA;
+	}
+
+	memset(meta, 0, sizeof(*meta));
+	start = ps.p;
+
+	res = expect(&ps, '{');
+	if (res < 0)
+		goto error;
+	if (!accept_char(&ps, '}')) {
+		do {
+			res = parse_string(&ps, &key, &key_len);
+			if (res < 0)
+				goto error;
+			res = expect(&ps, ':');
+			if (res < 0)
+				goto error;
+			res = parse_field(&ps,
+					  lookup_key(key, key_len),
+					  meta,
+					  &version_major,
+					  &version_minor,
+					  &cam_angles_count,
+					  &cam_angles_ts_count);
+			if (res < 0)
+				goto error;
+		} while (accept_char(&ps, ','));
+		res = expect(&ps, '}');
+		if (res < 0)
+			goto error;
+	}
+	skip_ws(&ps);
+
+	if (cam_angles_count != cam_angles_ts_count) {
+		ULOGE("%s: camera angles count mismatch (%d vs. %d)",
+		      __func__,
+		      cam_angles_count,
+		      cam_angles_ts_count);
+		/* The object itself is well-formed */
+		if (consumed)
+			*consumed = ps.p - str;
+		return -EPROTO;
+	}
+	meta->cam_angles_count = cam_angles_count;
+	meta->version = (version_major & 0xFFFF) << 16 |
+			(version_minor & 0xFFFF);
+
+	if (consumed)
+		*consumed = ps.p - str;
+
+	return 0;
+
+error:
+	ULOGE("%s: JSON parsing error at offset %zu",
+	      __func__,
+	      (size_t)(ps.p - str));
+	/* Skip to the end of the line where the object starts, so that the
+	 * caller can resume with the next record of newline-delimited JSON */
+	if (consumed) {
+		eol = memchr(start, '\n', ps.end - start);
+		*consumed = (eol != NULL) ? (size_t)(eol + 1 - str) : len;
+	}
+	return res;
+}
@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_PRIV_H_
+#define _TMETA_PRIV_H_
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#	include <winsock2.h>
+#else /* !_WIN32 */
+#	include <arpa/inet.h>
+#endif /* !_WIN32 */
+
+#include <metadata-thermal/tmeta.h>
+#include <metadata-thermal/tmeta_accum.h>
+#include <metadata-thermal/tmeta_archive.h>
+#include <metadata-thermal/tmeta_colorize.h>
+#include <metadata-thermal/tmeta_gen.h>
+#include <metadata-thermal/tmeta_hotspot.h>
+#include <metadata-thermal/tmeta_remap.h>
+#include <metadata-thermal/tmeta_rescale.h>
+#include <metadata-thermal/tmeta_stats.h>
+
+#define ULOG_TAG tmeta
+#include <ulog.h>
+
+#ifdef __APPLE__
+#	include <machine/endian.h>
+#elif defined(_WIN32)
+#	define bswapll(y) (((uint64_t)ntohl(y)) << 32 | ntohl(y >> 32))
+#	define htonll(y) bswapll(y)
+#	define ntohll(y) bswapll(y)
+#else
+#	include <endian.h>
+#	if __BYTE_ORDER == __LITTLE_ENDIAN
+#		define bswapll(y) (((uint64_t)ntohl(y)) << 32 | ntohl(y >> 32))
+#		define htonll(y) bswapll(y)
+#		define ntohll(y) bswapll(y)
+#	else
+#		define htonll(y) (y)
+#		define ntohll(y) (y)
+#	endif
+#endif
+
+
+/* Raw thermal value corresponding to an 8-bit value of the JPEG image
+ * (the JPEG data is the raw frame scaled from value_min..value_max to
+ * 0..255) */
+static inline double tmeta_u8_to_raw(const struct tmeta_data *meta,
+				     unsigned int value)
+{
+	return (double)meta->value_min +
+	       (double)value *
+		       ((double)meta->value_max - (double)meta->value_min) /
+		       255.;
+}
+
+
+/* Is the frame usable for radiometry? The frame state has been added in
+ * version 0.2, older frames are always considered valid */
+static inline bool tmeta_frame_is_valid(const struct tmeta_data *meta)
+{
+	if (TMETA_GET_MAJOR_VERSION(meta->version) == 0 &&
+	    TMETA_GET_MINOR_VERSION(meta->version) < 2)
+		return true;
+	return meta->frame_state == TMETA_THERMAL_FRAME_STATE_VALID;
+}
+
+
+/* AVX2 code paths: the library is usually built for the baseline
+ * instruction set of the target, so the AVX2 functions are built with a
+ * target attribute and selected at runtime; in a build for an AVX2 target
+ * they are used unconditionally */
+#if defined(__AVX2__)
+#	define TMETA_AVX2
+#	define TMETA_TARGET_AVX2
+#	define TMETA_TARGET_AVX2_FMA
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#	define TMETA_AVX2
+#	define TMETA_TARGET_AVX2 __attribute__((target("avx2")))
+#	define TMETA_TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+#endif
+
+#ifdef TMETA_AVX2
+#	include <immintrin.h>
+
+static inline bool tmeta_cpu_has_avx2(void)
+{
+#	ifdef __AVX2__
+	return true;
+#	else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#	endif
+}
+
+
+static inline bool tmeta_cpu_has_avx2_fma(void)
+{
+#	ifdef __AVX2__
+	/* TMETA_TARGET_AVX2_FMA is empty: FMA is used only if the build
+	 * enables it */
+	return true;
+#	else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#	endif
+}
+#endif /* TMETA_AVX2 */
+
+
+/* CRC32C (Castagnoli) of a buffer; crc is the CRC of the preceding data
+ * (0 for the first buffer), see tmeta_crc32c.c */
+uint32_t tmeta_crc32c(uint32_t crc, const void *buf, size_t len);
+
+
+/* Stats flags (enum tmeta_stats_flags), see tmeta_stats.c */
+extern uint32_t tmeta_stats_flags;
+
+
+static inline bool tmeta_stats_enabled(void)
+{
+	return (__atomic_load_n(&tmeta_stats_flags, __ATOMIC_RELAXED) &
+		TMETA_STATS_FLAG_COUNTERS) != 0;
+}
+
+
+uint64_t tmeta_stats_clock_ns(void);
+
+
+/* Start a latency measurement; returns 0 if latency stats are disabled */
+static inline uint64_t tmeta_stats_start(void)
+{
+	const uint32_t flags =
+		TMETA_STATS_FLAG_COUNTERS | TMETA_STATS_FLAG_LATENCY;
+	if ((__atomic_load_n(&tmeta_stats_flags, __ATOMIC_RELAXED) & flags) !=
+	    flags)
+		return 0;
+	return tmeta_stats_clock_ns();
+}
+
+
+void tmeta_stats_record_serialize(size_t size, uint64_t start);
+
+
+void tmeta_stats_record_deserialize(uint32_t version,
+				    uint32_t cam_angles_count,
+				    uint32_t jpeg_data_size,
+				    size_t size,
+				    int res,
+				    uint64_t start);
+
+
+void tmeta_stats_record_to_json(uint64_t start);
+
+
+#endif /* !_TMETA_PRIV_H_ */
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tmeta_priv.h"
+
+
+/* Calibration checks; the background (resp. window) temperature is only
+ * used if the emissivity (resp. window transmission) is below 1 */
+static bool calibration_is_valid(const struct tmeta_data *meta)
+{
+	if ((meta->calib_r <= 0.) || (meta->calib_b <= 0.))
+		return false;
+	if (!(meta->calib_emissivity > 0.) || (meta->calib_emissivity > 1.))
+		return false;
+	if (!(meta->calib_tau_win > 0.) || (meta->calib_tau_win > 1.))
+		return false;
+	if ((meta->calib_emissivity < 1.) && !(meta->calib_t_bg > 0.))
+		return false;
+	if ((meta->calib_tau_win < 1.) && !(meta->calib_t_win > 0.))
+		return false;
+	return true;
+}
+
+
+/* Raw value of a black body at a given temperature */
+static double planck_raw(const struct tmeta_data *meta, double temp)
+{
+	return meta->calib_r / (exp(meta->calib_b / temp) - meta->calib_f) +
+	       meta->calib_o;
+}
+
+
+/* Raw value contribution of the reflected background and of the window
+ * emission, i.e. the part of the measured raw value that does not come
+ * from the object */
+static double ambient_raw(const struct tmeta_data *meta)
+{
+	double e = meta->calib_emissivity;
+	double tau = meta->calib_tau_win;
+	double raw = 0.;
+
+	if (e < 1.)
+		raw += (1. - e) * tau * planck_raw(meta, meta->calib_t_bg);
+	if (tau < 1.)
+		raw += (1. - tau) * planck_raw(meta, meta->calib_t_win);
+	return raw;
+}
+
+
+int tmeta_raw_to_temperature(const struct tmeta_data *meta,
+			     double raw,
+			     double *temp)
+{
+	double obj, x;
+
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(temp == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!calibration_is_valid(meta), EINVAL);
+
+	obj = (raw - ambient_raw(meta)) /
+	      (meta->calib_emissivity * meta->calib_tau_win);
+	if (!(obj > meta->calib_o))
+		return -EDOM;
+	x = meta->calib_r / (obj - meta->calib_o) + meta->calib_f;
+	if (!(x > 1.))
+		return -EDOM;
+
+	*temp = meta->calib_b / log(x);
+	return 0;
+}
+
+
+int tmeta_temperature_to_raw(const struct tmeta_data *meta,
+			     double temp,
+			     double *raw)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(raw == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!calibration_is_valid(meta), EINVAL);
+
+	if (!(temp > 0.) || !(exp(meta->calib_b / temp) > meta->calib_f))
+		return -EDOM;
+
+	*raw = meta->calib_emissivity * meta->calib_tau_win *
+		       planck_raw(meta, temp) +
+	       ambient_raw(meta);
+	return 0;
+}
@@ -0,0 +1,882 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tmeta_priv.h"
+
+
+/* Default remap grid spacing in visible pixels */
+#define DEFAULT_GRID_STEP 16
+
+/* Default alignment quaternion tolerance in radians */
+#define DEFAULT_QUAT_TOLERANCE 1e-4
+
+/* Default intrinsics tolerance in pixels */
+#define DEFAULT_INTRINSICS_TOLERANCE 1e-2
+
+/* Thermal coordinate of grid nodes behind the thermal camera: NaN
+ * propagates through the grid interpolation so that all the pixels of the
+ * cells around such a node are invalid, and fails the warp range checks */
+#define INVALID_COORD NAN
+
+
+struct tmeta_remap;
+
+
+typedef void (*warp_row_u8_fn_t)(const struct tmeta_remap *self,
+				 const uint8_t *src,
+				 size_t src_stride,
+				 uint8_t *dst);
+
+
+typedef void (*warp_row_rgba_fn_t)(const struct tmeta_remap *self,
+				   const uint8_t *src,
+				   size_t src_stride,
+				   uint8_t *dst);
+
+
+typedef void (*warp_row_f32_fn_t)(const struct tmeta_remap *self,
+				  const float *src,
+				  size_t src_stride,
+				  float *dst);
+
+
+struct tmeta_remap {
+	/* Configuration */
+	struct tmeta_camera_intrinsics thermal;
+	struct tmeta_camera_intrinsics visible;
+	unsigned int grid_step;
+	double quat_tolerance;
+	double intrinsics_tolerance;
+
+	/* Remap grid: thermal frame coordinates of the grid nodes */
+	bool grid_valid;
+	float grid_quat[4];
+	struct tmeta_camera_intrinsics grid_thermal;
+	struct tmeta_camera_intrinsics grid_visible;
+	unsigned int grid_width;
+	unsigned int grid_height;
+	float *grid_x;
+	float *grid_y;
+
+	/* Warp work buffers: grid row interpolated for the current visible
+	 * row, then expanded to per-pixel thermal coordinates */
+	float *row_x;
+	float *row_y;
+	float *src_x;
+	float *src_y;
+
+	/* Row warp functions, selected at creation */
+	warp_row_u8_fn_t warp_row_u8;
+	warp_row_rgba_fn_t warp_row_rgba;
+	warp_row_f32_fn_t warp_row_f32;
+};
+
+
+static bool intrinsics_are_valid(const struct tmeta_camera_intrinsics *intr)
+{
+	return (intr->width > 0) && (intr->height > 0) && (intr->fx > 0.) &&
+	       (intr->fy > 0.);
+}
+
+
+static bool intrinsics_changed(const struct tmeta_camera_intrinsics *a,
+			       const struct tmeta_camera_intrinsics *b,
+			       double tolerance)
+{
+	if ((a->width != b->width) || (a->height != b->height))
+		return true;
+	return (fabs(a->fx - b->fx) > tolerance) ||
+	       (fabs(a->fy - b->fy) > tolerance) ||
+	       (fabs(a->cx - b->cx) > tolerance) ||
+	       (fabs(a->cy - b->cy) > tolerance);
+}
+
+
+/* Normalized alignment quaternion of the metadata, identity if missing */
+static void get_alignment_quat(const struct tmeta_data *meta, float quat[4])
+{
+	const float *q = meta->thermal_to_visible_quat;
+	double norm;
+
+	if ((TMETA_GET_MAJOR_VERSION(meta->version) == 0) &&
+	    (TMETA_GET_MINOR_VERSION(meta->version) < 4))
+		goto identity;
+
+	norm = sqrt((double)q[0] * q[0] + (double)q[1] * q[1] +
+		    (double)q[2] * q[2] + (double)q[3] * q[3]);
+	if (!(norm > 1e-6))
+		goto identity;
+
+	for (unsigned int i = 0; i < 4; i++)
+		quat[i] = (float)(q[i] / norm);
+	return;
+
+identity:
+	quat[0] = 0.f;
+	quat[1] = 0.f;
+	quat[2] = 0.f;
+	quat[3] = 1.f;
+}
+
+
+/* Rotation angle between two normalized quaternions */
+static double quat_angle(const float a[4], const float b[4])
+{
+	double dot = fabs((double)a[0] * b[0] + (double)a[1] * b[1] +
+			  (double)a[2] * b[2] + (double)a[3] * b[3]);
+	if (dot > 1.)
+		dot = 1.;
+	return 2. * acos(dot);
+}
+
+
+static void build_grid(struct tmeta_remap *self, const float quat[4])
+{
+	const struct tmeta_camera_intrinsics *th = &self->thermal;
+	const struct tmeta_camera_intrinsics *vi = &self->visible;
+	double x = quat[0], y = quat[1], z = quat[2], w = quat[3];
+	double r[3][3];
+
+	/* Thermal to visible rotation matrix */
+	r[0][0] = 1. - 2. * (y * y + z * z);
+	r[0][1] = 2. * (x * y - z * w);
+	r[0][2] = 2. * (x * z + y * w);
+	r[1][0] = 2. * (x * y + z * w);
+	r[1][1] = 1. - 2. * (x * x + z * z);
+	r[1][2] = 2. * (y * z - x * w);
+	r[2][0] = 2. * (x * z - y * w);
+	r[2][1] = 2. * (y * z + x * w);
+	r[2][2] = 1. - 2. * (x * x + y * y);
+
+	for (unsigned int j = 0; j < self->grid_height; j++) {
+		double v = (double)j * self->grid_step;
+		float *gx = self->grid_x + (size_t)j * self->grid_width;
+		float *gy = self->grid_y + (size_t)j * self->grid_width;
+		for (unsigned int i = 0; i < self->grid_width; i++) {
+			double u = (double)i * self->grid_step;
+			double rv[3], rt[3];
+
+			/* Visible pixel to visible camera ray */
+			rv[0] = (u - vi->cx) / vi->fx;
+			rv[1] = (v - vi->cy) / vi->fy;
+			rv[2] = 1.;
+
+			/* Visible to thermal camera ray (inverse rotation) */
+			for (unsigned int k = 0; k < 3; k++)
+				rt[k] = r[0][k] * rv[0] + r[1][k] * rv[1] +
+					r[2][k] * rv[2];
+
+			/* Projection on the thermal frame */
+			if (rt[2] <= 1e-9) {
+				gx[i] = INVALID_COORD;
+				gy[i] = INVALID_COORD;
+				continue;
+			}
+			gx[i] = (float)(th->fx * rt[0] / rt[2] + th->cx);
+			gy[i] = (float)(th->fy * rt[1] / rt[2] + th->cy);
+		}
+	}
+
+	memcpy(self->grid_quat, quat, sizeof(self->grid_quat));
+	self->grid_thermal = self->thermal;
+	self->grid_visible = self->visible;
+	self->grid_valid = true;
+}
+
+
+/* Compute the thermal frame coordinates of a visible frame row */
+static void expand_row(struct tmeta_remap *self, unsigned int y)
+{
+	const unsigned int step = self->grid_step;
+	const unsigned int gw = self->grid_width;
+	const unsigned int width = self->visible.width;
+	unsigned int gy = y / step;
+	float t = (float)(y - gy * step) / step;
+	const float *gx0 = self->grid_x + (size_t)gy * gw;
+	const float *gy0 = self->grid_y + (size_t)gy * gw;
+	const float *gx1 = gx0 + gw;
+	const float *gy1 = gy0 + gw;
+	float *restrict row_x = self->row_x;
+	float *restrict row_y = self->row_y;
+
+	/* Vertical interpolation between the two surrounding grid rows */
+	for (unsigned int i = 0; i < gw; i++) {
+		row_x[i] = gx0[i] + t * (gx1[i] - gx0[i]);
+		row_y[i] = gy0[i] + t * (gy1[i] - gy0[i]);
+	}
+
+	/* Horizontal interpolation between the grid columns */
+	for (unsigned int i = 0; i + 1 < gw; i++) {
+		unsigned int x0 = i * step;
+		if (x0 >= width)
+			break;
+		unsigned int n = (width - x0 < step) ? width - x0 : step;
+		float sx = row_x[i];
+		float sy = row_y[i];
+		float dx = (row_x[i + 1] - sx) / step;
+		float dy = (row_y[i + 1] - sy) / step;
+		float *restrict src_x = self->src_x + x0;
+		float *restrict src_y = self->src_y + x0;
+		for (unsigned int k = 0; k < n; k++) {
+			src_x[k] = sx + (float)k * dx;
+			src_y[k] = sy + (float)k * dy;
+		}
+	}
+}
+
+
+#ifdef TMETA_AVX2
+
+/* Source coordinates of 8 pixels for bilinear interpolation with 8.8
+ * fixed-point weights: the top-left pixel is clamped to width - 2 and
+ * height - 2 so that its right and bottom neighbours are inside the
+ * image, a weight of 256 then selecting them. This gives the same result
+ * as the scalar code, which uses the pixel itself as neighbour on the last
+ * column and row. The width and height must be at least 2 */
+TMETA_TARGET_AVX2_FMA static inline __m256i
+warp_coords_avx2(const struct tmeta_remap *self,
+		 unsigned int i,
+		 __m256i *x0,
+		 __m256i *y0,
+		 __m256i *wx,
+		 __m256i *wy)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 vxmax = _mm256_set1_ps(self->thermal.width - 1);
+	const __m256 vymax = _mm256_set1_ps(self->thermal.height - 1);
+	const __m256 v256 = _mm256_set1_ps(256.f);
+	__m256 x = _mm256_loadu_ps(self->src_x + i);
+	__m256 y = _mm256_loadu_ps(self->src_y + i);
+	__m256 valid = _mm256_and_ps(
+		_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ),
+			      _mm256_cmp_ps(x, vxmax, _CMP_LE_OQ)),
+		_mm256_and_ps(_mm256_cmp_ps(y, zero, _CMP_GE_OQ),
+			      _mm256_cmp_ps(y, vymax, _CMP_LE_OQ)));
+
+	/* Clamp so that the gathers stay inside the image (NaN is replaced
+	 * by 0 as the second operand is returned) */
+	x = _mm256_min_ps(_mm256_max_ps(x, zero), vxmax);
+	y = _mm256_min_ps(_mm256_max_ps(y, zero), vymax);
+	*x0 = _mm256_min_epi32(_mm256_cvttps_epi32(x),
+			       _mm256_set1_epi32(self->thermal.width - 2));
+	*y0 = _mm256_min_epi32(_mm256_cvttps_epi32(y),
+			       _mm256_set1_epi32(self->thermal.height - 2));
+	*wx = _mm256_cvttps_epi32(
+		_mm256_mul_ps(_mm256_sub_ps(x, _mm256_cvtepi32_ps(*x0)), v256));
+	*wy = _mm256_cvttps_epi32(
+		_mm256_mul_ps(_mm256_sub_ps(y, _mm256_cvtepi32_ps(*y0)), v256));
+
+	return _mm256_castps_si256(valid);
+}
+
+
+/* Vertical interpolation of the horizontally interpolated values:
+ * (top * (256 - wy) + bottom * wy + 32768) >> 16 */
+TMETA_TARGET_AVX2_FMA static inline __m256i
+warp_lerp_y_avx2(__m256i top, __m256i bottom, __m256i wy)
+{
+	__m256i v = _mm256_add_epi32(
+		_mm256_slli_epi32(top, 8),
+		_mm256_mullo_epi32(_mm256_sub_epi32(bottom, top), wy));
+	return _mm256_srli_epi32(
+		_mm256_add_epi32(v, _mm256_set1_epi32(32768)), 16);
+}
+
+
+/* Weights of the horizontal interpolation as 16-bit pairs for
+ * _mm256_madd_epi16(): (256 - wx) in the low half, wx in the high half */
+TMETA_TARGET_AVX2_FMA static inline __m256i warp_wx_pairs_avx2(__m256i wx)
+{
+	return _mm256_or_si256(
+		_mm256_sub_epi32(_mm256_set1_epi32(256), wx),
+		_mm256_slli_epi32(wx, 16));
+}
+
+#endif /* TMETA_AVX2 */
+
+
+/* Scalar warp of the row pixels from index i */
+static void warp_row_u8_c(const struct tmeta_remap *self,
+			  const uint8_t *src,
+			  size_t src_stride,
+			  uint8_t *dst,
+			  unsigned int i)
+{
+	const int tw = self->thermal.width;
+	const int th = self->thermal.height;
+	const float xmax = tw - 1;
+	const float ymax = th - 1;
+
+	for (; i < self->visible.width; i++) {
+		float x = self->src_x[i];
+		float y = self->src_y[i];
+		if (!((x >= 0.f) && (x <= xmax) && (y >= 0.f) &&
+		      (y <= ymax))) {
+			dst[i] = 0;
+			continue;
+		}
+		int x0 = (int)x;
+		int y0 = (int)y;
+		int x1 = (x0 < tw - 1) ? x0 + 1 : x0;
+		int y1 = (y0 < th - 1) ? y0 + 1 : y0;
+		unsigned int wx = (unsigned int)((x - x0) * 256.f);
+		unsigned int wy = (unsigned int)((y - y0) * 256.f);
+		const uint8_t *r0 = src + (size_t)y0 * src_stride;
+		const uint8_t *r1 = src + (size_t)y1 * src_stride;
+		unsigned int top = r0[x0] * (256 - wx) + r0[x1] * wx;
+		unsigned int bottom = r1[x0] * (256 - wx) + r1[x1] * wx;
+		dst[i] = (uint8_t)((top * (256 - wy) + bottom * wy + 32768) >>
+				   16);
+	}
+}
+
+
+static void warp_row_u8(const struct tmeta_remap *self,
+			const uint8_t *src,
+			size_t src_stride,
+			uint8_t *dst)
+{
+	warp_row_u8_c(self, src, src_stride, dst, 0);
+}
+
+
+/* Scalar warp of the row pixels from index i */
+static void warp_row_rgba_c(const struct tmeta_remap *self,
+			    const uint8_t *src,
+			    size_t src_stride,
+			    uint8_t *dst,
+			    unsigned int i)
+{
+	const int tw = self->thermal.width;
+	const int th = self->thermal.height;
+	const float xmax = tw - 1;
+	const float ymax = th - 1;
+
+	for (; i < self->visible.width; i++) {
+		float x = self->src_x[i];
+		float y = self->src_y[i];
+		uint8_t *d = dst + 4 * i;
+		if (!((x >= 0.f) && (x <= xmax) && (y >= 0.f) &&
+		      (y <= ymax))) {
+			memset(d, 0, 4);
+			continue;
+		}
+		int x0 = (int)x;
+		int y0 = (int)y;
+		int x1 = (x0 < tw - 1) ? x0 + 1 : x0;
+		int y1 = (y0 < th - 1) ? y0 + 1 : y0;
+		unsigned int wx = (unsigned int)((x - x0) * 256.f);
+		unsigned int wy = (unsigned int)((y - y0) * 256.f);
+		const uint8_t *p00 = src + (size_t)y0 * src_stride + 4 * x0;
+		const uint8_t *p01 = src + (size_t)y0 * src_stride + 4 * x1;
+		const uint8_t *p10 = src + (size_t)y1 * src_stride + 4 * x0;
+		const uint8_t *p11 = src + (size_t)y1 * src_stride + 4 * x1;
+		for (unsigned int c = 0; c < 4; c++) {
+			unsigned int top = p00[c] * (256 - wx) + p01[c] * wx;
+			unsigned int bottom = p10[c] * (256 - wx) + p11[c] * wx;
+			d[c] = (uint8_t)((top * (256 - wy) + bottom * wy +
+					  32768) >>
+					 16);
+		}
+	}
+}
+
+
+static void warp_row_rgba(const struct tmeta_remap *self,
+			  const uint8_t *src,
+			  size_t src_stride,
+			  uint8_t *dst)
+{
+	warp_row_rgba_c(self, src, src_stride, dst, 0);
+}
+
+
+/* Scalar warp of the row pixels from index i */
+static void warp_row_f32_c(const struct tmeta_remap *self,
+			   const float *src,
+			   size_t src_stride,
+			   float *dst,
+			   unsigned int i)
+{
+	const int tw = self->thermal.width;
+	const int th = self->thermal.height;
+	const float xmax = tw - 1;
+	const float ymax = th - 1;
+
+	for (; i < self->visible.width; i++) {
+		float x = self->src_x[i];
+		float y = self->src_y[i];
+		if (!((x >= 0.f) && (x <= xmax) && (y >= 0.f) &&
+		      (y <= ymax))) {
+			dst[i] = NAN;
+			continue;
+		}
+		int x0 = (int)x;
+		int y0 = (int)y;
+		int x1 = (x0 < tw - 1) ? x0 + 1 : x0;
+		int y1 = (y0 < th - 1) ? y0 + 1 : y0;
+		float fx = x - x0;
+		float fy = y - y0;
+		const float *r0 = src + (size_t)y0 * src_stride;
+		const float *r1 = src + (size_t)y1 * src_stride;
+		float top = r0[x0] + fx * (r0[x1] - r0[x0]);
+		float bottom = r1[x0] + fx * (r1[x1] - r1[x0]);
+		dst[i] = top + fy * (bottom - top);
+	}
+}
+
+
+static void warp_row_f32(const struct tmeta_remap *self,
+			 const float *src,
+			 size_t src_stride,
+			 float *dst)
+{
+	warp_row_f32_c(self, src, src_stride, dst, 0);
+}
+
+
+#ifdef TMETA_AVX2
+
+TMETA_TARGET_AVX2_FMA static void
+warp_row_u8_avx2(const struct tmeta_remap *self,
+		 const uint8_t *src,
+		 size_t src_stride,
+		 uint8_t *dst)
+{
+	const int tw = self->thermal.width;
+	const int th = self->thermal.height;
+	unsigned int i = 0;
+
+	/* The two horizontal neighbours are read with a single 32-bit
+	 * gather at an offset kept inside the row, then shifted */
+	if ((tw >= 4) && (th >= 2) &&
+	    ((uint64_t)src_stride * th <= INT32_MAX)) {
+		const __m256i vstride = _mm256_set1_epi32((int)src_stride);
+		const __m256i vlast = _mm256_set1_epi32(tw - 4);
+		/* Bytes 0 and 1 of each 32-bit value to 16-bit pairs */
+		const __m256i pairs = _mm256_setr_epi8(0, -1, 1, -1,
+						       4, -1, 5, -1,
+						       8, -1, 9, -1,
+						       12, -1, 13, -1,
+						       0, -1, 1, -1,
+						       4, -1, 5, -1,
+						       8, -1, 9, -1,
+						       12, -1, 13, -1);
+		/* Byte 0 of each 32-bit value to the low 4 bytes of the
+		 * lane */
+		const __m256i bytes = _mm256_setr_epi8(0, 4, 8, 12,
+						       -1, -1, -1, -1,
+						       -1, -1, -1, -1,
+						       -1, -1, -1, -1,
+						       0, 4, 8, 12,
+						       -1, -1, -1, -1,
+						       -1, -1, -1, -1,
+						       -1, -1, -1, -1);
+		for (; i + 8 <= self->visible.width; i += 8) {
+			__m256i x0, y0, wx, wy;
+			__m256i valid =
+				warp_coords_avx2(self, i, &x0, &y0, &wx, &wy);
+			__m256i start = _mm256_min_epi32(x0, vlast);
+			__m256i shift = _mm256_slli_epi32(
+				_mm256_sub_epi32(x0, start), 3);
+			__m256i r0 = _mm256_add_epi32(
+				_mm256_mullo_epi32(y0, vstride), start);
+			__m256i r1 = _mm256_add_epi32(r0, vstride);
+			__m256i p0 = _mm256_srlv_epi32(
+				_mm256_i32gather_epi32((const int *)src, r0, 1),
+				shift);
+			__m256i p1 = _mm256_srlv_epi32(
+				_mm256_i32gather_epi32((const int *)src, r1, 1),
+				shift);
+			__m256i w = warp_wx_pairs_avx2(wx);
+			__m256i top = _mm256_madd_epi16(
+				_mm256_shuffle_epi8(p0, pairs), w);
+			__m256i bottom = _mm256_madd_epi16(
+				_mm256_shuffle_epi8(p1, pairs), w);
+			__m256i res = _mm256_and_si256(
+				warp_lerp_y_avx2(top, bottom, wy), valid);
+			res = _mm256_permutevar8x32_epi32(
+				_mm256_shuffle_epi8(res, bytes),
+				_mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+			_mm_storel_epi64((__m128i *)(dst + i),
+					 _mm256_castsi256_si128(res));
+		}
+	}
+
+	warp_row_u8_c(self, src, src_stride, dst, i);
+}
+
+
+TMETA_TARGET_AVX2_FMA static void
+warp_row_rgba_avx2(const struct tmeta_remap *self,
+		   const uint8_t *src,
+		   size_t src_stride,
+		   uint8_t *dst)
+{
+	const int tw = self->thermal.width;
+	const int th = self->thermal.height;
+	unsigned int i = 0;
+
+	/* One 32-bit gather per neighbour; the channels are interpolated
+	 * one pixel at a time (pixel j of each 128-bit lane) */
+	if ((tw >= 2) && (th >= 2) &&
+	    ((uint64_t)src_stride * th <= INT32_MAX)) {
+		const __m256i vstride = _mm256_set1_epi32((int)src_stride);
+		const __m256i zero = _mm256_setzero_si256();
+		for (; i + 8 <= self->visible.width; i += 8) {
+			__m256i x0, y0, wx, wy;
+			__m256i valid =
+				warp_coords_avx2(self, i, &x0, &y0, &wx, &wy);
+			__m256i r0 = _mm256_add_epi32(
+				_mm256_mullo_epi32(y0, vstride),
+				_mm256_slli_epi32(x0, 2));
+			__m256i r1 = _mm256_add_epi32(r0, vstride);
+			__m256i p00 = _mm256_i32gather_epi32(
+				(const int *)src, r0, 1);
+			__m256i p01 = _mm256_i32gather_epi32(
+				(const int *)(src + 4), r0, 1);
+			__m256i p10 = _mm256_i32gather_epi32(
+				(const int *)src, r1, 1);
+			__m256i p11 = _mm256_i32gather_epi32(
+				(const int *)(src + 4), r1, 1);
+			__m256i w = warp_wx_pairs_avx2(wx);
+			/* Left/right channel pairs: pixels 0-1 and 2-3 of
+			 * each lane */
+			__m256i t[2] = {_mm256_unpacklo_epi8(p00, p01),
+					_mm256_unpackhi_epi8(p00, p01)};
+			__m256i b[2] = {_mm256_unpacklo_epi8(p10, p11),
+					_mm256_unpackhi_epi8(p10, p11)};
+			__m256i res[4];
+			for (unsigned int j = 0; j < 4; j++) {
+				__m256i tj = (j & 1) ? _mm256_unpackhi_epi8(
+							       t[j / 2], zero)
+						     : _mm256_unpacklo_epi8(
+							       t[j / 2], zero);
+				__m256i bj = (j & 1) ? _mm256_unpackhi_epi8(
+							       b[j / 2], zero)
+						     : _mm256_unpacklo_epi8(
+							       b[j / 2], zero);
+				/* Weights of pixel j of each lane */
+				__m256i wj = _mm256_permutevar8x32_epi32(
+					w,
+					_mm256_setr_epi32(
+						j, j, j, j, j + 4, j + 4, j + 4, j + 4));
+				__m256i wyj = _mm256_permutevar8x32_epi32(
+					wy,
+					_mm256_setr_epi32(
+						j, j, j, j, j + 4, j + 4, j + 4, j + 4));
+				res[j] = warp_lerp_y_avx2(
+					_mm256_madd_epi16(tj, wj),
+					_mm256_madd_epi16(bj, wj),
+					wyj);
+			}
+			__m256i out = _mm256_packus_epi16(
+				_mm256_packus_epi32(res[0], res[1]),
+				_mm256_packus_epi32(res[2], res[3]));
+			_mm256_storeu_si256((__m256i *)(dst + 4 * i),
+					    _mm256_and_si256(out, valid));
+		}
+	}
+
+	warp_row_rgba_c(self, src, src_stride, dst, i);
+}
+
+
+/* Built without FMA so that the interpolation gives the same result as
+ * the scalar code */
+TMETA_TARGET_AVX2 static void
+warp_row_f32_avx2(const struct tmeta_remap *self,
+		  const float *src,
+		  size_t src_stride,
+		  float *dst)
+{
+	const int tw = self->thermal.width;
+	const int th = self->thermal.height;
+	const float xmax = tw - 1;
+	const float ymax = th - 1;
+	unsigned int i = 0;
+
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 vxmax = _mm256_set1_ps(xmax);
+	const __m256 vymax = _mm256_set1_ps(ymax);
+	const __m256 vnan = _mm256_set1_ps(NAN);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i vxmaxi = _mm256_set1_epi32(tw - 1);
+	const __m256i vymaxi = _mm256_set1_epi32(th - 1);
+	const __m256i vstride = _mm256_set1_epi32((int)src_stride);
+	for (; i + 8 <= self->visible.width; i += 8) {
+		__m256 x = _mm256_loadu_ps(self->src_x + i);
+		__m256 y = _mm256_loadu_ps(self->src_y + i);
+		__m256 valid = _mm256_and_ps(
+			_mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GE_OQ),
+				      _mm256_cmp_ps(x, vxmax, _CMP_LE_OQ)),
+			_mm256_and_ps(_mm256_cmp_ps(y, zero, _CMP_GE_OQ),
+				      _mm256_cmp_ps(y, vymax, _CMP_LE_OQ)));
+		/* Clamp so that the gathers stay inside the image */
+		x = _mm256_min_ps(_mm256_max_ps(x, zero), vxmax);
+		y = _mm256_min_ps(_mm256_max_ps(y, zero), vymax);
+		__m256 xf = _mm256_floor_ps(x);
+		__m256 yf = _mm256_floor_ps(y);
+		__m256 fx = _mm256_sub_ps(x, xf);
+		__m256 fy = _mm256_sub_ps(y, yf);
+		__m256i x0 = _mm256_cvttps_epi32(xf);
+		__m256i y0 = _mm256_cvttps_epi32(yf);
+		__m256i x1 = _mm256_min_epi32(_mm256_add_epi32(x0, one), vxmaxi);
+		__m256i y1 = _mm256_min_epi32(_mm256_add_epi32(y0, one), vymaxi);
+		__m256i r0 = _mm256_mullo_epi32(y0, vstride);
+		__m256i r1 = _mm256_mullo_epi32(y1, vstride);
+		__m256 p00 = _mm256_i32gather_ps(
+			src, _mm256_add_epi32(r0, x0), sizeof(float));
+		__m256 p01 = _mm256_i32gather_ps(
+			src, _mm256_add_epi32(r0, x1), sizeof(float));
+		__m256 p10 = _mm256_i32gather_ps(
+			src, _mm256_add_epi32(r1, x0), sizeof(float));
+		__m256 p11 = _mm256_i32gather_ps(
+			src, _mm256_add_epi32(r1, x1), sizeof(float));
+		__m256 top = _mm256_add_ps(
+			p00, _mm256_mul_ps(fx, _mm256_sub_ps(p01, p00)));
+		__m256 bottom = _mm256_add_ps(
+			p10, _mm256_mul_ps(fx, _mm256_sub_ps(p11, p10)));
+		__m256 res = _mm256_add_ps(
+			top, _mm256_mul_ps(fy, _mm256_sub_ps(bottom, top)));
+		_mm256_storeu_ps(dst + i, _mm256_blendv_ps(vnan, res, valid));
+	}
+
+	warp_row_f32_c(self, src, src_stride, dst, i);
+}
+
+#endif /* TMETA_AVX2 */
+
+
+int tmeta_remap_new(const struct tmeta_remap_config *config,
+		    struct tmeta_remap **ret_obj)
+{
+	int res;
+	struct tmeta_remap *self;
+
+	ULOG_ERRNO_RETURN_ERR_IF(config == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(ret_obj == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!intrinsics_are_valid(&config->thermal),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!intrinsics_are_valid(&config->visible),
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->quat_tolerance < 0., EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(config->intrinsics_tolerance < 0., EINVAL);
+
+	self = calloc(1, sizeof(*self));
+	if (self == NULL) {
+		res = -ENOMEM;
+		ULOG_ERRNO("calloc", -res);
+		return res;
+	}
+
+	self->thermal = config->thermal;
+	self->visible = config->visible;
+	self->grid_step = (config->grid_step > 0) ? config->grid_step
+						  : DEFAULT_GRID_STEP;
+	self->quat_tolerance = (config->quat_tolerance > 0.)
+				       ? config->quat_tolerance
+				       : DEFAULT_QUAT_TOLERANCE;
+	self->intrinsics_tolerance = (config->intrinsics_tolerance > 0.)
+					     ? config->intrinsics_tolerance
+					     : DEFAULT_INTRINSICS_TOLERANCE;
+
+	self->warp_row_u8 = warp_row_u8;
+	self->warp_row_rgba = warp_row_rgba;
+	self->warp_row_f32 = warp_row_f32;
+#ifdef TMETA_AVX2
+	if (tmeta_cpu_has_avx2_fma()) {
+		self->warp_row_u8 = warp_row_u8_avx2;
+		self->warp_row_rgba = warp_row_rgba_avx2;
+	}
+	if (tmeta_cpu_has_avx2())
+		self->warp_row_f32 = warp_row_f32_avx2;
+#endif
+
+	/* One extra node after the last pixel so that every pixel lies
+	 * between two nodes */
+	self->grid_width = (self->visible.width - 1) / self->grid_step + 2;
+	self->grid_height = (self->visible.height - 1) / self->grid_step + 2;
+
+	size_t grid_size = (size_t)self->grid_width * self->grid_height;
+	self->grid_x = malloc(grid_size * sizeof(*self->grid_x));
+	self->grid_y = malloc(grid_size * sizeof(*self->grid_y));
+	self->row_x = malloc(self->grid_width * sizeof(*self->row_x));
+	self->row_y = malloc(self->grid_width * sizeof(*self->row_y));
+	self->src_x = malloc(self->visible.width * sizeof(*self->src_x));
+	self->src_y = malloc(self->visible.width * sizeof(*self->src_y));
+	if ((self->grid_x == NULL) || (self->grid_y == NULL) ||
+	    (self->row_x == NULL) || (self->row_y == NULL) ||
+	    (self->src_x == NULL) || (self->src_y == NULL)) {
+		res = -ENOMEM;
+		ULOG_ERRNO("malloc", -res);
+		goto error;
+	}
+
+	*ret_obj = self;
+
+	return 0;
+
+error:
+	tmeta_remap_destroy(self);
+	return res;
+}
+
+
+int tmeta_remap_destroy(struct tmeta_remap *self)
+{
+	if (self == NULL)
+		return 0;
+
+	free(self->grid_x);
+	free(self->grid_y);
+	free(self->row_x);
+	free(self->row_y);
+	free(self->src_x);
+	free(self->src_y);
+	free(self);
+
+	return 0;
+}
+
+
+int tmeta_remap_set_intrinsics(struct tmeta_remap *self,
+			       const struct tmeta_camera_intrinsics *thermal,
+			       const struct tmeta_camera_intrinsics *visible)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(thermal == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(visible == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!intrinsics_are_valid(thermal), EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(!intrinsics_are_valid(visible), EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((visible->width != self->visible.width) ||
+					 (visible->height !=
+					  self->visible.height),
+				 EINVAL);
+
+	self->thermal = *thermal;
+	self->visible = *visible;
+
+	return 0;
+}
+
+
+int tmeta_remap_update(struct tmeta_remap *self,
+		       const struct tmeta_data *meta,
+		       bool *rebuilt)
+{
+	float quat[4];
+	bool rebuild;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+
+	get_alignment_quat(meta, quat);
+
+	rebuild = !self->grid_valid ||
+		  (quat_angle(quat, self->grid_quat) > self->quat_tolerance) ||
+		  intrinsics_changed(&self->thermal,
+				     &self->grid_thermal,
+				     self->intrinsics_tolerance) ||
+		  intrinsics_changed(&self->visible,
+				     &self->grid_visible,
+				     self->intrinsics_tolerance);
+	if (rebuild)
+		build_grid(self, quat);
+
+	if (rebuilt)
+		*rebuilt = rebuild;
+
+	return 0;
+}
+
+
+int tmeta_remap_warp(struct tmeta_remap *self,
+		     enum tmeta_remap_format format,
+		     const void *src,
+		     size_t src_stride,
+		     void *dst,
+		     size_t dst_stride)
+{
+	size_t bpp;
+
+	ULOG_ERRNO_RETURN_ERR_IF(self == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(src == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst == NULL, EINVAL);
+
+	switch (format) {
+	case TMETA_REMAP_FORMAT_U8:
+		bpp = sizeof(uint8_t);
+		break;
+	case TMETA_REMAP_FORMAT_F32:
+		bpp = sizeof(float);
+		ULOG_ERRNO_RETURN_ERR_IF((src_stride % sizeof(float)) != 0,
+					 EINVAL);
+		ULOG_ERRNO_RETURN_ERR_IF((dst_stride % sizeof(float)) != 0,
+					 EINVAL);
+		break;
+	case TMETA_REMAP_FORMAT_RGBA:
+		bpp = 4;
+		break;
+	default:
+		ULOGE("%s: invalid format %d", __func__, format);
+		return -EINVAL;
+	}
+	ULOG_ERRNO_RETURN_ERR_IF(src_stride < self->thermal.width * bpp,
+				 EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst_stride < self->visible.width * bpp,
+				 EINVAL);
+
+	if (!self->grid_valid) {
+		ULOGE("%s: no remap grid, tmeta_remap_update() must be "
+		      "called first",
+		      __func__);
+		return -EPROTO;
+	}
+
+	for (unsigned int y = 0; y < self->visible.height; y++) {
+		uint8_t *d = (uint8_t *)dst + (size_t)y * dst_stride;
+		expand_row(self, y);
+		switch (format) {
+		case TMETA_REMAP_FORMAT_U8:
+			self->warp_row_u8(self, src, src_stride, d);
+			break;
+		case TMETA_REMAP_FORMAT_F32:
+			self->warp_row_f32(self,
+					   src,
+					   src_stride / sizeof(float),
+					   (float *)d);
+			break;
+		case TMETA_REMAP_FORMAT_RGBA:
+			self->warp_row_rgba(self, src, src_stride, d);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
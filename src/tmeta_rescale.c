@@ -0,0 +1,386 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tmeta_priv.h"
+
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#	include <arm_neon.h>
+#	define TMETA_RESCALE_NEON
+#endif
+
+
+/* Rescale parameters; the scalar and SIMD kernels use the same float
+ * operations in the same order so that their output is identical */
+struct rescale_params {
+	uint16_t lo;
+	float scale;
+};
+
+
+static inline uint8_t rescale_value(uint16_t v,
+				    const struct rescale_params *params)
+{
+	float f = (float)((int32_t)v - (int32_t)params->lo) * params->scale;
+	if (f < 0.f)
+		f = 0.f;
+	if (f > 255.f)
+		f = 255.f;
+	return (uint8_t)(int32_t)(f + 0.5f);
+}
+
+
+static void minmax_row(const uint16_t *src,
+		       unsigned int width,
+		       uint16_t *vmin,
+		       uint16_t *vmax)
+{
+	uint16_t lo = *vmin, hi = *vmax;
+	unsigned int i = 0;
+
+#if defined(__AVX2__)
+	if (width >= 16) {
+		__m256i mn = _mm256_set1_epi16((short)lo);
+		__m256i mx = _mm256_set1_epi16((short)hi);
+		for (; i + 16 <= width; i += 16) {
+			__m256i v = _mm256_loadu_si256(
+				(const __m256i *)(src + i));
+			mn = _mm256_min_epu16(mn, v);
+			mx = _mm256_max_epu16(mx, v);
+		}
+		__m128i mn128 = _mm_min_epu16(_mm256_castsi256_si128(mn),
+					      _mm256_extracti128_si256(mn, 1));
+		__m128i mx128 = _mm_max_epu16(_mm256_castsi256_si128(mx),
+					      _mm256_extracti128_si256(mx, 1));
+		/* Horizontal max as the min of the complement */
+		lo = (uint16_t)_mm_cvtsi128_si32(_mm_minpos_epu16(mn128));
+		hi = (uint16_t)~_mm_cvtsi128_si32(_mm_minpos_epu16(
+			_mm_xor_si128(mx128, _mm_set1_epi16(-1))));
+	}
+#elif defined(TMETA_RESCALE_NEON)
+	if (width >= 8) {
+		uint16x8_t mn = vdupq_n_u16(lo);
+		uint16x8_t mx = vdupq_n_u16(hi);
+		for (; i + 8 <= width; i += 8) {
+			uint16x8_t v = vld1q_u16(src + i);
+			mn = vminq_u16(mn, v);
+			mx = vmaxq_u16(mx, v);
+		}
+		lo = vminvq_u16(mn);
+		hi = vmaxvq_u16(mx);
+	}
+#endif
+
+	for (; i < width; i++) {
+		if (src[i] < lo)
+			lo = src[i];
+		if (src[i] > hi)
+			hi = src[i];
+	}
+
+	*vmin = lo;
+	*vmax = hi;
+}
+
+
+/* Rescale a row and, if minmax is true, compute its min/max; minmax is
+ * a constant at each call site so that the unused reduction is removed */
+static inline void rescale_row(const uint16_t *src,
+			       uint8_t *dst,
+			       unsigned int width,
+			       const struct rescale_params *params,
+			       bool minmax,
+			       uint16_t *vmin,
+			       uint16_t *vmax)
+{
+	uint16_t lo = minmax ? *vmin : 0, hi = minmax ? *vmax : 0;
+	unsigned int i = 0;
+
+#if defined(__AVX2__)
+	if (width >= 16) {
+		const __m256i vlo = _mm256_set1_epi32(params->lo);
+		const __m256 vscale = _mm256_set1_ps(params->scale);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 v255 = _mm256_set1_ps(255.f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		__m256i mn = _mm256_set1_epi16((short)lo);
+		__m256i mx = _mm256_set1_epi16((short)hi);
+		for (; i + 16 <= width; i += 16) {
+			__m256i v = _mm256_loadu_si256(
+				(const __m256i *)(src + i));
+			if (minmax) {
+				mn = _mm256_min_epu16(mn, v);
+				mx = _mm256_max_epu16(mx, v);
+			}
+			__m256 fa = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+				_mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)),
+				vlo));
+			__m256 fb = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+				_mm256_cvtepu16_epi32(
+					_mm256_extracti128_si256(v, 1)),
+				vlo));
+			fa = _mm256_mul_ps(fa, vscale);
+			fb = _mm256_mul_ps(fb, vscale);
+			fa = _mm256_min_ps(_mm256_max_ps(fa, zero), v255);
+			fb = _mm256_min_ps(_mm256_max_ps(fb, zero), v255);
+			__m256i a = _mm256_cvttps_epi32(_mm256_add_ps(fa, half));
+			__m256i b = _mm256_cvttps_epi32(_mm256_add_ps(fb, half));
+			/* Pack to 16-bit (lane-interleaved), restore the
+			 * order, then pack to 8-bit */
+			__m256i p = _mm256_permute4x64_epi64(
+				_mm256_packus_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128(
+				(__m128i *)(dst + i),
+				_mm_packus_epi16(_mm256_castsi256_si128(p),
+						 _mm256_extracti128_si256(p, 1)));
+		}
+		if (minmax) {
+			__m128i mn128 =
+				_mm_min_epu16(_mm256_castsi256_si128(mn),
+					      _mm256_extracti128_si256(mn, 1));
+			__m128i mx128 =
+				_mm_max_epu16(_mm256_castsi256_si128(mx),
+					      _mm256_extracti128_si256(mx, 1));
+			lo = (uint16_t)_mm_cvtsi128_si32(
+				_mm_minpos_epu16(mn128));
+			hi = (uint16_t)~_mm_cvtsi128_si32(_mm_minpos_epu16(
+				_mm_xor_si128(mx128, _mm_set1_epi16(-1))));
+		}
+	}
+#elif defined(TMETA_RESCALE_NEON)
+	if (width >= 16) {
+		const int32x4_t vlo = vdupq_n_s32(params->lo);
+		const float32x4_t vscale = vdupq_n_f32(params->scale);
+		const float32x4_t zero = vdupq_n_f32(0.f);
+		const float32x4_t v255 = vdupq_n_f32(255.f);
+		const float32x4_t half = vdupq_n_f32(0.5f);
+		uint16x8_t mn = vdupq_n_u16(lo);
+		uint16x8_t mx = vdupq_n_u16(hi);
+		for (; i + 16 <= width; i += 16) {
+			uint16x8_t v[2];
+			uint16x8_t r[2];
+			v[0] = vld1q_u16(src + i);
+			v[1] = vld1q_u16(src + i + 8);
+			if (minmax) {
+				mn = vminq_u16(mn, vminq_u16(v[0], v[1]));
+				mx = vmaxq_u16(mx, vmaxq_u16(v[0], v[1]));
+			}
+			for (unsigned int k = 0; k < 2; k++) {
+				int32x4_t a = vsubq_s32(
+					vreinterpretq_s32_u32(
+						vmovl_u16(vget_low_u16(v[k]))),
+					vlo);
+				int32x4_t b = vsubq_s32(
+					vreinterpretq_s32_u32(
+						vmovl_u16(vget_high_u16(v[k]))),
+					vlo);
+				float32x4_t fa =
+					vmulq_f32(vcvtq_f32_s32(a), vscale);
+				float32x4_t fb =
+					vmulq_f32(vcvtq_f32_s32(b), vscale);
+				fa = vminq_f32(vmaxq_f32(fa, zero), v255);
+				fb = vminq_f32(vmaxq_f32(fb, zero), v255);
+				fa = vaddq_f32(fa, half);
+				fb = vaddq_f32(fb, half);
+				r[k] = vcombine_u16(
+					vmovn_u32(vcvtq_u32_f32(fa)),
+					vmovn_u32(vcvtq_u32_f32(fb)));
+			}
+			vst1q_u8(dst + i,
+				 vcombine_u8(vmovn_u16(r[0]), vmovn_u16(r[1])));
+		}
+		if (minmax) {
+			lo = vminvq_u16(mn);
+			hi = vmaxvq_u16(mx);
+		}
+	}
+#endif
+
+	for (; i < width; i++) {
+		uint16_t v = src[i];
+		if (minmax) {
+			if (v < lo)
+				lo = v;
+			if (v > hi)
+				hi = v;
+		}
+		dst[i] = rescale_value(v, params);
+	}
+
+	if (minmax) {
+		*vmin = lo;
+		*vmax = hi;
+	}
+}
+
+
+/* Rescale a frame and, if vmin and vmax are not NULL, compute its
+ * min/max */
+static void rescale_frame(const uint16_t *src,
+			  size_t src_stride,
+			  unsigned int width,
+			  unsigned int height,
+			  uint8_t *dst,
+			  size_t dst_stride,
+			  uint16_t range_min,
+			  uint16_t range_max,
+			  uint16_t *vmin,
+			  uint16_t *vmax)
+{
+	struct rescale_params params;
+
+	params.lo = range_min;
+	params.scale = (range_max > range_min)
+			       ? 255.f / (float)(range_max - range_min)
+			       : 0.f;
+
+	if ((vmin == NULL) || (vmax == NULL)) {
+		for (unsigned int y = 0; y < height; y++) {
+			rescale_row(src, dst, width, &params, false, NULL, NULL);
+			src = (const uint16_t *)((const uint8_t *)src +
+						 src_stride);
+			dst += dst_stride;
+		}
+		return;
+	}
+
+	*vmin = UINT16_MAX;
+	*vmax = 0;
+	for (unsigned int y = 0; y < height; y++) {
+		rescale_row(src, dst, width, &params, true, vmin, vmax);
+		src = (const uint16_t *)((const uint8_t *)src + src_stride);
+		dst += dst_stride;
+	}
+}
+
+
+int tmeta_rescale_raw_frame(const uint16_t *src,
+			    size_t src_stride,
+			    unsigned int width,
+			    unsigned int height,
+			    uint8_t *dst,
+			    size_t dst_stride,
+			    enum tmeta_rescale_mode mode,
+			    struct tmeta_data *meta,
+			    struct tmeta_rescale_result *result)
+{
+	uint16_t range_min, range_max, vmin, vmax;
+	unsigned int passes = 0;
+
+	ULOG_ERRNO_RETURN_ERR_IF(src == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(meta == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(result == NULL, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((width == 0) || (height == 0), EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(src_stride < width * sizeof(uint16_t), EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF((src_stride % sizeof(uint16_t)) != 0, EINVAL);
+	ULOG_ERRNO_RETURN_ERR_IF(dst_stride < width, EINVAL);
+
+	switch (mode) {
+	case TMETA_RESCALE_MODE_EXACT:
+		break;
+	case TMETA_RESCALE_MODE_PREDICTIVE:
+	case TMETA_RESCALE_MODE_PREDICTIVE_DEFERRED:
+		if ((result->passes == 0) ||
+		    (result->frame_max > UINT16_MAX) ||
+		    (result->frame_min > result->frame_max))
+			mode = TMETA_RESCALE_MODE_EXACT;
+		break;
+	default:
+		ULOGE("%s: invalid mode %d", __func__, mode);
+		return -EINVAL;
+	}
+
+	if (mode == TMETA_RESCALE_MODE_EXACT) {
+		/* Min/max reduction pass */
+		const uint16_t *s = src;
+		vmin = UINT16_MAX;
+		vmax = 0;
+		for (unsigned int y = 0; y < height; y++) {
+			minmax_row(s, width, &vmin, &vmax);
+			s = (const uint16_t *)((const uint8_t *)s + src_stride);
+		}
+		passes++;
+		range_min = vmin;
+		range_max = vmax;
+		/* The min/max are already known from the reduction pass */
+		rescale_frame(src,
+			      src_stride,
+			      width,
+			      height,
+			      dst,
+			      dst_stride,
+			      range_min,
+			      range_max,
+			      NULL,
+			      NULL);
+		passes++;
+		result->clamped = false;
+	} else {
+		/* Single pass with the previous frame range */
+		range_min = result->frame_min;
+		range_max = result->frame_max;
+		rescale_frame(src,
+			      src_stride,
+			      width,
+			      height,
+			      dst,
+			      dst_stride,
+			      range_min,
+			      range_max,
+			      &vmin,
+			      &vmax);
+		passes++;
+		result->clamped = (vmin < range_min) || (vmax > range_max);
+		if (result->clamped && (mode == TMETA_RESCALE_MODE_PREDICTIVE)) {
+			/* Correction pass with the frame range, whose
+			 * min/max are already known */
+			range_min = vmin;
+			range_max = vmax;
+			rescale_frame(src,
+				      src_stride,
+				      width,
+				      height,
+				      dst,
+				      dst_stride,
+				      range_min,
+				      range_max,
+				      NULL,
+				      NULL);
+			passes++;
+			result->clamped = false;
+		}
+	}
+
+	meta->value_min = range_min;
+	meta->value_max = range_max;
+	result->frame_min = vmin;
+	result->frame_max = vmax;
+	result->passes = passes;
+
+	return 0;
+}
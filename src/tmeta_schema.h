@@ -0,0 +1,312 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TMETA_SCHEMA_H_
+#define _TMETA_SCHEMA_H_
+
+/* Wire format description of the thermal metadata structure.
+ *
+ * The fields are listed once, in wire order and grouped by the version
+ * that added them, as X(kind, member) entries. The per-version encoders
+ * and decoders, the structure sizes and the JSON conversions are all
+ * generated from these lists. A new minor version only needs a new field
+ * list, a TMETA_SCHEMA_TAIL_<minor> entry, its truncation error and the
+ * instantiation of its encoder and decoder. */
+
+/* Field kinds and wire sizes:
+ * - U32: unsigned 32-bit integer, network byte order
+ * - GAIN_MODE, FRAME_STATE: enums, serialized as U32
+ * - COUNT: camera angles count, serialized as U32; the camera angles,
+ *   their timestamps and the JPEG data follow the v0.1 header
+ * - F64: double, host byte order
+ * - QUAT: quaternion (x, y, z, w) as 4 floats, host byte order
+ * - CHECKSUM: CRC32C of the data from the version field up to the
+ *   checksum, serialized as U32; the member name is not used */
+#define TMETA_SCHEMA_U32_SIZE 4
+#define TMETA_SCHEMA_GAIN_MODE_SIZE 4
+#define TMETA_SCHEMA_FRAME_STATE_SIZE 4
+#define TMETA_SCHEMA_COUNT_SIZE 4
+#define TMETA_SCHEMA_F64_SIZE 8
+#define TMETA_SCHEMA_QUAT_SIZE 16
+#define TMETA_SCHEMA_CHECKSUM_SIZE 4
+
+/* Camera angle size: quaternion and timestamp (network byte order) */
+#define TMETA_SCHEMA_CAM_ANGLE_SIZE (TMETA_SCHEMA_QUAT_SIZE + 8)
+
+
+/* Version 0.1 fixed header */
+#define TMETA_SCHEMA_V0_1_HEADER(X)                                            \
+	X(GAIN_MODE, gain_mode)                                                \
+	X(F64, calib_r)                                                        \
+	X(F64, calib_b)                                                        \
+	X(F64, calib_f)                                                        \
+	X(F64, calib_o)                                                        \
+	X(F64, calib_tau_win)                                                  \
+	X(F64, calib_t_win)                                                    \
+	X(F64, calib_t_bg)                                                     \
+	X(F64, calib_emissivity)                                               \
+	X(U32, jpeg_data_size)                                                 \
+	X(U32, value_min)                                                      \
+	X(U32, value_max)                                                      \
+	X(QUAT, attitude_reference_quat)                                       \
+	X(COUNT, cam_angles_count)
+
+/* Version 0.2 shutter state */
+#define TMETA_SCHEMA_V0_2(X) X(FRAME_STATE, frame_state)
+
+/* Version 0.3 temperatures */
+#define TMETA_SCHEMA_V0_3(X)                                                   \
+	X(F64, fpa_temp)                                                       \
+	X(F64, housing_temp)                                                   \
+	X(F64, window_reflection)
+
+/* Version 0.4 thermal camera alignment */
+#define TMETA_SCHEMA_V0_4(X) X(QUAT, thermal_to_visible_quat)
+
+/* Version 0.5 checksum */
+#define TMETA_SCHEMA_V0_5(X) X(CHECKSUM, crc32c)
+
+
+/* Fields following the v0.1 variable size data, per minor version */
+#define TMETA_SCHEMA_TAIL_1(X)
+#define TMETA_SCHEMA_TAIL_2(X) TMETA_SCHEMA_TAIL_1(X) TMETA_SCHEMA_V0_2(X)
+#define TMETA_SCHEMA_TAIL_3(X) TMETA_SCHEMA_TAIL_2(X) TMETA_SCHEMA_V0_3(X)
+#define TMETA_SCHEMA_TAIL_4(X) TMETA_SCHEMA_TAIL_3(X) TMETA_SCHEMA_V0_4(X)
+#define TMETA_SCHEMA_TAIL_5(X) TMETA_SCHEMA_TAIL_4(X) TMETA_SCHEMA_V0_5(X)
+
+/* Latest minor version */
+#define TMETA_SCHEMA_MINOR_VERSION 5
+#define TMETA_SCHEMA_TAIL_LATEST(X) TMETA_SCHEMA_TAIL_5(X)
+
+
+/* Size in bytes of a field list */
+#define TMETA_SCHEMA_FIELD_SIZE(_kind, _member) +TMETA_SCHEMA_##_kind##_SIZE
+#define TMETA_SCHEMA_SIZE(_fields) (0 _fields(TMETA_SCHEMA_FIELD_SIZE))
+
+
+/* The public size macros must match the schema */
+_Static_assert(TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_1_HEADER) ==
+		       TMETA_V0_1_HEADER_SIZE,
+	       "v0.1 header size mismatch");
+_Static_assert(TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_2) == TMETA_V0_2_DATA_SIZE,
+	       "v0.2 data size mismatch");
+_Static_assert(TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_3) == TMETA_V0_3_DATA_SIZE,
+	       "v0.3 data size mismatch");
+_Static_assert(TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_4) == TMETA_V0_4_DATA_SIZE,
+	       "v0.4 data size mismatch");
+_Static_assert(TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_5) == TMETA_V0_5_DATA_SIZE,
+	       "v0.5 data size mismatch");
+_Static_assert(TMETA_SCHEMA_MINOR_VERSION == TMETA_MINOR_VERSION,
+	       "latest minor version mismatch");
+
+
+/* Unaligned loads and stores */
+
+static inline uint32_t tmeta_schema_load_u32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+
+static inline uint64_t tmeta_schema_load_u64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return ntohll(v);
+}
+
+
+static inline void tmeta_schema_store_u32(uint8_t *p, uint32_t v)
+{
+	v = htonl(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+
+static inline void tmeta_schema_store_u64(uint8_t *p, uint64_t v)
+{
+	v = htonll(v);
+	memcpy(p, &v, sizeof(v));
+}
+
+
+/* Field encoding and decoding, per kind */
+#define TMETA_SCHEMA_ENCODE_U32(_p, _m, _f) tmeta_schema_store_u32(_p, (_m)->_f)
+#define TMETA_SCHEMA_ENCODE_GAIN_MODE(_p, _m, _f)                              \
+	tmeta_schema_store_u32(_p, (uint32_t)(_m)->_f)
+#define TMETA_SCHEMA_ENCODE_FRAME_STATE(_p, _m, _f)                            \
+	tmeta_schema_store_u32(_p, (uint32_t)(_m)->_f)
+#define TMETA_SCHEMA_ENCODE_COUNT(_p, _m, _f)                                  \
+	tmeta_schema_store_u32(_p, (_m)->_f)
+#define TMETA_SCHEMA_ENCODE_F64(_p, _m, _f) memcpy(_p, &(_m)->_f, sizeof(double))
+#define TMETA_SCHEMA_ENCODE_QUAT(_p, _m, _f)                                   \
+	memcpy(_p, (_m)->_f, TMETA_SCHEMA_QUAT_SIZE)
+#define TMETA_SCHEMA_ENCODE_CHECKSUM(_p, _m, _f)                               \
+	tmeta_schema_store_u32(_p, tmeta_crc32c(0, buf, (size_t)((_p)-buf)))
+
+#define TMETA_SCHEMA_DECODE_U32(_p, _m, _f) (_m)->_f = tmeta_schema_load_u32(_p)
+#define TMETA_SCHEMA_DECODE_GAIN_MODE(_p, _m, _f)                              \
+	(_m)->_f = (enum tmeta_thermal_gain_mode)tmeta_schema_load_u32(_p)
+#define TMETA_SCHEMA_DECODE_FRAME_STATE(_p, _m, _f)                            \
+	(_m)->_f = (enum tmeta_thermal_frame_state)tmeta_schema_load_u32(_p)
+#define TMETA_SCHEMA_DECODE_COUNT(_p, _m, _f)                                  \
+	(_m)->_f = tmeta_schema_load_u32(_p)
+#define TMETA_SCHEMA_DECODE_F64(_p, _m, _f) memcpy(&(_m)->_f, _p, sizeof(double))
+#define TMETA_SCHEMA_DECODE_QUAT(_p, _m, _f)                                   \
+	memcpy((_m)->_f, _p, TMETA_SCHEMA_QUAT_SIZE)
+#define TMETA_SCHEMA_DECODE_CHECKSUM(_p, _m, _f)                               \
+	do {                                                                   \
+		if (tmeta_schema_load_u32(_p) !=                               \
+		    tmeta_crc32c(0, buf, (size_t)((_p)-buf)))                  \
+			return TMETA_ERR_BAD_CHECKSUM;                         \
+	} while (0)
+
+/* Field list entries; they use the 'buf' (start of the version field), 'p'
+ * and 'meta' variables of the generated functions */
+#define TMETA_SCHEMA_ENCODE_FIELD(_kind, _f)                                   \
+	TMETA_SCHEMA_ENCODE_##_kind(p, meta, _f);                              \
+	p += TMETA_SCHEMA_##_kind##_SIZE;
+#define TMETA_SCHEMA_DECODE_FIELD(_kind, _f)                                   \
+	TMETA_SCHEMA_DECODE_##_kind(p, meta, _f);                              \
+	p += TMETA_SCHEMA_##_kind##_SIZE;
+
+
+/* Camera angles: quaternions (host byte order) then timestamps (network
+ * byte order); NULL arrays are skipped on load */
+static inline void tmeta_schema_store_cam_angles(uint8_t *p,
+						 const float *quats,
+						 const uint64_t *timestamps,
+						 uint32_t count)
+{
+	memcpy(p, quats, (size_t)count * TMETA_SCHEMA_QUAT_SIZE);
+	p += (size_t)count * TMETA_SCHEMA_QUAT_SIZE;
+	for (uint32_t i = 0; i < count; i++) {
+		tmeta_schema_store_u64(p, timestamps[i]);
+		p += sizeof(uint64_t);
+	}
+}
+
+
+static inline void tmeta_schema_load_cam_angles(const uint8_t *p,
+						uint32_t count,
+						float *quats,
+						uint64_t *timestamps)
+{
+	if (quats != NULL)
+		memcpy(quats, p, (size_t)count * TMETA_SCHEMA_QUAT_SIZE);
+	if (timestamps == NULL)
+		return;
+	p += (size_t)count * TMETA_SCHEMA_QUAT_SIZE;
+	for (uint32_t i = 0; i < count; i++) {
+		timestamps[i] = tmeta_schema_load_u64(p);
+		p += sizeof(uint64_t);
+	}
+}
+
+
+/* Define an encoder for a minor version and a metadata structure type:
+ * the encoder writes the data from the version field to the end and
+ * returns the number of bytes written; the buffer must be large enough,
+ * i.e. at least the size returned by the _name##_size function
+ * (size_t size(const _type *meta)) defined along with the encoder. The
+ * camera angles are written by _store_cam_angles
+ * (void store(const _type *meta, uint8_t *p)) */
+#define TMETA_SCHEMA_DEFINE_ENCODER(_name, _type, _minor, _store_cam_angles)   \
+	static inline size_t _name##_size(const _type *meta)                   \
+	{                                                                      \
+		return TMETA_VERSION_SIZE +                                    \
+		       TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_1_HEADER) +           \
+		       (size_t)meta->cam_angles_count *                        \
+			       TMETA_SCHEMA_CAM_ANGLE_SIZE +                   \
+		       meta->jpeg_data_size +                                  \
+		       TMETA_SCHEMA_SIZE(TMETA_SCHEMA_TAIL_##_minor);          \
+	}                                                                      \
+	static size_t _name(const _type *meta, uint8_t *buf)                   \
+	{                                                                      \
+		uint8_t *p = buf;                                              \
+		tmeta_schema_store_u32(                                        \
+			p, TMETA_MAJOR_VERSION << 16 | (_minor));              \
+		p += TMETA_VERSION_SIZE;                                       \
+		TMETA_SCHEMA_V0_1_HEADER(TMETA_SCHEMA_ENCODE_FIELD)            \
+		_store_cam_angles(meta, p);                                    \
+		p += (size_t)meta->cam_angles_count *                          \
+		     TMETA_SCHEMA_CAM_ANGLE_SIZE;                              \
+		if (meta->jpeg_data_size > 0)                                  \
+			memcpy(p, meta->jpeg_data, meta->jpeg_data_size);      \
+		p += meta->jpeg_data_size;                                     \
+		TMETA_SCHEMA_TAIL_##_minor(TMETA_SCHEMA_ENCODE_FIELD)          \
+		return p - buf;                                                \
+	}
+
+
+/* Define a decoder for a minor version and a metadata structure type: the
+ * decoder reads the data after the version field (buf points to the
+ * version field and size includes it). The camera angles count is
+ * validated by _check_cam_angles (int check(const _type *meta)) before
+ * the size check, and the camera angles are read by _load_cam_angles
+ * (int load(_type *meta, const uint8_t *p)); an error returned by the
+ * latter is reported once the whole structure is decoded. A single size
+ * check is done once the variable sizes are known; on failure the
+ * diagnose function (int diagnose(size_t size, uint32_t cam_angles_count,
+ * uint32_t jpeg_data_size, unsigned int minor)) returns the detailed
+ * error code */
+#define TMETA_SCHEMA_DEFINE_DECODER(                                           \
+	_name, _type, _minor, _check_cam_angles, _load_cam_angles, _diagnose)  \
+	static int _name(const uint8_t *buf, size_t size, _type *meta)         \
+	{                                                                      \
+		const uint8_t *p = buf + TMETA_VERSION_SIZE;                   \
+		uint64_t needed;                                               \
+		int res;                                                       \
+		size -= TMETA_VERSION_SIZE;                                    \
+		if (size < TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_1_HEADER))        \
+			return TMETA_ERR_TRUNCATED_HEADER;                     \
+		TMETA_SCHEMA_V0_1_HEADER(TMETA_SCHEMA_DECODE_FIELD)            \
+		res = _check_cam_angles(meta);                                 \
+		if (res < 0)                                                   \
+			return res;                                            \
+		needed = TMETA_SCHEMA_SIZE(TMETA_SCHEMA_V0_1_HEADER) +         \
+			 (uint64_t)meta->cam_angles_count *                    \
+				 TMETA_SCHEMA_CAM_ANGLE_SIZE +                 \
+			 meta->jpeg_data_size +                                \
+			 TMETA_SCHEMA_SIZE(TMETA_SCHEMA_TAIL_##_minor);        \
+		if (size < needed) {                                           \
+			return _diagnose(size,                                 \
+					 meta->cam_angles_count,               \
+					 meta->jpeg_data_size,                 \
+					 (_minor));                            \
+		}                                                              \
+		res = _load_cam_angles(meta, p);                               \
+		p += (size_t)meta->cam_angles_count *                          \
+		     TMETA_SCHEMA_CAM_ANGLE_SIZE;                              \
+		meta->jpeg_data = (void *)p;                                   \
+		p += meta->jpeg_data_size;                                     \
+		TMETA_SCHEMA_TAIL_##_minor(TMETA_SCHEMA_DECODE_FIELD)          \
+		return res;                                                    \
+	}
+
+#endif /* !_TMETA_SCHEMA_H_ */
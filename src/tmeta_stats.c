@@ -0,0 +1,296 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <time.h>
+
+#include "tmeta_priv.h"
+
+
+/* Number of counter shards; threads are assigned a shard in a round-robin
+ * fashion to limit the cache line contention on the counters */
+#define SHARD_COUNT 16
+
+
+#define STAT_LOAD(_p) __atomic_load_n((_p), __ATOMIC_RELAXED)
+#define STAT_STORE(_p, _v) __atomic_store_n((_p), (_v), __ATOMIC_RELAXED)
+#define STAT_ADD(_p, _v) __atomic_fetch_add((_p), (_v), __ATOMIC_RELAXED)
+
+
+struct shard {
+	struct tmeta_stats stats;
+} __attribute__((aligned(64)));
+
+
+uint32_t tmeta_stats_flags;
+static struct shard shards[SHARD_COUNT];
+static uint32_t shard_next;
+static __thread int shard_index = -1;
+
+
+static struct tmeta_stats *get_shard_stats(void)
+{
+	if (shard_index < 0)
+		shard_index = STAT_ADD(&shard_next, 1) % SHARD_COUNT;
+	return &shards[shard_index].stats;
+}
+
+
+static void histogram_add(struct tmeta_stats_histogram *histo, uint64_t val)
+{
+	unsigned int bucket = 0;
+	uint64_t max;
+
+	if (val > 0) {
+		bucket = 64 - __builtin_clzll(val);
+		if (bucket >= TMETA_STATS_HISTOGRAM_BUCKETS)
+			bucket = TMETA_STATS_HISTOGRAM_BUCKETS - 1;
+	}
+
+	STAT_ADD(&histo->count, 1);
+	STAT_ADD(&histo->sum, val);
+	STAT_ADD(&histo->buckets[bucket], 1);
+
+	max = STAT_LOAD(&histo->max);
+	while (val > max) {
+		if (__atomic_compare_exchange_n(&histo->max,
+						&max,
+						val,
+						true,
+						__ATOMIC_RELAXED,
+						__ATOMIC_RELAXED))
+			break;
+	}
+}
+
+
+static void histogram_merge(struct tmeta_stats_histogram *dst,
+			    struct tmeta_stats_histogram *src)
+{
+	uint64_t max;
+
+	dst->count += STAT_LOAD(&src->count);
+	dst->sum += STAT_LOAD(&src->sum);
+	max = STAT_LOAD(&src->max);
+	if (max > dst->max)
+		dst->max = max;
+	for (unsigned int i = 0; i < TMETA_STATS_HISTOGRAM_BUCKETS; i++)
+		dst->buckets[i] += STAT_LOAD(&src->buckets[i]);
+}
+
+
+static enum tmeta_stats_failure failure_from_err(int err)
+{
+	switch (err) {
+	case -ENOENT:
+		return TMETA_STATS_FAILURE_NOT_THERMAL;
+	case TMETA_ERR_SHORT_HEADER:
+		return TMETA_STATS_FAILURE_SHORT_HEADER;
+	case TMETA_ERR_BAD_MAJOR_VERSION:
+		return TMETA_STATS_FAILURE_BAD_MAJOR_VERSION;
+	case TMETA_ERR_TRUNCATED_HEADER:
+		return TMETA_STATS_FAILURE_TRUNCATED_HEADER;
+	case TMETA_ERR_TOO_MANY_CAM_ANGLES:
+		return TMETA_STATS_FAILURE_TOO_MANY_CAM_ANGLES;
+	case TMETA_ERR_TRUNCATED_CAM_ANGLES:
+		return TMETA_STATS_FAILURE_TRUNCATED_CAM_ANGLES;
+	case TMETA_ERR_TRUNCATED_JPEG:
+		return TMETA_STATS_FAILURE_TRUNCATED_JPEG;
+	case TMETA_ERR_TRUNCATED_V0_2:
+		return TMETA_STATS_FAILURE_TRUNCATED_V0_2;
+	case TMETA_ERR_TRUNCATED_V0_3:
+		return TMETA_STATS_FAILURE_TRUNCATED_V0_3;
+	case TMETA_ERR_TRUNCATED_V0_4:
+		return TMETA_STATS_FAILURE_TRUNCATED_V0_4;
+	case TMETA_ERR_TRUNCATED_V0_5:
+		return TMETA_STATS_FAILURE_TRUNCATED_V0_5;
+	case TMETA_ERR_BAD_CHECKSUM:
+		return TMETA_STATS_FAILURE_BAD_CHECKSUM;
+	case -ENOBUFS:
+		return TMETA_STATS_FAILURE_NO_CAPACITY;
+	default:
+		return TMETA_STATS_FAILURE_OTHER;
+	}
+}
+
+
+uint64_t tmeta_stats_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+
+void tmeta_stats_record_serialize(size_t size, uint64_t start)
+{
+	struct tmeta_stats *stats = get_shard_stats();
+
+	STAT_ADD(&stats->serialized_frames, 1);
+	STAT_ADD(&stats->serialized_bytes, size);
+	if (start != 0)
+		histogram_add(&stats->serialize_ns,
+			      tmeta_stats_clock_ns() - start);
+}
+
+
+void tmeta_stats_record_deserialize(uint32_t version,
+				    uint32_t cam_angles_count,
+				    uint32_t jpeg_data_size,
+				    size_t size,
+				    int res,
+				    uint64_t start)
+{
+	struct tmeta_stats *stats = get_shard_stats();
+	unsigned int minor;
+
+	if (start != 0)
+		histogram_add(&stats->deserialize_ns,
+			      tmeta_stats_clock_ns() - start);
+
+	if (res < 0) {
+		STAT_ADD(&stats->deserialize_failures, 1);
+		STAT_ADD(&stats->failures[failure_from_err(res)], 1);
+		return;
+	}
+
+	STAT_ADD(&stats->deserialized_frames, 1);
+	STAT_ADD(&stats->deserialized_bytes, size);
+	minor = TMETA_GET_MINOR_VERSION(version);
+	if (minor >= TMETA_STATS_VERSION_COUNT)
+		minor = TMETA_STATS_VERSION_COUNT - 1;
+	STAT_ADD(&stats->versions[minor], 1);
+	histogram_add(&stats->cam_angles_count, cam_angles_count);
+	histogram_add(&stats->jpeg_data_size, jpeg_data_size);
+}
+
+
+void tmeta_stats_record_to_json(uint64_t start)
+{
+	struct tmeta_stats *stats = get_shard_stats();
+
+	STAT_ADD(&stats->json_frames, 1);
+	if (start != 0)
+		histogram_add(&stats->to_json_ns,
+			      tmeta_stats_clock_ns() - start);
+}
+
+
+int tmeta_stats_enable(uint32_t flags)
+{
+	ULOG_ERRNO_RETURN_ERR_IF((flags & ~(TMETA_STATS_FLAG_COUNTERS |
+					    TMETA_STATS_FLAG_LATENCY)) != 0,
+				 EINVAL);
+
+	STAT_STORE(&tmeta_stats_flags, flags);
+
+	return 0;
+}
+
+
+int tmeta_stats_get(struct tmeta_stats *stats)
+{
+	ULOG_ERRNO_RETURN_ERR_IF(stats == NULL, EINVAL);
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (unsigned int s = 0; s < SHARD_COUNT; s++) {
+		struct tmeta_stats *src = &shards[s].stats;
+		stats->serialized_frames += STAT_LOAD(&src->serialized_frames);
+		stats->serialized_bytes += STAT_LOAD(&src->serialized_bytes);
+		stats->deserialized_frames +=
+			STAT_LOAD(&src->deserialized_frames);
+		stats->deserialized_bytes +=
+			STAT_LOAD(&src->deserialized_bytes);
+		stats->deserialize_failures +=
+			STAT_LOAD(&src->deserialize_failures);
+		for (unsigned int i = 0; i < TMETA_STATS_FAILURE_COUNT; i++)
+			stats->failures[i] += STAT_LOAD(&src->failures[i]);
+		for (unsigned int i = 0; i < TMETA_STATS_VERSION_COUNT; i++)
+			stats->versions[i] += STAT_LOAD(&src->versions[i]);
+		stats->json_frames += STAT_LOAD(&src->json_frames);
+		histogram_merge(&stats->cam_angles_count,
+				&src->cam_angles_count);
+		histogram_merge(&stats->jpeg_data_size, &src->jpeg_data_size);
+		histogram_merge(&stats->serialize_ns, &src->serialize_ns);
+		histogram_merge(&stats->deserialize_ns, &src->deserialize_ns);
+		histogram_merge(&stats->to_json_ns, &src->to_json_ns);
+	}
+
+	return 0;
+}
+
+
+int tmeta_stats_reset(void)
+{
+	/* The stats structure only contains 64-bit counters */
+	for (unsigned int s = 0; s < SHARD_COUNT; s++) {
+		uint64_t *counters = (uint64_t *)&shards[s].stats;
+		size_t count = sizeof(shards[s].stats) / sizeof(uint64_t);
+		for (size_t i = 0; i < count; i++)
+			STAT_STORE(&counters[i], 0);
+	}
+
+	return 0;
+}
+
+
+const char *tmeta_stats_failure_to_str(enum tmeta_stats_failure failure)
+{
+	switch (failure) {
+	case TMETA_STATS_FAILURE_NOT_THERMAL:
+		return "NOT_THERMAL";
+	case TMETA_STATS_FAILURE_SHORT_HEADER:
+		return "SHORT_HEADER";
+	case TMETA_STATS_FAILURE_BAD_MAJOR_VERSION:
+		return "BAD_MAJOR_VERSION";
+	case TMETA_STATS_FAILURE_TRUNCATED_HEADER:
+		return "TRUNCATED_HEADER";
+	case TMETA_STATS_FAILURE_TOO_MANY_CAM_ANGLES:
+		return "TOO_MANY_CAM_ANGLES";
+	case TMETA_STATS_FAILURE_TRUNCATED_CAM_ANGLES:
+		return "TRUNCATED_CAM_ANGLES";
+	case TMETA_STATS_FAILURE_TRUNCATED_JPEG:
+		return "TRUNCATED_JPEG";
+	case TMETA_STATS_FAILURE_TRUNCATED_V0_2:
+		return "TRUNCATED_V0_2";
+	case TMETA_STATS_FAILURE_TRUNCATED_V0_3:
+		return "TRUNCATED_V0_3";
+	case TMETA_STATS_FAILURE_TRUNCATED_V0_4:
+		return "TRUNCATED_V0_4";
+	case TMETA_STATS_FAILURE_TRUNCATED_V0_5:
+		return "TRUNCATED_V0_5";
+	case TMETA_STATS_FAILURE_BAD_CHECKSUM:
+		return "BAD_CHECKSUM";
+	case TMETA_STATS_FAILURE_NO_CAPACITY:
+		return "NO_CAPACITY";
+	case TMETA_STATS_FAILURE_OTHER:
+		return "OTHER";
+	default:
+		return "UNKNOWN";
+	}
+}
@@ -0,0 +1,978 @@
+/**
+ * Copyright (c) 2017 Parrot Drones SAS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the Parrot Drones SAS Company nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE PARROT DRONES SAS COMPANY BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <json-c/json.h>
+
+#include <metadata-thermal/tmeta.h>
+#include <metadata-thermal/tmeta_accum.h>
+#include <metadata-thermal/tmeta_colorize.h>
+#include <metadata-thermal/tmeta_gen.h>
+#include <metadata-thermal/tmeta_hotspot.h>
+#include <metadata-thermal/tmeta_remap.h>
+#include <metadata-thermal/tmeta_rescale.h>
+#include <metadata-thermal/tmeta_stats.h>
+
+
+#define DEFAULT_DURATION 10.
+#define DEFAULT_POOL_SIZE 1024
+#define DEFAULT_SEED 1
+#define DEFAULT_PLANE_WIDTH 640
+#define DEFAULT_PLANE_HEIGHT 512
+
+/* Synthetic planes per thread for the image stages */
+#define PLANE_POOL_SIZE 4
+
+/* Persistence threshold of the temporal accumulator in Kelvin */
+#define ACCUM_THRESHOLD 313.15
+
+/* Hotspot threshold as an 8-bit value of each frame */
+#define HOTSPOT_THRESHOLD_VALUE 200
+
+#define MAX_REGIONS 16
+
+/* Visible camera of the remap stage (about 69 degrees horizontal field of
+ * view); the thermal camera has the synthetic plane size and about
+ * 50 degrees horizontal field of view. Focal lengths are given relative to
+ * the image width */
+#define REMAP_VISIBLE_WIDTH 1280
+#define REMAP_VISIBLE_HEIGHT 720
+#define REMAP_VISIBLE_FOCAL 0.73
+#define REMAP_THERMAL_FOCAL 1.07
+
+/* Latency histogram: log-linear buckets with 2^HIST_SUB_BITS linear
+ * sub-buckets per power of 2 (about 6% relative precision) */
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+
+struct config {
+	unsigned int threads;
+	double duration;
+	uint64_t frames;
+	uint64_t seed;
+	unsigned int minor_version;
+	unsigned int pool_size;
+	double rate;
+	bool json;
+	bool json_parse;
+	bool stats;
+	unsigned int plane_width;
+	unsigned int plane_height;
+	bool rescale;
+	bool colorize;
+	bool accum;
+	bool hotspot;
+	bool remap;
+};
+
+
+struct worker {
+	const struct config *config;
+	unsigned int index;
+	pthread_t thread;
+	bool thread_created;
+
+	/* Pre-generated SEIs */
+	uint8_t *pool;
+	size_t *offsets;
+	size_t *sizes;
+
+	/* Synthetic planes (raw for the rescale stage, 8-bit otherwise) */
+	uint16_t *raw_planes;
+	uint8_t *planes;
+
+	/* Image stages */
+	uint8_t *rescaled;
+	struct tmeta_rescale_result rescale;
+	uint8_t *rgba;
+	struct tmeta_colorizer *colorizer;
+	struct tmeta_accum *accum;
+	struct tmeta_hotspot *hotspot;
+	struct tmeta_hotspot_region regions[MAX_REGIONS];
+	struct tmeta_remap *remap;
+	uint8_t *warped;
+	uint8_t *warped_rgba;
+
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t elapsed_ns;
+	uint64_t hist[HIST_BUCKETS];
+};
+
+
+static pthread_barrier_t start_barrier;
+static int stop_requested;
+
+
+static const char short_options[] = "ht:d:n:s:m:p:r:jJSP:RcaHM";
+
+
+static const struct option long_options[] = {
+	{"help", no_argument, NULL, 'h'},
+	{"threads", required_argument, NULL, 't'},
+	{"duration", required_argument, NULL, 'd'},
+	{"frames", required_argument, NULL, 'n'},
+	{"seed", required_argument, NULL, 's'},
+	{"minor", required_argument, NULL, 'm'},
+	{"pool", required_argument, NULL, 'p'},
+	{"rate", required_argument, NULL, 'r'},
+	{"json", no_argument, NULL, 'j'},
+	{"json-parse", no_argument, NULL, 'J'},
+	{"stats", no_argument, NULL, 'S'},
+	{"plane", required_argument, NULL, 'P'},
+	{"rescale", no_argument, NULL, 'R'},
+	{"colorize", no_argument, NULL, 'c'},
+	{"accum", no_argument, NULL, 'a'},
+	{"hotspot", no_argument, NULL, 'H'},
+	{"remap", no_argument, NULL, 'M'},
+	{0, 0, 0, 0},
+};
+
+
+static void usage(char *prog_name)
+{
+	/* clang-format off */
+	printf("Usage: %s [options]\n"
+	       "Thermal metadata load test: each thread decodes synthetic "
+	       "SEIs\nand runs the selected downstream stages\n\n"
+	       "Options:\n"
+	       "-h | --help                  Print this message\n"
+	       "-t | --threads <n>           Number of threads "
+	       "(default: number of CPUs)\n"
+	       "-d | --duration <s>          Test duration in seconds "
+	       "(default: %.0f)\n"
+	       "-n | --frames <n>            Frames per thread "
+	       "(instead of a duration)\n"
+	       "-s | --seed <seed>           Generator seed (default: %d)\n"
+	       "-m | --minor <minor>         SEI minor version "
+	       "(1 to %d, default: %d)\n"
+	       "-p | --pool <n>              Pre-generated SEIs per thread "
+	       "(default: %d)\n"
+	       "-r | --rate <fps>            Frame rate per thread "
+	       "(default: unlimited); the latency\n"
+	       "                             is then measured from the "
+	       "scheduled frame time\n"
+	       "-j | --json                  Add the JSON writer stage\n"
+	       "-J | --json-parse            Add the JSON parser stage "
+	       "(implies --json)\n"
+	       "-S | --stats                 Enable the library stats\n"
+	       "-P | --plane <w>x<h>         Synthetic plane size of the "
+	       "image stages\n"
+	       "                             (default: %dx%d)\n"
+	       "-R | --rescale               Add the raw frame rescale "
+	       "stage (predictive mode);\n"
+	       "                             the next image stages then use "
+	       "the rescaled plane\n"
+	       "-c | --colorize              Add the colorize stage "
+	       "(smoothed range, RGBA output)\n"
+	       "-a | --accum                 Add the temporal accumulator "
+	       "stage (default window)\n"
+	       "-H | --hotspot               Add the hotspot detection "
+	       "stage (single thread)\n"
+	       "-M | --remap                 Add the thermal to visible "
+	       "reprojection stage\n"
+	       "                             (%dx%d U8 warp, and RGBA warp "
+	       "with --colorize)\n"
+	       "\n"
+	       "The JPEG data of the SEIs is not decoded: the image stages "
+	       "process synthetic\nplanes generated before the test, with "
+	       "the metadata of the decoded SEIs.\n"
+	       "The archive writer is not a stage: its cost is dominated by "
+	       "the file I/O,\nwhich would measure the storage rather than "
+	       "the library.\n"
+	       "\n",
+	       prog_name,
+	       DEFAULT_DURATION,
+	       DEFAULT_SEED,
+	       TMETA_MINOR_VERSION,
+	       TMETA_MINOR_VERSION,
+	       DEFAULT_POOL_SIZE,
+	       DEFAULT_PLANE_WIDTH,
+	       DEFAULT_PLANE_HEIGHT,
+	       REMAP_VISIBLE_WIDTH,
+	       REMAP_VISIBLE_HEIGHT);
+	/* clang-format on */
+}
+
+
+static uint64_t clock_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void sleep_until_ns(uint64_t t)
+{
+	struct timespec ts = {
+		.tv_sec = t / 1000000000ULL,
+		.tv_nsec = t % 1000000000ULL,
+	};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+
+static unsigned int hist_bucket(uint64_t v)
+{
+	if (v < HIST_SUB_COUNT)
+		return (unsigned int)v;
+	unsigned int msb = 63 - __builtin_clzll(v);
+	unsigned int shift = msb - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB_COUNT +
+	       (unsigned int)((v >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+
+/* Upper bound of a bucket */
+static uint64_t hist_value(unsigned int bucket)
+{
+	if (bucket < HIST_SUB_COUNT)
+		return bucket;
+	unsigned int shift = bucket / HIST_SUB_COUNT - 1;
+	uint64_t sub = bucket % HIST_SUB_COUNT;
+	return ((HIST_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+
+static uint64_t hist_percentile(const uint64_t *hist,
+				uint64_t count,
+				double percentile)
+{
+	uint64_t rank = (uint64_t)(percentile / 100. * (double)count);
+	uint64_t sum = 0;
+
+	if (rank >= count)
+		rank = count - 1;
+	for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+		sum += hist[i];
+		if (sum > rank)
+			return hist_value(i);
+	}
+	return 0;
+}
+
+
+static int worker_generate(struct worker *w)
+{
+	int res;
+	struct tmeta_gen *gen = NULL;
+	struct tmeta_gen_config gen_config;
+	struct tmeta_data meta;
+	const void *sei;
+	size_t sei_size, total = 0, capacity = 0;
+	unsigned int count = w->config->pool_size;
+
+	memset(&gen_config, 0, sizeof(gen_config));
+	gen_config.seed = w->config->seed + w->index;
+	gen_config.minor_version = w->config->minor_version;
+
+	res = tmeta_gen_new(&gen_config, &gen);
+	if (res < 0) {
+		fprintf(stderr, "tmeta_gen_new: %s\n", strerror(-res));
+		return res;
+	}
+
+	w->offsets = calloc(count, sizeof(*w->offsets));
+	w->sizes = calloc(count, sizeof(*w->sizes));
+	if ((w->offsets == NULL) || (w->sizes == NULL)) {
+		res = -ENOMEM;
+		goto out;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		res = tmeta_gen_next(gen, &meta, &sei, &sei_size);
+		if (res < 0) {
+			fprintf(stderr, "tmeta_gen_next: %s\n", strerror(-res));
+			goto out;
+		}
+		if (total + sei_size > capacity) {
+			size_t new_capacity = 2 * (total + sei_size);
+			uint8_t *pool = realloc(w->pool, new_capacity);
+			if (pool == NULL) {
+				res = -ENOMEM;
+				goto out;
+			}
+			w->pool = pool;
+			capacity = new_capacity;
+		}
+		memcpy(w->pool + total, sei, sei_size);
+		w->offsets[i] = total;
+		w->sizes[i] = sei_size;
+		total += sei_size;
+	}
+
+out:
+	tmeta_gen_destroy(gen);
+	return res;
+}
+
+
+static uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+
+/* Synthetic scene: vertical gradient with noise and a hot disc whose
+ * position depends on the plane index; v is in 0..1 */
+static double plane_value(unsigned int x,
+			  unsigned int y,
+			  unsigned int width,
+			  unsigned int height,
+			  unsigned int index,
+			  uint32_t *state)
+{
+	double cx = width * (index + 1) / (PLANE_POOL_SIZE + 1.);
+	double cy = height / 2.;
+	double r = (width < height ? width : height) / 8.;
+	double dx = x - cx, dy = y - cy;
+	double v = 0.2 + 0.4 * y / height +
+		   0.05 * (xorshift32(state) & 0xFF) / 255.;
+
+	if (dx * dx + dy * dy < r * r)
+		v = 0.9 + 0.1 * (1. - (dx * dx + dy * dy) / (r * r));
+	return v;
+}
+
+
+static int worker_generate_planes(struct worker *w)
+{
+	const struct config *config = w->config;
+	unsigned int width = config->plane_width;
+	unsigned int height = config->plane_height;
+	size_t plane_size = (size_t)width * height;
+	uint32_t state = (uint32_t)(config->seed + w->index) | 1;
+
+	if (config->rescale) {
+		w->raw_planes = malloc(PLANE_POOL_SIZE * plane_size *
+				       sizeof(*w->raw_planes));
+		w->rescaled = malloc(plane_size);
+		if ((w->raw_planes == NULL) || (w->rescaled == NULL))
+			return -ENOMEM;
+	} else {
+		w->planes = malloc(PLANE_POOL_SIZE * plane_size);
+		if (w->planes == NULL)
+			return -ENOMEM;
+	}
+
+	for (unsigned int i = 0; i < PLANE_POOL_SIZE; i++) {
+		for (unsigned int y = 0; y < height; y++) {
+			for (unsigned int x = 0; x < width; x++) {
+				size_t offset = i * plane_size +
+						(size_t)y * width + x;
+				double v = plane_value(
+					x, y, width, height, i, &state);
+				if (config->rescale) {
+					/* 14-bit raw values */
+					w->raw_planes[offset] =
+						(uint16_t)(6000. + v * 4000.);
+				} else {
+					w->planes[offset] =
+						(uint8_t)(v * 255. + 0.5);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+static int worker_init_stages(struct worker *w)
+{
+	int res;
+	const struct config *config = w->config;
+
+	if (!config->rescale && !config->colorize && !config->accum &&
+	    !config->hotspot && !config->remap)
+		return 0;
+
+	res = worker_generate_planes(w);
+	if (res < 0) {
+		fprintf(stderr, "worker_generate_planes: %s\n", strerror(-res));
+		return res;
+	}
+
+	if (config->colorize) {
+		struct tmeta_colorizer_config colorizer_config;
+		memset(&colorizer_config, 0, sizeof(colorizer_config));
+		colorizer_config.palette = TMETA_PALETTE_IRON;
+		colorizer_config.range_mode = TMETA_RANGE_MODE_SMOOTHED;
+		w->rgba = malloc((size_t)config->plane_width *
+				 config->plane_height * 4);
+		if (w->rgba == NULL)
+			return -ENOMEM;
+		res = tmeta_colorizer_new(&colorizer_config, &w->colorizer);
+		if (res < 0) {
+			fprintf(stderr,
+				"tmeta_colorizer_new: %s\n",
+				strerror(-res));
+			return res;
+		}
+	}
+
+	if (config->accum) {
+		struct tmeta_accum_config accum_config;
+		memset(&accum_config, 0, sizeof(accum_config));
+		accum_config.width = config->plane_width;
+		accum_config.height = config->plane_height;
+		accum_config.threshold = ACCUM_THRESHOLD;
+		res = tmeta_accum_new(&accum_config, &w->accum);
+		if (res < 0) {
+			fprintf(stderr, "tmeta_accum_new: %s\n", strerror(-res));
+			return res;
+		}
+	}
+
+	if (config->hotspot) {
+		/* The load test threads already use the CPUs */
+		struct tmeta_hotspot_config hotspot_config;
+		memset(&hotspot_config, 0, sizeof(hotspot_config));
+		hotspot_config.width = config->plane_width;
+		hotspot_config.height = config->plane_height;
+		hotspot_config.threads = 1;
+		res = tmeta_hotspot_new(&hotspot_config, &w->hotspot);
+		if (res < 0) {
+			fprintf(stderr,
+				"tmeta_hotspot_new: %s\n",
+				strerror(-res));
+			return res;
+		}
+	}
+
+	if (config->remap) {
+		struct tmeta_remap_config remap_config;
+		size_t visible_size =
+			(size_t)REMAP_VISIBLE_WIDTH * REMAP_VISIBLE_HEIGHT;
+		memset(&remap_config, 0, sizeof(remap_config));
+		remap_config.thermal.width = config->plane_width;
+		remap_config.thermal.height = config->plane_height;
+		remap_config.thermal.fx =
+			REMAP_THERMAL_FOCAL * config->plane_width;
+		remap_config.thermal.fy = remap_config.thermal.fx;
+		remap_config.thermal.cx = (config->plane_width - 1) / 2.;
+		remap_config.thermal.cy = (config->plane_height - 1) / 2.;
+		remap_config.visible.width = REMAP_VISIBLE_WIDTH;
+		remap_config.visible.height = REMAP_VISIBLE_HEIGHT;
+		remap_config.visible.fx =
+			REMAP_VISIBLE_FOCAL * REMAP_VISIBLE_WIDTH;
+		remap_config.visible.fy = remap_config.visible.fx;
+		remap_config.visible.cx = (REMAP_VISIBLE_WIDTH - 1) / 2.;
+		remap_config.visible.cy = (REMAP_VISIBLE_HEIGHT - 1) / 2.;
+		w->warped = malloc(visible_size);
+		if (w->warped == NULL)
+			return -ENOMEM;
+		if (config->colorize) {
+			w->warped_rgba = malloc(visible_size * 4);
+			if (w->warped_rgba == NULL)
+				return -ENOMEM;
+		}
+		res = tmeta_remap_new(&remap_config, &w->remap);
+		if (res < 0) {
+			fprintf(stderr,
+				"tmeta_remap_new: %s\n",
+				strerror(-res));
+			return res;
+		}
+	}
+
+	return 0;
+}
+
+
+static int process_image(struct worker *w,
+			 unsigned int index,
+			 struct tmeta_data *meta)
+{
+	int res;
+	const struct config *config = w->config;
+	unsigned int width = config->plane_width;
+	unsigned int height = config->plane_height;
+	size_t plane_size = (size_t)width * height;
+	unsigned int plane_index = index % PLANE_POOL_SIZE;
+	const uint8_t *plane;
+
+	if (config->rescale) {
+		/* The rescale sets value_min and value_max to the range of
+		 * the rescaled plane */
+		res = tmeta_rescale_raw_frame(
+			w->raw_planes + plane_index * plane_size,
+			width * sizeof(*w->raw_planes),
+			width,
+			height,
+			w->rescaled,
+			width,
+			TMETA_RESCALE_MODE_PREDICTIVE,
+			meta,
+			&w->rescale);
+		if (res < 0)
+			return res;
+		plane = w->rescaled;
+	} else {
+		plane = w->planes + plane_index * plane_size;
+	}
+
+	if (config->colorize) {
+		res = tmeta_colorizer_update(w->colorizer, meta);
+		if (res < 0)
+			return res;
+		res = tmeta_colorizer_apply(w->colorizer,
+					    plane,
+					    width,
+					    w->rgba,
+					    (size_t)width * 4,
+					    width,
+					    height);
+		if (res < 0)
+			return res;
+	}
+
+	if (config->accum) {
+		res = tmeta_accum_push(w->accum, plane, width, meta);
+		if (res < 0)
+			return res;
+	}
+
+	if (config->hotspot) {
+		double raw, threshold;
+		unsigned int count;
+		raw = meta->value_min + HOTSPOT_THRESHOLD_VALUE *
+						(double)(meta->value_max -
+							 meta->value_min) /
+						255.;
+		res = tmeta_raw_to_temperature(meta, raw, &threshold);
+		if (res < 0)
+			return res;
+		res = tmeta_hotspot_detect(w->hotspot,
+					   plane,
+					   width,
+					   meta,
+					   threshold,
+					   w->regions,
+					   MAX_REGIONS,
+					   &count);
+		/* Frames that are not valid are skipped */
+		if ((res < 0) && (res != -EAGAIN))
+			return res;
+	}
+
+	if (config->remap) {
+		res = tmeta_remap_update(w->remap, meta, NULL);
+		if (res < 0)
+			return res;
+		res = tmeta_remap_warp(w->remap,
+				       TMETA_REMAP_FORMAT_U8,
+				       plane,
+				       width,
+				       w->warped,
+				       REMAP_VISIBLE_WIDTH);
+		if (res < 0)
+			return res;
+		if (config->colorize) {
+			res = tmeta_remap_warp(w->remap,
+					       TMETA_REMAP_FORMAT_RGBA,
+					       w->rgba,
+					       (size_t)width * 4,
+					       w->warped_rgba,
+					       (size_t)REMAP_VISIBLE_WIDTH * 4);
+			if (res < 0)
+				return res;
+		}
+	}
+
+	return 0;
+}
+
+
+static int process_frame(struct worker *w, unsigned int index)
+{
+	int res;
+	struct tmeta_data meta;
+	struct json_object *jobj;
+	const char *str;
+
+	res = tmeta_deserialize_thermal_metadata_user_data_sei(
+		w->pool + w->offsets[index], w->sizes[index], &meta);
+	if (res < 0)
+		return res;
+
+	res = process_image(w, index, &meta);
+	if ((res < 0) || !w->config->json)
+		return res;
+
+	jobj = json_object_new_object();
+	if (jobj == NULL)
+		return -ENOMEM;
+	res = tmeta_thermal_metadata_to_json(&meta, jobj);
+	if (res < 0)
+		goto out;
+	str = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PLAIN);
+	if (str == NULL) {
+		res = -ENOMEM;
+		goto out;
+	}
+	if (w->config->json_parse) {
+		res = tmeta_thermal_metadata_from_json_str(
+			str, strlen(str), &meta, NULL);
+	}
+
+out:
+	json_object_put(jobj);
+	return res;
+}
+
+
+static void *worker_run(void *userdata)
+{
+	struct worker *w = userdata;
+	const struct config *config = w->config;
+	uint64_t period_ns = 0, start, scheduled, t0, t1;
+	unsigned int i = 0;
+
+	if (config->rate > 0.)
+		period_ns = (uint64_t)(1e9 / config->rate);
+
+	pthread_barrier_wait(&start_barrier);
+	start = clock_ns();
+	scheduled = start;
+
+	while (true) {
+		if (config->frames > 0) {
+			if (w->frames >= config->frames)
+				break;
+		} else if (__atomic_load_n(&stop_requested, __ATOMIC_RELAXED)) {
+			break;
+		}
+
+		if (period_ns > 0) {
+			sleep_until_ns(scheduled);
+			t0 = scheduled;
+			scheduled += period_ns;
+		} else {
+			t0 = clock_ns();
+		}
+
+		if (process_frame(w, i) < 0)
+			w->errors++;
+		t1 = clock_ns();
+
+		w->hist[hist_bucket(t1 - t0)]++;
+		w->frames++;
+		w->bytes += w->sizes[i];
+		if (++i == config->pool_size)
+			i = 0;
+	}
+
+	w->elapsed_ns = clock_ns() - start;
+	return NULL;
+}
+
+
+static void print_report(const struct config *config,
+			 struct worker *workers)
+{
+	uint64_t frames = 0, bytes = 0, errors = 0, elapsed_ns = 0;
+	double min_fps = 0., max_fps = 0., seconds;
+	static uint64_t hist[HIST_BUCKETS];
+	static const double percentiles[] = {50., 90., 99., 99.9, 99.99};
+
+	for (unsigned int t = 0; t < config->threads; t++) {
+		struct worker *w = &workers[t];
+		double fps = (w->elapsed_ns > 0)
+				     ? (double)w->frames * 1e9 / w->elapsed_ns
+				     : 0.;
+		frames += w->frames;
+		bytes += w->bytes;
+		errors += w->errors;
+		if (w->elapsed_ns > elapsed_ns)
+			elapsed_ns = w->elapsed_ns;
+		if ((t == 0) || (fps < min_fps))
+			min_fps = fps;
+		if ((t == 0) || (fps > max_fps))
+			max_fps = fps;
+		for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+			hist[i] += w->hist[i];
+	}
+
+	seconds = (double)elapsed_ns * 1e-9;
+	printf("threads: %u, minor version: %u, "
+	       "stages: deserialize%s%s%s%s%s%s%s%s\n",
+	       config->threads,
+	       config->minor_version,
+	       config->rescale ? ", rescale" : "",
+	       config->colorize ? ", colorize" : "",
+	       config->accum ? ", accum" : "",
+	       config->hotspot ? ", hotspot" : "",
+	       config->remap ? ", remap" : "",
+	       config->json ? ", to_json" : "",
+	       config->json_parse ? ", from_json_str" : "",
+	       config->stats ? " (stats enabled)" : "");
+	if (config->rescale || config->colorize || config->accum ||
+	    config->hotspot || config->remap) {
+		printf("synthetic plane: %ux%u\n",
+		       config->plane_width,
+		       config->plane_height);
+	}
+	if (config->remap) {
+		printf("remap visible frame: %ux%u\n",
+		       REMAP_VISIBLE_WIDTH,
+		       REMAP_VISIBLE_HEIGHT);
+	}
+	printf("frames: %" PRIu64 " in %.3f s, errors: %" PRIu64 "\n",
+	       frames,
+	       seconds,
+	       errors);
+	if ((frames == 0) || (seconds <= 0.))
+		return;
+	printf("throughput: %.0f frames/s, %.1f MB/s "
+	       "(per thread: min %.0f, max %.0f frames/s)\n",
+	       (double)frames / seconds,
+	       (double)bytes / seconds / 1e6,
+	       min_fps,
+	       max_fps);
+	printf("latency (us):");
+	for (unsigned int i = 0; i < sizeof(percentiles) / sizeof(*percentiles);
+	     i++) {
+		printf(" p%g=%.2f",
+		       percentiles[i],
+		       hist_percentile(hist, frames, percentiles[i]) * 1e-3);
+	}
+	printf(" max=%.2f\n", hist_percentile(hist, frames, 100.) * 1e-3);
+
+	if (config->stats) {
+		struct tmeta_stats stats;
+		if (tmeta_stats_get(&stats) == 0) {
+			printf("library stats: deserialized %" PRIu64
+			       " frames, %" PRIu64 " failures\n",
+			       stats.deserialized_frames,
+			       stats.deserialize_failures);
+		}
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	int res, status = EXIT_SUCCESS;
+	int idx, c;
+	struct config config;
+	struct worker *workers = NULL;
+	long cpus;
+
+	memset(&config, 0, sizeof(config));
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	config.threads = (cpus > 0) ? (unsigned int)cpus : 1;
+	config.duration = DEFAULT_DURATION;
+	config.seed = DEFAULT_SEED;
+	config.minor_version = TMETA_MINOR_VERSION;
+	config.pool_size = DEFAULT_POOL_SIZE;
+	config.plane_width = DEFAULT_PLANE_WIDTH;
+	config.plane_height = DEFAULT_PLANE_HEIGHT;
+
+	while ((c = getopt_long(
+			argc, argv, short_options, long_options, &idx)) != -1) {
+		switch (c) {
+		case 0:
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+			break;
+		case 't':
+			config.threads = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			config.duration = strtod(optarg, NULL);
+			break;
+		case 'n':
+			config.frames = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			config.seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'm':
+			config.minor_version = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			config.pool_size = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			config.rate = strtod(optarg, NULL);
+			break;
+		case 'j':
+			config.json = true;
+			break;
+		case 'J':
+			config.json = true;
+			config.json_parse = true;
+			break;
+		case 'S':
+			config.stats = true;
+			break;
+		case 'P':
+			if (sscanf(optarg,
+				   "%ux%u",
+				   &config.plane_width,
+				   &config.plane_height) != 2) {
+				config.plane_width = 0;
+				config.plane_height = 0;
+			}
+			break;
+		case 'R':
+			config.rescale = true;
+			break;
+		case 'c':
+			config.colorize = true;
+			break;
+		case 'a':
+			config.accum = true;
+			break;
+		case 'H':
+			config.hotspot = true;
+			break;
+		case 'M':
+			config.remap = true;
+			break;
+		default:
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+			break;
+		}
+	}
+
+	if ((config.threads == 0) || (config.pool_size == 0) ||
+	    (config.minor_version < 1) ||
+	    (config.minor_version > TMETA_MINOR_VERSION) ||
+	    (config.plane_width == 0) || (config.plane_height == 0) ||
+	    ((config.frames == 0) && !(config.duration > 0.))) {
+		fprintf(stderr, "Invalid arguments\n");
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	workers = calloc(config.threads, sizeof(*workers));
+	if (workers == NULL) {
+		fprintf(stderr, "calloc: %s\n", strerror(ENOMEM));
+		exit(EXIT_FAILURE);
+	}
+
+	for (unsigned int t = 0; t < config.threads; t++) {
+		workers[t].config = &config;
+		workers[t].index = t;
+		res = worker_generate(&workers[t]);
+		if (res < 0) {
+			status = EXIT_FAILURE;
+			goto out;
+		}
+		res = worker_init_stages(&workers[t]);
+		if (res < 0) {
+			status = EXIT_FAILURE;
+			goto out;
+		}
+	}
+
+	/* Enable the stats after the generation so that only the processed
+	 * frames are accounted */
+	if (config.stats) {
+		tmeta_stats_reset();
+		tmeta_stats_enable(TMETA_STATS_FLAG_COUNTERS |
+				   TMETA_STATS_FLAG_LATENCY);
+	}
+
+	res = pthread_barrier_init(&start_barrier, NULL, config.threads + 1);
+	if (res != 0) {
+		fprintf(stderr, "pthread_barrier_init: %s\n", strerror(res));
+		status = EXIT_FAILURE;
+		goto out;
+	}
+
+	for (unsigned int t = 0; t < config.threads; t++) {
+		res = pthread_create(
+			&workers[t].thread, NULL, worker_run, &workers[t]);
+		if (res != 0) {
+			fprintf(stderr, "pthread_create: %s\n", strerror(res));
+			/* Threads waiting on the barrier cannot be released:
+			 * give up */
+			exit(EXIT_FAILURE);
+		}
+		workers[t].thread_created = true;
+	}
+
+	pthread_barrier_wait(&start_barrier);
+	if (config.frames == 0) {
+		sleep_until_ns(clock_ns() + (uint64_t)(config.duration * 1e9));
+		__atomic_store_n(&stop_requested, 1, __ATOMIC_RELAXED);
+	}
+
+	for (unsigned int t = 0; t < config.threads; t++) {
+		if (workers[t].thread_created)
+			pthread_join(workers[t].thread, NULL);
+	}
+	pthread_barrier_destroy(&start_barrier);
+
+	print_report(&config, workers);
+
+out:
+	for (unsigned int t = 0; t < config.threads; t++) {
+		free(workers[t].pool);
+		free(workers[t].offsets);
+		free(workers[t].sizes);
+		free(workers[t].raw_planes);
+		free(workers[t].planes);
+		free(workers[t].rescaled);
+		free(workers[t].rgba);
+		tmeta_colorizer_destroy(workers[t].colorizer);
+		tmeta_accum_destroy(workers[t].accum);
+		tmeta_hotspot_destroy(workers[t].hotspot);
+		tmeta_remap_destroy(workers[t].remap);
+		free(workers[t].warped);
+		free(workers[t].warped_rgba);
+	}
+	free(workers);
+
+	return status;
+}